@@ -6,4 +6,9 @@ struct String;
 
 struct String *compile_classes(const struct Map *classes);
 
+// Compiles the classes into separate files, which can be built in parallel:
+// a shared header, runtime.c, and class_<name>.c for each class. Returns a
+// map from the file names to their contents
+struct Map *compile_classes_split(const struct Map *classes);
+
 #endif
@@ -2,13 +2,17 @@
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-command.h"
 #include "glasstypes/glass-function.h"
+#include "utils/copy-interface.h"
 #include "utils/list.h"
 #include "utils/map.h"
 #include "utils/set.h"
 #include "utils/string.h"
 
 #include <ctype.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 extern const char *RUNTIME_LIBRARY[];
 
@@ -79,6 +83,11 @@ String *make_quoted_string(const String *str) {
     return quoted;
 }
 
+bool is_local_name(const String *name) {
+    char c = string_get(name, 0);
+    return !isupper(c) && !islower(c);
+}
+
 Set *get_all_names(const Map *classes) {
     List *class_names = map_get_keys(classes);
     Set *all_names = new_set(STRING_HASH_OPS);
@@ -177,16 +186,14 @@ void generate_name_enum(String *code, const Map *classes) {
         string_add_str(code, name);
         string_add_chars(code, ": return ");
 
-        char c = string_get(name, 0);
-
-        if (isupper(c)) {
-            string_add_chars(code, "SCOPE_GLOBAL;\n");
+        if (is_local_name(name)) {
+            string_add_chars(code, "SCOPE_LOCAL;\n");
         }
-        else if (islower(c)) {
-            string_add_chars(code, "SCOPE_CLASSWIDE;\n");
+        else if (isupper(string_get(name, 0))) {
+            string_add_chars(code, "SCOPE_GLOBAL;\n");
         }
         else {
-            string_add_chars(code, "SCOPE_LOCAL;\n");
+            string_add_chars(code, "SCOPE_CLASSWIDE;\n");
         }
     }
 
@@ -276,245 +283,1528 @@ void generate_string_literals(String *code, const Map *classes) {
     free_set(string_set);
 }
 
-void generate_function(String *code, const GlassClass *gclass, const GlassFunction *func) {
-    const String *class_name = class_get_name(gclass);
-    const String *func_name = func_get_name(func);
-    String *mangled_name = mangle_name(class_name, func_name);
+// Returns the local names used by a function, which are given C locals
+List *get_local_names(const GlassFunction *func) {
+    Set *name_set = new_set(STRING_HASH_OPS);
 
-    string_add_chars(code, "void ");
-    string_add_str(code, mangled_name);
-    string_add_chars(code, "(size_t inst_index) {\n");
+    for (size_t i = 0; i < func_len(func); i++) {
+        const GlassCommand *cmd = func_get_command(func, i);
 
-    int indent_level = 1;
+        if ((cmd->type == CMD_PUSH_NAME || cmd->type == CMD_LOOP_BEGIN) && is_local_name(cmd->str)) {
+            set_add(name_set, cmd->str);
+        }
+    }
 
-    add_indents(code, indent_level);
-    string_add_chars(code, "Map *local_vars = new_map();\n");
-    add_indents(code, indent_level);
-    string_add_chars(code, "GlassValue *tmp, *tmp2, *tmp3;\n");
-    add_indents(code, indent_level);
-    string_add_chars(code, "void (*ctor)(size_t);\n");
-    add_indents(code, indent_level);
-    string_add_chars(code, "size_t index;\n");
-    add_indents(code, indent_level);
+    List *names = set_to_list(name_set);
+    free_set(name_set);
+    return names;
+}
 
-    // Disable warnings for unused variables
-    string_add_chars(code, "(void) local_vars;");
-    add_indents(code, indent_level);
-    string_add_chars(code, "(void) tmp;");
-    add_indents(code, indent_level);
-    string_add_chars(code, "(void) tmp2;");
-    add_indents(code, indent_level);
-    string_add_chars(code, "(void) tmp3;");
-    add_indents(code, indent_level);
-    string_add_chars(code, "(void) ctor;");
-    add_indents(code, indent_level);
-    string_add_chars(code, "(void) index;");
-    add_indents(code, indent_level);
-    string_add_chars(code, "(void) inst_index;");
+// Returns the class-wide names used as variables by a class's functions,
+// which are given fixed slots in its instances. Names that are only used to
+// get functions are left out
+List *get_field_names(const GlassClass *gclass) {
+    Set *name_set = new_set(STRING_HASH_OPS);
+    List *func_names = class_get_func_names(gclass);
 
-    for (size_t i = 0; i < func_len(func); i++) {
-        const GlassCommand *cmd = func_get_command(func, i);
+    for (size_t i = 0; i < list_len(func_names); i++) {
+        const GlassFunction *func = class_get_func(gclass, list_get(func_names, i));
 
-        add_indents(code, indent_level);
+        for (size_t j = 0; j < func_len(func); j++) {
+            const GlassCommand *cmd = func_get_command(func, j);
+            bool gets_func = j + 1 < func_len(func) && func_get_command(func, j + 1)->type == CMD_GET_FUNC;
 
-        switch (cmd->type) {
-            case CMD_ASSIGN_VAL: {
-                string_add_chars(code, "tmp2 = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "set_var(tmp->name, tmp2, local_vars, inst_index);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "free_value(tmp);\n");
-                break;
+            if ((cmd->type == CMD_PUSH_NAME || cmd->type == CMD_LOOP_BEGIN) && islower(string_get(cmd->str, 0)) &&
+                !(cmd->type == CMD_PUSH_NAME && gets_func)) {
+                set_add(name_set, cmd->str);
             }
+        }
+    }
 
-            case CMD_ASSIGN_SELF: {
-                string_add_chars(code, "tmp = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp2 = new_inst_value(inst_index);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "set_var(tmp->name, tmp2, local_vars, inst_index);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "free_value(tmp);\n");
-                break;
-            }
+    List *names = set_to_list(name_set);
+    free_list(func_names);
+    free_set(name_set);
+    return names;
+}
 
-            case CMD_BUILTIN: {
-                String *builtin_name = builtin_func_name(cmd->builtin);
-                string_add_str(code, builtin_name);
-                string_add_chars(code, "();\n");
-                free_string(builtin_name);
-                break;
+// While generating a function, the top of the stack is tracked at compile
+// time. Anything below the tracked entries is on the runtime stack, and the
+// entries are spilled onto it wherever its effects aren't known
+typedef enum EntryType {
+    // A name pushed by the function, which is only looked up statically
+    ENTRY_NAME,
+    // A value held in the C temporary s<depth>
+    ENTRY_VALUE,
+    // An unboxed number held in the C temporary d<depth>
+    ENTRY_NUMBER,
+    // A builtin function of a known class, which is run inline
+    ENTRY_BUILTIN,
+    // A function of a known class, which is called directly on the instance
+    // index held in the C temporary i<depth>
+    ENTRY_METHOD,
+} EntryType;
+
+typedef struct StackEntry {
+    EntryType type;
+
+    // The pushed name, or the name of a function
+    const String *name;
+
+    const String *class_name;
+
+    BuiltinFunc builtin;
+} StackEntry;
+
+typedef enum VarType {
+    VAR_UNKNOWN,
+    VAR_NUMBER,
+    VAR_INST,
+} VarType;
+
+// What's known about a local variable at some point in a function. Numbers
+// are kept unboxed in the C local num_<name> where possible, in which case
+// local_<name> is out of date
+typedef struct LocalState {
+    VarType type;
+
+    // The class of an instance
+    const String *class_name;
+
+    bool unboxed;
+} LocalState;
+
+// What's known about the class-wide and global variables of a program, which
+// is gathered from every assignment to them before any code is generated.
+// Variables that are only ever set to new instances of one class are known
+// to hold instances of it
+typedef struct ProgramVars {
+    // The class of each variable's instances, keyed by the variable name,
+    // prefixed by its class for class-wide variables
+    Map *var_classes;
+
+    // Variables that are set to anything else
+    Set *mixed_vars;
+
+    // Names that end up on the runtime stack, and so can be set through names
+    // that aren't known statically
+    Set *escaped_names;
+
+    bool complete;
+} ProgramVars;
+
+typedef struct FuncGen {
+    String *code;
+
+    int indent_level;
+
+    const Map *classes;
+
+    const String *class_name;
+
+    const GlassFunction *func;
+
+    ProgramVars *vars;
+
+    List *locals;
+
+    // The fields of the function's class
+    List *fields;
+
+    // The current state of each local, in the same order as locals
+    LocalState *local_states;
+
+    // The states of the locals at the start of each loop, indexed by the
+    // loop's first command. These are joined with the states at the end of
+    // the loop until nothing changes
+    LocalState **loop_states;
+
+    bool loops_changed;
+
+    StackEntry *stack;
+
+    size_t stack_len;
+
+    size_t stack_alloc;
+
+    size_t num_temps;
+
+    // Whether the function runs itself again in place of a call at its end
+    bool has_tail_call;
+} FuncGen;
+
+// Returns the index of a name in a list of locals or fields, or the list's
+// length if it isn't there
+size_t name_index(const List *names, const String *name) {
+    size_t len = list_len(names);
+
+    for (size_t i = 0; i < len; i++) {
+        if (strings_equal(list_get(names, i), name)) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+// Boxed locals live in an array, so that the function's frame can hand them
+// to the garbage collector
+void add_local(String *code, const List *locals, const String *name) {
+    char buf[40];
+    sprintf(buf, "locals[%zu]", name_index(locals, name));
+    string_add_chars(code, buf);
+}
+
+bool is_field_name(const List *fields, const String *name) {
+    return name != NULL && name_index(fields, name) < list_len(fields);
+}
+
+void add_field(String *code, const List *fields, const String *name) {
+    char buf[80];
+    sprintf(buf, "instances[inst_index].fields[%zu]", name_index(fields, name));
+    string_add_chars(code, buf);
+}
+
+void add_unboxed_local(String *code, const String *name) {
+    string_add_chars(code, "num_");
+    string_add_str(code, name);
+}
+
+void add_temp(String *code, size_t index) {
+    char buf[40];
+    sprintf(buf, "s%zu", index);
+    string_add_chars(code, buf);
+}
+
+void add_number_temp(String *code, size_t index) {
+    char buf[40];
+    sprintf(buf, "d%zu", index);
+    string_add_chars(code, buf);
+}
+
+// Writes a C double literal that keeps the number exactly, including the
+// sign of zero and of NaN
+void add_number_literal(String *code, double num) {
+    char buf[40];
+    if (isnan(num)) {
+        string_add_chars(code, signbit(num) ? "-NAN" : "NAN");
+        return;
+    }
+    if (isinf(num)) {
+        string_add_chars(code, num < 0 ? "-INFINITY" : "INFINITY");
+        return;
+    }
+
+    sprintf(buf, "%.17g", num);
+    string_add_chars(code, buf);
+    if (strpbrk(buf, ".e") == NULL) {
+        string_add_chars(code, ".0");
+    }
+}
+
+void add_index_temp(String *code, size_t index) {
+    char buf[40];
+    sprintf(buf, "i%zu", index);
+    string_add_chars(code, buf);
+}
+
+// Returns the index of a local name, or list_len(locals) if the name isn't
+// a local
+size_t find_local(const FuncGen *gen, const String *name) {
+    if (name == NULL || !is_local_name(name)) {
+        return list_len(gen->locals);
+    }
+
+    return name_index(gen->locals, name);
+}
+
+// Generates code that stores an unboxed local in its GlassValue
+void box_local(FuncGen *gen, size_t index) {
+    LocalState *state = &gen->local_states[index];
+
+    if (state->unboxed) {
+        const String *name = list_get(gen->locals, index);
+
+        add_indents(gen->code, gen->indent_level);
+        string_add_chars(gen->code, "set_local(&");
+        add_local(gen->code, gen->locals, name);
+        string_add_chars(gen->code, ", new_number_value(");
+        add_unboxed_local(gen->code, name);
+        string_add_chars(gen->code, "));\n");
+
+        state->unboxed = false;
+    }
+}
+
+// Boxes every local, which has to be done before they're accessed by names
+// that aren't known statically
+void box_locals(FuncGen *gen) {
+    for (size_t i = 0; i < list_len(gen->locals); i++) {
+        box_local(gen, i);
+    }
+}
+
+// Forgets what's known about the locals, after one of them has been set by a
+// name that isn't known statically
+void reset_locals(FuncGen *gen) {
+    box_locals(gen);
+
+    for (size_t i = 0; i < list_len(gen->locals); i++) {
+        gen->local_states[i] = (LocalState) {VAR_UNKNOWN, NULL, false};
+    }
+}
+
+// Generates code that moves the locals into the boxing given by states,
+// where any local that's unboxed in states is known to be a number
+void convert_locals(FuncGen *gen, const LocalState *states) {
+    for (size_t i = 0; i < list_len(gen->locals); i++) {
+        if (states[i].unboxed && !gen->local_states[i].unboxed) {
+            const String *name = list_get(gen->locals, i);
+
+            add_indents(gen->code, gen->indent_level);
+            add_unboxed_local(gen->code, name);
+            string_add_chars(gen->code, " = ");
+            add_local(gen->code, gen->locals, name);
+            string_add_chars(gen->code, "->num;\n");
+        }
+        else if (!states[i].unboxed) {
+            box_local(gen, i);
+        }
+
+        gen->local_states[i] = states[i];
+    }
+}
+
+// Joins the states of the locals from another path into states, returning
+// true if anything changed. Numbers are unboxed wherever both paths agree
+bool join_local_states(LocalState *states, const LocalState *other, size_t len) {
+    bool changed = false;
+
+    for (size_t i = 0; i < len; i++) {
+        bool same = states[i].type == other[i].type &&
+            (states[i].type != VAR_INST || strings_equal(states[i].class_name, other[i].class_name));
+
+        if (!same && states[i].type != VAR_UNKNOWN) {
+            states[i] = (LocalState) {VAR_UNKNOWN, NULL, false};
+            changed = true;
+        }
+
+        states[i].unboxed = states[i].type == VAR_NUMBER;
+    }
+
+    return changed;
+}
+
+// Generates code that sets the variable named by name_var to value_var. If
+// the name isn't known, a switch picks out the function's C locals
+void generate_set_var(String *code, int indent_level, const List *locals, const List *fields,
+                      const String *known_name, const char *name_var, const char *value_var) {
+    if (known_name != NULL && (is_local_name(known_name) || is_field_name(fields, known_name))) {
+        string_add_chars(code, "set_local(&");
+        if (is_local_name(known_name)) {
+            add_local(code, locals, known_name);
+        }
+        else {
+            add_field(code, fields, known_name);
+        }
+        string_add_chars(code, ", ");
+        string_add_chars(code, value_var);
+        string_add_chars(code, ");\n");
+        return;
+    }
+
+    if (known_name == NULL && !list_empty(locals)) {
+        string_add_chars(code, "switch (");
+        string_add_chars(code, name_var);
+        string_add_chars(code, "->name) {\n");
+
+        for (size_t i = 0; i < list_len(locals); i++) {
+            const String *local = list_get(locals, i);
+
+            add_indents(code, indent_level + 1);
+            string_add_chars(code, "case NAME_");
+            string_add_str(code, local);
+            string_add_chars(code, ": set_local(&");
+            add_local(code, locals, local);
+            string_add_chars(code, ", ");
+            string_add_chars(code, value_var);
+            string_add_chars(code, "); break;\n");
+        }
+
+        add_indents(code, indent_level + 1);
+        string_add_chars(code, "default: ");
+    }
+
+    string_add_chars(code, "set_var(");
+    if (known_name != NULL) {
+        string_add_chars(code, "NAME_");
+        string_add_str(code, known_name);
+    }
+    else {
+        string_add_chars(code, name_var);
+        string_add_chars(code, "->name");
+    }
+    string_add_chars(code, ", ");
+    string_add_chars(code, value_var);
+    string_add_chars(code, ", &local_vars, inst_index);\n");
+
+    if (known_name == NULL && !list_empty(locals)) {
+        add_indents(code, indent_level);
+        string_add_chars(code, "}\n");
+    }
+}
+
+// Generates code that sets dest_var to the variable named by name_var
+void generate_get_var(String *code, int indent_level, const List *locals, const List *fields,
+                      const String *known_name, const char *name_var, const char *dest_var) {
+    if (known_name != NULL && (is_local_name(known_name) || is_field_name(fields, known_name))) {
+        string_add_chars(code, dest_var);
+        string_add_chars(code, " = ");
+        if (is_local_name(known_name)) {
+            add_local(code, locals, known_name);
+        }
+        else {
+            add_field(code, fields, known_name);
+        }
+        string_add_chars(code, ";\n");
+        return;
+    }
+
+    if (known_name == NULL && !list_empty(locals)) {
+        string_add_chars(code, "switch (");
+        string_add_chars(code, name_var);
+        string_add_chars(code, "->name) {\n");
+
+        for (size_t i = 0; i < list_len(locals); i++) {
+            const String *local = list_get(locals, i);
+
+            add_indents(code, indent_level + 1);
+            string_add_chars(code, "case NAME_");
+            string_add_str(code, local);
+            string_add_chars(code, ": ");
+            string_add_chars(code, dest_var);
+            string_add_chars(code, " = ");
+            add_local(code, locals, local);
+            string_add_chars(code, "; break;\n");
+        }
+
+        add_indents(code, indent_level + 1);
+        string_add_chars(code, "default: ");
+    }
+
+    string_add_chars(code, dest_var);
+    string_add_chars(code, " = get_var(");
+    if (known_name != NULL) {
+        string_add_chars(code, "NAME_");
+        string_add_str(code, known_name);
+    }
+    else {
+        string_add_chars(code, name_var);
+        string_add_chars(code, "->name");
+    }
+    string_add_chars(code, ", local_vars, inst_index);\n");
+
+    if (known_name == NULL && !list_empty(locals)) {
+        add_indents(code, indent_level);
+        string_add_chars(code, "}\n");
+    }
+}
+
+// Pushes a tracked entry, returning its index
+size_t push_entry(FuncGen *gen, StackEntry entry) {
+    if (gen->stack_len == gen->stack_alloc) {
+        gen->stack_alloc = gen->stack_alloc == 0 ? 16 : gen->stack_alloc * 2;
+        gen->stack = realloc(gen->stack, sizeof(StackEntry) * gen->stack_alloc);
+    }
+
+    size_t index = gen->stack_len++;
+    gen->stack[index] = entry;
+
+    if (index + 1 > gen->num_temps) {
+        gen->num_temps = index + 1;
+    }
+
+    return index;
+}
+
+size_t push_value(FuncGen *gen) {
+    return push_entry(gen, (StackEntry) {ENTRY_VALUE, NULL, NULL, 0});
+}
+
+size_t push_number(FuncGen *gen) {
+    return push_entry(gen, (StackEntry) {ENTRY_NUMBER, NULL, NULL, 0});
+}
+
+const StackEntry *top_entry(const FuncGen *gen) {
+    return gen->stack_len > 0 ? &gen->stack[gen->stack_len - 1] : NULL;
+}
+
+// Adds an expression for a new reference to a tracked entry
+void add_entry_value(FuncGen *gen, size_t index) {
+    const StackEntry *entry = &gen->stack[index];
+    String *code = gen->code;
+
+    switch (entry->type) {
+        case ENTRY_NAME: {
+            set_add(gen->vars->escaped_names, entry->name);
+            string_add_chars(code, "copy_value(&nameValue_");
+            string_add_str(code, entry->name);
+            string_add_chars(code, ")");
+            break;
+        }
+
+        case ENTRY_VALUE: {
+            add_temp(code, index);
+            break;
+        }
+
+        case ENTRY_NUMBER: {
+            string_add_chars(code, "new_number_value(");
+            add_number_temp(code, index);
+            string_add_chars(code, ")");
+            break;
+        }
+
+        case ENTRY_BUILTIN:
+        case ENTRY_METHOD: {
+            String *mangled_name = mangle_name(entry->class_name, entry->name);
+            string_add_chars(code, "new_func_value(");
+            if (entry->type == ENTRY_METHOD) {
+                add_index_temp(code, index);
+            }
+            else {
+                string_add_chars(code, "0");
             }
+            string_add_chars(code, ", ");
+            string_add_str(code, mangled_name);
+            string_add_chars(code, ")");
+            free_string(mangled_name);
+            break;
+        }
+    }
+}
+
+// Generates code that moves every tracked entry onto the runtime stack
+void spill_stack(FuncGen *gen) {
+    for (size_t i = 0; i < gen->stack_len; i++) {
+        add_indents(gen->code, gen->indent_level);
+        string_add_chars(gen->code, "stack_push(");
+        add_entry_value(gen, i);
+        string_add_chars(gen->code, ");\n");
+    }
+
+    gen->stack_len = 0;
+}
+
+// Generates code that pops the top of the stack into dest_var
+void pop_value(FuncGen *gen, const char *dest_var) {
+    if (gen->stack_len == 0) {
+        add_indents(gen->code, gen->indent_level);
+        string_add_chars(gen->code, dest_var);
+        string_add_chars(gen->code, " = stack_pop();\n");
+        return;
+    }
+
+    add_indents(gen->code, gen->indent_level);
+    string_add_chars(gen->code, dest_var);
+    string_add_chars(gen->code, " = ");
+    add_entry_value(gen, --gen->stack_len);
+    string_add_chars(gen->code, ";\n");
+}
+
+// Pops a name off the stack, returning it if it's known. Otherwise, code is
+// generated that pops it into dest_var, which has to be freed after use
+const String *pop_name(FuncGen *gen, const char *dest_var) {
+    const StackEntry *top = top_entry(gen);
+
+    if (top != NULL && top->type == ENTRY_NAME) {
+        gen->stack_len--;
+        return top->name;
+    }
+
+    pop_value(gen, dest_var);
+    return NULL;
+}
+
+// Pops a number off the stack, writing the C expression for it to expr. If
+// it isn't an unboxed number, it's first moved into scratch_var
+void pop_number(FuncGen *gen, const char *scratch_var, char *expr) {
+    const StackEntry *top = top_entry(gen);
+
+    if (top != NULL && top->type == ENTRY_NUMBER) {
+        sprintf(expr, "d%zu", --gen->stack_len);
+        return;
+    }
+
+    pop_value(gen, "tmp");
+    add_indents(gen->code, gen->indent_level);
+    string_add_chars(gen->code, scratch_var);
+    string_add_chars(gen->code, " = tmp->num;\n");
+    add_indents(gen->code, gen->indent_level);
+    string_add_chars(gen->code, "free_value(tmp);\n");
+    sprintf(expr, "%s", scratch_var);
+}
+
+void free_popped_name(FuncGen *gen, const String *name, const char *var) {
+    if (name == NULL) {
+        add_indents(gen->code, gen->indent_level);
+        string_add_chars(gen->code, "free_value(");
+        string_add_chars(gen->code, var);
+        string_add_chars(gen->code, ");\n");
+    }
+}
+
+// Adds the name constant for a popped name, or the name held by var
+void add_popped_name(FuncGen *gen, const String *name, const char *var) {
+    if (name != NULL) {
+        string_add_chars(gen->code, "NAME_");
+        string_add_str(gen->code, name);
+    }
+    else {
+        string_add_chars(gen->code, var);
+        string_add_chars(gen->code, "->name");
+    }
+}
+
+String *var_key(const FuncGen *gen, const String *name) {
+    if (isupper(string_get(name, 0))) {
+        return copy_string(name);
+    }
+
+    String *key = copy_string(gen->class_name);
+    string_add_char(key, '.');
+    string_add_str(key, name);
+    return key;
+}
+
+// Records an assignment to a class-wide or global variable, of an instance of
+// the given class, or of anything else if it's NULL
+void record_var_set(FuncGen *gen, const String *name, const String *class_name) {
+    String *key = var_key(gen, name);
+    const String *var_class = map_get(gen->vars->var_classes, key);
+
+    if (class_name == NULL || (var_class != NULL && !strings_equal(var_class, class_name))) {
+        set_add(gen->vars->mixed_vars, key);
+    }
+    else if (var_class == NULL) {
+        map_set(gen->vars->var_classes, key, class_name);
+    }
+
+    free_string(key);
+}
+
+// Returns the class of the instances that a variable always holds, or NULL if
+// it isn't known
+const String *find_var_class(const FuncGen *gen, const String *name) {
+    size_t local = find_local(gen, name);
+
+    if (local < list_len(gen->locals)) {
+        const LocalState *state = &gen->local_states[local];
+        return state->type == VAR_INST ? state->class_name : NULL;
+    }
+
+    if (name == NULL || !gen->vars->complete || set_has(gen->vars->escaped_names, name)) {
+        return NULL;
+    }
+
+    String *key = var_key(gen, name);
+    const String *var_class = set_has(gen->vars->mixed_vars, key) ? NULL : map_get(gen->vars->var_classes, key);
+    free_string(key);
+
+    return var_class;
+}
+
+// Generates code that sets the variable with the given name, or the name in
+// tmp if it isn't known, to the value in tmp2
+void set_popped_var(FuncGen *gen, const String *name, LocalState state) {
+    size_t local = find_local(gen, name);
+
+    if (name != NULL && local == list_len(gen->locals)) {
+        record_var_set(gen, name, state.type == VAR_INST ? state.class_name : NULL);
+    }
+
+    if (name == NULL) {
+        reset_locals(gen);
+    }
+
+    add_indents(gen->code, gen->indent_level);
+    generate_set_var(gen->code, gen->indent_level, gen->locals, gen->fields, name, "tmp", "tmp2");
+    free_popped_name(gen, name, "tmp");
+
+    if (local < list_len(gen->locals)) {
+        gen->local_states[local] = state;
+    }
+}
+
+// Returns true if the given class exists and has the function
+bool find_class_func(const FuncGen *gen, const String *class_name, const String *func_name) {
+    const GlassClass *gclass = map_get(gen->classes, class_name);
+    return gclass != NULL && class_has_func(gclass, func_name);
+}
+
+// Returns true if the function of the given class just runs a builtin, which
+// can then be run inline. Builtins that use their instance are called normally
+bool find_builtin(const FuncGen *gen, const String *class_name, const String *func_name,
+                  BuiltinFunc *builtin) {
+    const GlassClass *gclass = map_get(gen->classes, class_name);
+    if (gclass == NULL) {
+        return false;
+    }
+
+    const GlassFunction *func = class_get_func(gclass, func_name);
+    if (func == NULL || func_len(func) != 1) {
+        return false;
+    }
+
+    const GlassCommand *cmd = func_get_command(func, 0);
+    if (cmd->type != CMD_BUILTIN || builtin_uses_instance(cmd->builtin)) {
+        return false;
+    }
+
+    *builtin = cmd->builtin;
+    return true;
+}
+
+bool is_math_builtin(BuiltinFunc builtin) {
+    switch (builtin) {
+        case BUILTIN_MATH_ADD:
+        case BUILTIN_MATH_DIVIDE:
+        case BUILTIN_MATH_EQUAL:
+        case BUILTIN_MATH_FLOOR:
+        case BUILTIN_MATH_GREATER_OR_EQUAL:
+        case BUILTIN_MATH_GREATER_THAN:
+        case BUILTIN_MATH_LESS_OR_EQUAL:
+        case BUILTIN_MATH_LESS_THAN:
+        case BUILTIN_MATH_MODULO:
+        case BUILTIN_MATH_MULTIPLY:
+        case BUILTIN_MATH_NOT_EQUAL:
+        case BUILTIN_MATH_SUBTRACT:
+            return true;
+
+        default:
+            return false;
+    }
+}
 
-            case CMD_DUPLICATE: {
-                char buf[80];
-                sprintf(buf, "duplicate(%zu);\n", cmd->index);
+// Generates a math builtin as plain double arithmetic, matching the
+// implementations in builtins.txt
+void generate_math_builtin(FuncGen *gen, BuiltinFunc builtin) {
+    char val1[40], val2[40], buf[160];
+
+    pop_number(gen, "num", val1);
+
+    if (builtin == BUILTIN_MATH_FLOOR) {
+        sprintf(buf, "floor(%s)", val1);
+    }
+    else {
+        pop_number(gen, "num2", val2);
+
+        switch (builtin) {
+            case BUILTIN_MATH_ADD: sprintf(buf, "%s + %s", val1, val2); break;
+            case BUILTIN_MATH_DIVIDE: sprintf(buf, "%s / %s", val2, val1); break;
+            case BUILTIN_MATH_EQUAL: sprintf(buf, "%s == %s ? 1.0 : 0.0", val1, val2); break;
+            case BUILTIN_MATH_GREATER_OR_EQUAL: sprintf(buf, "%s <= %s ? 1.0 : 0.0", val1, val2); break;
+            case BUILTIN_MATH_GREATER_THAN: sprintf(buf, "%s < %s ? 1.0 : 0.0", val1, val2); break;
+            case BUILTIN_MATH_LESS_OR_EQUAL: sprintf(buf, "%s >= %s ? 1.0 : 0.0", val1, val2); break;
+            case BUILTIN_MATH_LESS_THAN: sprintf(buf, "%s > %s ? 1.0 : 0.0", val1, val2); break;
+            case BUILTIN_MATH_MODULO: sprintf(buf, "fmod(%s, %s)", val2, val1); break;
+            case BUILTIN_MATH_MULTIPLY: sprintf(buf, "%s * %s", val1, val2); break;
+            case BUILTIN_MATH_NOT_EQUAL: sprintf(buf, "%s != %s ? 1.0 : 0.0", val1, val2); break;
+            default: sprintf(buf, "%s - %s", val2, val1); break;
+        }
+    }
+
+    size_t index = push_number(gen);
+    add_indents(gen->code, gen->indent_level);
+    add_number_temp(gen->code, index);
+    string_add_chars(gen->code, " = ");
+    string_add_chars(gen->code, buf);
+    string_add_chars(gen->code, ";\n");
+}
+
+// Gets the number of values that a builtin implemented in builtins.txt pops
+// and pushes. Returns false if they aren't known
+bool get_builtin_stack_effect(BuiltinFunc builtin, size_t *pops, size_t *pushes) {
+    switch (builtin) {
+        case BUILTIN_INPUT_ARG_COUNT:
+        case BUILTIN_INPUT_ARGUMENT:
+            *pops = 0;
+            *pushes = 1;
+            return true;
+
+        case BUILTIN_OUTPUT_NUM:
+        case BUILTIN_OUTPUT_STR:
+            *pops = 1;
+            *pushes = 0;
+            return true;
+
+        case BUILTIN_STR_LENGTH:
+        case BUILTIN_STR_NUM_TO_STR:
+        case BUILTIN_STR_STR_TO_NUM:
+            *pops = 1;
+            *pushes = 1;
+            return true;
+
+        case BUILTIN_STR_APPEND:
+        case BUILTIN_STR_EQUAL:
+        case BUILTIN_STR_INDEX:
+            *pops = 2;
+            *pushes = 1;
+            return true;
+
+        case BUILTIN_STR_SPLIT:
+            *pops = 2;
+            *pushes = 2;
+            return true;
+
+        case BUILTIN_STR_REPLACE:
+            *pops = 3;
+            *pushes = 1;
+            return true;
+
+        case BUILTIN_LIST_LENGTH:
+        case BUILTIN_LIST_POP:
+            *pops = 0;
+            *pushes = 1;
+            return true;
+
+        case BUILTIN_LIST_GET:
+            *pops = 1;
+            *pushes = 1;
+            return true;
+
+        case BUILTIN_LIST_PUSH:
+            *pops = 1;
+            *pushes = 0;
+            return true;
+
+        case BUILTIN_LIST_SET:
+            *pops = 2;
+            *pushes = 0;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Generates a direct call to a builtin. When its stack effect is known, only
+// its arguments are moved onto the runtime stack, and its results are moved
+// back into temporaries
+void generate_builtin_call(FuncGen *gen, BuiltinFunc builtin) {
+    String *code = gen->code;
+    size_t pops, pushes;
+    bool known_effect = get_builtin_stack_effect(builtin, &pops, &pushes) && pops <= gen->stack_len;
+
+    if (known_effect) {
+        size_t base = gen->stack_len - pops;
+
+        for (size_t i = base; i < gen->stack_len; i++) {
+            add_indents(code, gen->indent_level);
+            string_add_chars(code, "stack_push(");
+            add_entry_value(gen, i);
+            string_add_chars(code, ");\n");
+        }
+        gen->stack_len = base;
+    }
+    else {
+        spill_stack(gen);
+    }
+
+    String *builtin_name = builtin_func_name(builtin);
+    add_indents(code, gen->indent_level);
+    string_add_str(code, builtin_name);
+    string_add_chars(code, builtin_uses_instance(builtin) ? "(inst_index);\n" : "();\n");
+    free_string(builtin_name);
+
+    if (known_effect) {
+        size_t base = gen->stack_len;
+
+        for (size_t i = 0; i < pushes; i++) {
+            push_value(gen);
+        }
+
+        for (size_t i = pushes; i > 0; i--) {
+            add_indents(code, gen->indent_level);
+            add_temp(code, base + i - 1);
+            string_add_chars(code, " = stack_pop();\n");
+        }
+    }
+}
+
+// Generates a builtin inline, rather than calling it through its class
+void generate_builtin(FuncGen *gen, BuiltinFunc builtin) {
+    String *code = gen->code;
+
+    if (is_math_builtin(builtin)) {
+        generate_math_builtin(gen, builtin);
+    }
+    else if (builtin == BUILTIN_OUTPUT_NUM) {
+        char val[40];
+        pop_number(gen, "num", val);
+
+        add_indents(code, gen->indent_level);
+        string_add_chars(code, "printf(\"%g\", ");
+        string_add_chars(code, val);
+        string_add_chars(code, ");\n");
+    }
+    else if (builtin == BUILTIN_OUTPUT_STR) {
+        pop_value(gen, "tmp");
+
+        add_indents(code, gen->indent_level);
+        string_add_chars(code, "fwrite(tmp->str->buf, sizeof(char), tmp->str->len, stdout);\n");
+        add_indents(code, gen->indent_level);
+        string_add_chars(code, "free_value(tmp);\n");
+    }
+    else {
+        generate_builtin_call(gen, builtin);
+    }
+}
+
+// Generates the loop condition, reading the loop variable
+void generate_loop_condition(FuncGen *gen, const String *name) {
+    size_t local = find_local(gen, name);
+    String *code = gen->code;
+
+    add_indents(code, gen->indent_level);
+
+    if (local < list_len(gen->locals) && gen->local_states[local].unboxed) {
+        string_add_chars(code, "while (");
+        add_unboxed_local(code, name);
+        string_add_chars(code, " != 0.0) {\n");
+    }
+    else if (local < list_len(gen->locals)) {
+        string_add_chars(code, "while (is_truthy(");
+        add_local(code, gen->locals, name);
+        string_add_chars(code, ")) {\n");
+    }
+    else if (is_field_name(gen->fields, name)) {
+        string_add_chars(code, "while (is_truthy(");
+        add_field(code, gen->fields, name);
+        string_add_chars(code, ")) {\n");
+    }
+    else {
+        string_add_chars(code, "while (is_truthy(get_var(NAME_");
+        string_add_str(code, name);
+        string_add_chars(code, ", local_vars, inst_index))) {\n");
+    }
+}
+
+void generate_loop_begin(FuncGen *gen, size_t cmd_index) {
+    size_t num_locals = list_len(gen->locals);
+    LocalState **loop_states = &gen->loop_states[cmd_index];
+
+    // The stack can differ between iterations
+    spill_stack(gen);
+
+    if (*loop_states == NULL) {
+        *loop_states = malloc(sizeof(LocalState) * (num_locals > 0 ? num_locals : 1));
+        memcpy(*loop_states, gen->local_states, sizeof(LocalState) * num_locals);
+    }
+
+    join_local_states(*loop_states, gen->local_states, num_locals);
+    convert_locals(gen, *loop_states);
+
+    generate_loop_condition(gen, func_get_command(gen->func, cmd_index)->str);
+    gen->indent_level++;
+}
+
+void generate_loop_end(FuncGen *gen, size_t begin_index) {
+    LocalState *loop_states = gen->loop_states[begin_index];
+
+    spill_stack(gen);
+
+    if (join_local_states(loop_states, gen->local_states, list_len(gen->locals))) {
+        gen->loops_changed = true;
+    }
+
+    convert_locals(gen, loop_states);
+
+    gen->indent_level--;
+    add_indents(gen->code, gen->indent_level);
+    string_add_chars(gen->code, "}\n");
+}
+
+void generate_get_func(FuncGen *gen) {
+    String *code = gen->code;
+
+    const String *func_name = pop_name(gen, "tmp2");
+    const String *name = pop_name(gen, "tmp");
+
+    const String *class_name = find_var_class(gen, name);
+    BuiltinFunc builtin;
+
+    if (func_name != NULL && class_name != NULL && find_builtin(gen, class_name, func_name, &builtin)) {
+        push_entry(gen, (StackEntry) {ENTRY_BUILTIN, func_name, class_name, builtin});
+        return;
+    }
+
+    if (name == NULL) {
+        box_locals(gen);
+    }
+
+    add_indents(code, gen->indent_level);
+    generate_get_var(code, gen->indent_level, gen->locals, gen->fields, name, "tmp", "tmp3");
+    free_popped_name(gen, name, "tmp");
+
+    // Functions of known classes are called directly
+    if (func_name != NULL && class_name != NULL && find_class_func(gen, class_name, func_name)) {
+        size_t index = push_entry(gen, (StackEntry) {ENTRY_METHOD, func_name, class_name, 0});
+        add_indents(code, gen->indent_level);
+        add_index_temp(code, index);
+        string_add_chars(code, " = tmp3->inst_index;\n");
+        return;
+    }
+
+    size_t index = push_value(gen);
+    add_indents(code, gen->indent_level);
+    add_temp(code, index);
+    string_add_chars(code, " = make_func(tmp3->inst_index, ");
+    add_popped_name(gen, func_name, "tmp2");
+    string_add_chars(code, ");\n");
+    free_popped_name(gen, func_name, "tmp2");
+}
+
+void generate_get_val(FuncGen *gen) {
+    String *code = gen->code;
+
+    const String *name = pop_name(gen, "tmp");
+    size_t local = find_local(gen, name);
+
+    if (local < list_len(gen->locals) && gen->local_states[local].type == VAR_NUMBER) {
+        size_t index = push_number(gen);
+        add_indents(code, gen->indent_level);
+        add_number_temp(code, index);
+        string_add_chars(code, " = ");
+
+        if (gen->local_states[local].unboxed) {
+            add_unboxed_local(code, name);
+        }
+        else {
+            add_local(code, gen->locals, name);
+            string_add_chars(code, "->num");
+        }
+        string_add_chars(code, ";\n");
+        return;
+    }
+
+    if (name == NULL) {
+        box_locals(gen);
+    }
+
+    size_t index = push_value(gen);
+    char temp[40];
+    sprintf(temp, "s%zu", index);
+
+    add_indents(code, gen->indent_level);
+    generate_get_var(code, gen->indent_level, gen->locals, gen->fields, name, "tmp", temp);
+    add_indents(code, gen->indent_level);
+    string_add_chars(code, temp);
+    string_add_chars(code, "->ref_count++;\n");
+    free_popped_name(gen, name, "tmp");
+}
+
+void generate_assign_val(FuncGen *gen) {
+    size_t len = gen->stack_len;
+
+    // Numbers assigned to locals stay unboxed
+    if (len >= 2 && gen->stack[len - 1].type == ENTRY_NUMBER && gen->stack[len - 2].type == ENTRY_NAME) {
+        const String *name = gen->stack[len - 2].name;
+        size_t local = find_local(gen, name);
+
+        if (local < list_len(gen->locals)) {
+            add_indents(gen->code, gen->indent_level);
+            add_unboxed_local(gen->code, name);
+            string_add_chars(gen->code, " = ");
+            add_number_temp(gen->code, len - 1);
+            string_add_chars(gen->code, ";\n");
+
+            gen->stack_len -= 2;
+            gen->local_states[local] = (LocalState) {VAR_NUMBER, NULL, true};
+            return;
+        }
+    }
+
+    pop_value(gen, "tmp2");
+    const String *name = pop_name(gen, "tmp");
+    set_popped_var(gen, name, (LocalState) {VAR_UNKNOWN, NULL, false});
+}
+
+// Returns whether nothing runs after the command at index before the function
+// returns
+bool is_tail_command(const FuncGen *gen, size_t cmd_index) {
+    return cmd_index + 1 == func_len(gen->func) || func_get_command(gen->func, cmd_index + 1)->type == CMD_RETURN;
+}
+
+bool is_current_func(const FuncGen *gen, const String *class_name, const String *func_name) {
+    return strings_equal(class_name, gen->class_name) && strings_equal(func_name, func_get_name(gen->func));
+}
+
+// Generates a call to the function itself at its end as a jump back to its
+// start, so recursion like this runs in constant stack space
+void generate_tail_call(FuncGen *gen, const char *index_expr) {
+    String *code = gen->code;
+    char buf[160];
+
+    add_indents(code, gen->indent_level);
+    sprintf(buf, "inst_index = %s;\n", index_expr);
+    string_add_chars(code, buf);
+    add_indents(code, gen->indent_level);
+    string_add_chars(code, "reenter_frame(&frame, inst_index);\n");
+    add_indents(code, gen->indent_level);
+    string_add_chars(code, "goto tail_call;\n");
+
+    gen->has_tail_call = true;
+}
+
+void generate_new_inst(FuncGen *gen, size_t cmd_index) {
+    String *code = gen->code;
+
+    const String *class_name = pop_name(gen, "tmp2");
+    const String *name = pop_name(gen, "tmp");
+
+    // The constructor can use the stack
+    spill_stack(gen);
+
+    add_indents(code, gen->indent_level);
+    string_add_chars(code, "index = new_instance(CLASSES_ARRAY[");
+    add_popped_name(gen, class_name, "tmp2");
+    string_add_chars(code, "]);\n");
+    free_popped_name(gen, class_name, "tmp2");
+    add_indents(code, gen->indent_level);
+    string_add_chars(code, "tmp2 = new_inst_value(index);\n");
+
+    String *ctor_name = string_from_chars("c__");
+
+    LocalState state = {VAR_UNKNOWN, NULL, false};
+    if (class_name != NULL) {
+        state = (LocalState) {VAR_INST, class_name, false};
+    }
+
+    // A constructor that creates another instance of its class last, into a
+    // local that goes away with its frame, can run again on the new instance
+    if (class_name != NULL && name != NULL && is_local_name(name) && is_tail_command(gen, cmd_index) &&
+        is_current_func(gen, class_name, ctor_name) && find_class_func(gen, class_name, ctor_name))
+    {
+        set_popped_var(gen, name, state);
+        generate_tail_call(gen, "index");
+        free_string(ctor_name);
+        return;
+    }
+
+    if (class_name != NULL && map_has(gen->classes, class_name)) {
+        if (find_class_func(gen, class_name, ctor_name)) {
+            String *mangled_name = mangle_name(class_name, ctor_name);
+            add_indents(code, gen->indent_level);
+            string_add_str(code, mangled_name);
+            string_add_chars(code, "(index);\n");
+            free_string(mangled_name);
+        }
+    }
+    else {
+        add_indents(code, gen->indent_level);
+        string_add_chars(code, "ctor = instances[index].gclass->funcs[NAME_c__];\n");
+        add_indents(code, gen->indent_level);
+        string_add_chars(code, "if (ctor != NULL) {\n");
+        add_indents(code, gen->indent_level + 1);
+        string_add_chars(code, "ctor(index);\n");
+        add_indents(code, gen->indent_level);
+        string_add_chars(code, "}\n");
+    }
+
+    free_string(ctor_name);
+    set_popped_var(gen, name, state);
+}
+
+void generate_command(FuncGen *gen, size_t cmd_index) {
+    const GlassCommand *cmd = func_get_command(gen->func, cmd_index);
+    String *code = gen->code;
+    char buf[160];
+
+    switch (cmd->type) {
+        case CMD_ASSIGN_VAL: {
+            generate_assign_val(gen);
+            break;
+        }
+
+        case CMD_ASSIGN_SELF: {
+            const String *name = pop_name(gen, "tmp");
+
+            add_indents(code, gen->indent_level);
+            string_add_chars(code, "tmp2 = new_inst_value(inst_index);\n");
+            set_popped_var(gen, name, (LocalState) {VAR_INST, gen->class_name, false});
+            break;
+        }
+
+        case CMD_BUILTIN: {
+            generate_builtin(gen, cmd->builtin);
+            break;
+        }
+
+        case CMD_DUPLICATE: {
+            size_t len = gen->stack_len;
+
+            // Values below the tracked entries are read in place
+            if (cmd->index >= len) {
+                size_t index = push_value(gen);
+                add_indents(code, gen->indent_level);
+                sprintf(buf, "s%zu = stack_get(%zu);\n", index, cmd->index - len);
                 string_add_chars(code, buf);
                 break;
             }
 
-            case CMD_EXECUTE_FUNC: {
-                string_add_chars(code, "tmp = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp->func.func(tmp->func.index);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "free_value(tmp);\n");
-                break;
-            }
+            size_t src = len - cmd->index - 1;
+            size_t index = push_entry(gen, gen->stack[src]);
 
-            case CMD_GET_FUNC: {
-                string_add_chars(code, "tmp2 = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp3 = get_var(tmp->name, local_vars, inst_index);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "free_value(tmp);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp = make_func(tmp3->inst_index, tmp2->name);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "stack_push(tmp);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "free_value(tmp2);\n");
-                break;
+            if (gen->stack[src].type == ENTRY_VALUE) {
+                add_indents(code, gen->indent_level);
+                sprintf(buf, "s%zu = s%zu;\n", index, src);
+                string_add_chars(code, buf);
+                add_indents(code, gen->indent_level);
+                sprintf(buf, "s%zu->ref_count++;\n", index);
+                string_add_chars(code, buf);
             }
-
-            case CMD_GET_VAL: {
-                string_add_chars(code, "tmp = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp2 = get_var(tmp->name, local_vars, inst_index);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "stack_push(tmp2);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp2->ref_count++;\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "free_value(tmp);\n");
-                break;
+            else if (gen->stack[src].type == ENTRY_NUMBER) {
+                add_indents(code, gen->indent_level);
+                sprintf(buf, "d%zu = d%zu;\n", index, src);
+                string_add_chars(code, buf);
             }
+            else if (gen->stack[src].type == ENTRY_METHOD) {
+                add_indents(code, gen->indent_level);
+                sprintf(buf, "i%zu = i%zu;\n", index, src);
+                string_add_chars(code, buf);
+            }
+            break;
+        }
+
+        case CMD_EXECUTE_FUNC: {
+            const StackEntry *top = top_entry(gen);
 
-            case CMD_LOOP_BEGIN: {
-                string_add_chars(code, "tmp = get_var(NAME_");
-                string_add_str(code, cmd->str);
-                string_add_chars(code, ", local_vars, inst_index);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "while (is_truthy(tmp)) {\n");
-                indent_level++;
+            if (top != NULL && top->type == ENTRY_BUILTIN) {
+                gen->stack_len--;
+                generate_builtin(gen, top->builtin);
                 break;
             }
 
-            case CMD_LOOP_END: {
-                string_add_chars(code, "tmp = get_var(NAME_");
-                string_add_str(code, cmd->str);
-                string_add_chars(code, ", local_vars, inst_index);\n");
-                indent_level--;
-                add_indents(code, indent_level);
-                string_add_chars(code, "}\n");
+            if (top != NULL && top->type == ENTRY_METHOD) {
+                String *mangled_name = mangle_name(top->class_name, top->name);
+                bool tail_call = is_tail_command(gen, cmd_index) &&
+                                 is_current_func(gen, top->class_name, top->name);
+                size_t index = --gen->stack_len;
+
+                spill_stack(gen);
+
+                if (tail_call) {
+                    sprintf(buf, "i%zu", index);
+                    generate_tail_call(gen, buf);
+                    free_string(mangled_name);
+                    break;
+                }
+
+                add_indents(code, gen->indent_level);
+                string_add_str(code, mangled_name);
+                string_add_char(code, '(');
+                add_index_temp(code, index);
+                string_add_chars(code, ");\n");
+                free_string(mangled_name);
                 break;
             }
 
-            case CMD_NEW_INST: {
-                string_add_chars(code, "tmp2 = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp = stack_pop();\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "index = new_instance(CLASSES_ARRAY[tmp2->name]);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "free_value(tmp2);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp2 = malloc(sizeof(GlassValue));\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp2->type = TYPE_INST;\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp2->inst_index = index;\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "tmp2->ref_count = 1;\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "ctor = instances[index].gclass->funcs[NAME_c__];\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "if (ctor != NULL) {\n");
-                add_indents(code, indent_level + 1);
-                string_add_chars(code, "ctor(index);\n");
-                add_indents(code, indent_level);
+            pop_value(gen, "tmp");
+            spill_stack(gen);
+
+            // The function could turn out to be this one
+            if (is_tail_command(gen, cmd_index)) {
+                String *mangled_name = mangle_name(gen->class_name, func_get_name(gen->func));
+
+                add_indents(code, gen->indent_level);
+                string_add_chars(code, "if (tmp->func.func == ");
+                string_add_str(code, mangled_name);
+                string_add_chars(code, ") {\n");
+                gen->indent_level++;
+                add_indents(code, gen->indent_level);
+                string_add_chars(code, "index = tmp->func.index;\n");
+                add_indents(code, gen->indent_level);
+                string_add_chars(code, "free_value(tmp);\n");
+                generate_tail_call(gen, "index");
+                gen->indent_level--;
+                add_indents(code, gen->indent_level);
                 string_add_chars(code, "}\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "set_var(tmp->name, tmp2, local_vars, inst_index);\n");
-                break;
+                free_string(mangled_name);
             }
 
-            case CMD_POP_STACK: {
+            add_indents(code, gen->indent_level);
+            string_add_chars(code, "tmp->func.func(tmp->func.index);\n");
+            add_indents(code, gen->indent_level);
+            string_add_chars(code, "free_value(tmp);\n");
+            break;
+        }
+
+        case CMD_GET_FUNC: {
+            generate_get_func(gen);
+            break;
+        }
+
+        case CMD_GET_VAL: {
+            generate_get_val(gen);
+            break;
+        }
+
+        case CMD_LOOP_BEGIN: {
+            generate_loop_begin(gen, cmd_index);
+            break;
+        }
+
+        case CMD_LOOP_END: {
+            generate_loop_end(gen, cmd->index);
+            break;
+        }
+
+        case CMD_NEW_INST: {
+            generate_new_inst(gen, cmd_index);
+            break;
+        }
+
+        case CMD_POP_STACK: {
+            const StackEntry *top = top_entry(gen);
+
+            if (top == NULL) {
+                add_indents(code, gen->indent_level);
                 string_add_chars(code, "free_value(stack_pop());\n");
-                break;
             }
-
-            case CMD_PUSH_NAME: { 
-                string_add_chars(code, "nameValue_");
-                string_add_str(code, cmd->str);
-                string_add_chars(code, ".ref_count++;\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "stack_push(&nameValue_");
-                string_add_str(code, cmd->str);
+            else if (top->type == ENTRY_VALUE) {
+                add_indents(code, gen->indent_level);
+                string_add_chars(code, "free_value(");
+                add_temp(code, gen->stack_len - 1);
                 string_add_chars(code, ");\n");
-                break;
             }
 
-            case CMD_PUSH_NUM: {
-                char buf[160];
-                sprintf(buf, "stack_push(new_number_value(%f));\n", cmd->number);
-                string_add_chars(code, buf);
-                break;
+            if (top != NULL) {
+                gen->stack_len--;
             }
+            break;
+        }
 
-            case CMD_PUSH_STR: {
-                String *str_ident = convert_str_to_identifier(cmd->str);
-                string_add_chars(code, "strValue_");
-                string_add_str(code, str_ident);
-                string_add_chars(code, ".ref_count++;\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "stack_push(&strValue_");
-                string_add_str(code, str_ident);
-                string_add_chars(code, ");\n");
-                free_string(str_ident);
-                break;
-            }
+        case CMD_PUSH_NAME: {
+            push_entry(gen, (StackEntry) {ENTRY_NAME, cmd->str, NULL, 0});
+            break;
+        }
 
-            case CMD_RETURN: {
-                string_add_chars(code, "free_map(local_vars);\n");
-                add_indents(code, indent_level);
-                string_add_chars(code, "return;\n");
-            }
+        case CMD_PUSH_NUM: {
+            size_t index = push_number(gen);
+            add_indents(code, gen->indent_level);
+            add_number_temp(code, index);
+            string_add_chars(code, " = ");
+            add_number_literal(code, cmd->number);
+            string_add_chars(code, ";\n");
+            break;
+        }
+
+        case CMD_PUSH_STR: {
+            String *str_ident = convert_str_to_identifier(cmd->str);
+            size_t index = push_value(gen);
+
+            add_indents(code, gen->indent_level);
+            string_add_chars(code, "strValue_");
+            string_add_str(code, str_ident);
+            string_add_chars(code, ".ref_count++;\n");
+            add_indents(code, gen->indent_level);
+            add_temp(code, index);
+            string_add_chars(code, " = &strValue_");
+            string_add_str(code, str_ident);
+            string_add_chars(code, ";\n");
+            free_string(str_ident);
+            break;
+        }
+
+        case CMD_RETURN: {
+            spill_stack(gen);
+
+            add_indents(code, gen->indent_level);
+            string_add_chars(code, "leave_frame(&frame);\n");
+            add_indents(code, gen->indent_level);
+            string_add_chars(code, "return;\n");
         }
     }
+}
+
+// Generates the body of a function into gen->code. This is repeated until
+// the states of the locals at the start of each loop stop changing
+void generate_function_body(FuncGen *gen) {
+    do {
+        free_string(gen->code);
+        gen->code = new_string();
+        gen->indent_level = 1;
+        gen->loops_changed = false;
+        gen->has_tail_call = false;
+        gen->stack_len = 0;
+
+        for (size_t i = 0; i < list_len(gen->locals); i++) {
+            gen->local_states[i] = (LocalState) {VAR_UNKNOWN, NULL, false};
+        }
+
+        for (size_t i = 0; i < func_len(gen->func); i++) {
+            generate_command(gen, i);
+        }
+
+        spill_stack(gen);
+        add_indents(gen->code, gen->indent_level);
+        string_add_chars(gen->code, "leave_frame(&frame);\n");
+    } while (gen->loops_changed);
+}
+
+void generate_function(String *code, const Map *classes, ProgramVars *vars, const GlassClass *gclass,
+                       const GlassFunction *func) {
+    const String *class_name = class_get_name(gclass);
+    const String *func_name = func_get_name(func);
+    String *mangled_name = mangle_name(class_name, func_name);
+
+    FuncGen gen = {
+        .code = new_string(),
+        .classes = classes,
+        .class_name = class_name,
+        .func = func,
+        .vars = vars,
+        .locals = get_local_names(func),
+        .fields = get_field_names(gclass),
+        .loop_states = calloc(func_len(func) + 1, sizeof(LocalState *)),
+    };
+    gen.local_states = malloc(sizeof(LocalState) * (list_len(gen.locals) + 1));
+
+    generate_function_body(&gen);
+
+    string_add_chars(code, "void ");
+    string_add_str(code, mangled_name);
+    string_add_chars(code, "(size_t inst_index) {\n");
 
-    add_indents(code, indent_level);
-    string_add_chars(code, "free_map(local_vars);\n");
+    add_indents(code, 1);
+    string_add_chars(code, "Map *local_vars = NULL;\n");
+
+    char buf[160];
+    size_t num_locals = list_len(gen.locals);
+    add_indents(code, 1);
+    sprintf(buf, "GlassValue *locals[%zu] = {NULL};\n", num_locals > 0 ? num_locals : 1);
+    string_add_chars(code, buf);
+    add_indents(code, 1);
+    string_add_chars(code, "Frame frame;\n");
+    add_indents(code, 1);
+    sprintf(buf, "enter_frame(&frame, inst_index, &local_vars, locals, %zu);\n", num_locals);
+    string_add_chars(code, buf);
+
+    if (gen.has_tail_call) {
+        string_add_chars(code, "tail_call:;\n");
+    }
+
+    for (size_t i = 0; i < num_locals; i++) {
+        const String *local = list_get(gen.locals, i);
+
+        add_indents(code, 1);
+        string_add_chars(code, "double ");
+        add_unboxed_local(code, local);
+        string_add_chars(code, " = 0.0;\n");
+        add_indents(code, 1);
+        string_add_chars(code, "(void) ");
+        add_unboxed_local(code, local);
+        string_add_chars(code, ";\n");
+    }
+
+    for (size_t i = 0; i < gen.num_temps; i++) {
+        add_indents(code, 1);
+        sprintf(buf, "GlassValue *s%zu; double d%zu; size_t i%zu;\n", i, i, i);
+        string_add_chars(code, buf);
+        add_indents(code, 1);
+        sprintf(buf, "(void) s%zu; (void) d%zu; (void) i%zu;\n", i, i, i);
+        string_add_chars(code, buf);
+    }
+
+    add_indents(code, 1);
+    string_add_chars(code, "GlassValue *tmp, *tmp2, *tmp3;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "double num, num2;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "void (*ctor)(size_t);\n");
+    add_indents(code, 1);
+    string_add_chars(code, "size_t index;\n");
+
+    // Disable warnings for unused variables
+    add_indents(code, 1);
+    string_add_chars(code, "(void) tmp;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "(void) tmp2;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "(void) tmp3;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "(void) num;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "(void) num2;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "(void) ctor;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "(void) index;\n");
+    add_indents(code, 1);
+    string_add_chars(code, "(void) inst_index;\n");
+
+    string_add_str(code, gen.code);
     string_add_chars(code, "}\n\n");
 
+    for (size_t i = 0; i < func_len(func); i++) {
+        free(gen.loop_states[i]);
+    }
+    free(gen.loop_states);
+    free(gen.local_states);
+    free(gen.stack);
+    free_list(gen.locals);
+    free_list(gen.fields);
+    free_string(gen.code);
     free_string(mangled_name);
 }
 
-void generate_functions(String *code, const Map *classes) {
+// Generates the functions of each class, adding their code to class_codes in
+// the order of the classes' names
+void generate_program_functions(List *class_codes, const Map *classes, ProgramVars *vars) {
     List *class_names = map_get_keys(classes);
 
     for (size_t i = 0; i < list_len(class_names); i++) {
         const String *class_name = list_get(class_names, i);
         const GlassClass *gclass = map_get(classes, class_name);
         List *func_names = class_get_func_names(gclass);
+        String *code = new_string();
 
         for (size_t j = 0; j < list_len(func_names); j++) {
             const String *func_name = list_get(func_names, j);
             const GlassFunction *func = class_get_func(gclass, func_name);
 
-            generate_function(code, gclass, func);
+            generate_function(code, classes, vars, gclass, func);
         }
 
+        list_add(class_codes, code);
+        free_string(code);
         free_list(func_names);
     }
 
     free_list(class_names);
 }
 
+void generate_functions(List *class_codes, const Map *classes) {
+    ProgramVars vars = {
+        .var_classes = new_map(STRING_HASH_OPS, BORROWED_COPY_OPS),
+        .mixed_vars = new_set(STRING_HASH_OPS),
+        .escaped_names = new_set(STRING_HASH_OPS),
+        .complete = false,
+    };
+
+    // Gather the assignments to every variable first, throwing away the code
+    List *scratch = new_list(STRING_COPY_OPS);
+    generate_program_functions(scratch, classes, &vars);
+    free_list(scratch);
+
+    vars.complete = true;
+    generate_program_functions(class_codes, classes, &vars);
+
+    free_map(vars.var_classes);
+    free_set(vars.mixed_vars);
+    free_set(vars.escaped_names);
+}
+
 void generate_class_definitions(String *code, const Map *classes) {
     List *class_names = map_get_keys(classes);
 
@@ -536,7 +1826,7 @@ void generate_class_definitions(String *code, const Map *classes) {
 
         string_add_chars(gclass_def, "const GlassClass C_");
         string_add_str(gclass_def, class_name);
-        string_add_chars(gclass_def, " = {\n    {\n");
+        string_add_chars(gclass_def, " = {\n    .funcs = {\n");
 
         for (size_t j = 0; j < list_len(func_names); j++) {
             const String *func_name = list_get(func_names, j);
@@ -555,7 +1845,27 @@ void generate_class_definitions(String *code, const Map *classes) {
             free_string(mangled_name);
         }
 
-        string_add_chars(gclass_def, "    }\n};\n\n");
+        List *fields = get_field_names(gclass);
+        char buf[40];
+
+        string_add_chars(gclass_def, "    },\n");
+
+        if (!list_empty(fields)) {
+            string_add_chars(gclass_def, "    .field_slots = {\n");
+
+            for (size_t j = 0; j < list_len(fields); j++) {
+                string_add_chars(gclass_def, "        [NAME_");
+                string_add_str(gclass_def, list_get(fields, j));
+                sprintf(buf, "] = %zu,\n", j + 1);
+                string_add_chars(gclass_def, buf);
+            }
+
+            string_add_chars(gclass_def, "    },\n");
+        }
+
+        sprintf(buf, "    .num_fields = %zu\n};\n\n", list_len(fields));
+        string_add_chars(gclass_def, buf);
+        free_list(fields);
 
         string_add_str(code, forward_decls);
         string_add_str(code, gclass_def);
@@ -574,6 +1884,7 @@ void generate_class_definitions(String *code, const Map *classes) {
 
 String *compile_classes(const Map *classes) {
     String *code = new_string();
+    List *class_codes = new_list(STRING_COPY_OPS);
 
     generate_name_enum(code, classes);
     add_runtime_library(code);
@@ -581,8 +1892,152 @@ String *compile_classes(const Map *classes) {
     generate_name_literals(code, classes);
     generate_string_literals(code, classes);
     generate_class_definitions(code, classes);
-    generate_functions(code, classes);
+
+    generate_functions(class_codes, classes);
+    for (size_t i = 0; i < list_len(class_codes); i++) {
+        string_add_str(code, list_get(class_codes, i));
+    }
+
     add_main_func(code);
 
+    free_list(class_codes);
     return code;
 }
+
+// Returns the end of the line starting at index
+size_t find_line_end(const String *code, size_t index) {
+    while (index < string_len(code) && string_get(code, index) != '\n') {
+        index++;
+    }
+    return index;
+}
+
+// Returns the end of the top-level item starting at index. Items that open a
+// block end with the line that closes it
+size_t find_item_end(const String *code, size_t index) {
+    size_t end = find_line_end(code, index);
+
+    if (end == index || string_get(code, end - 1) != '{') {
+        return end;
+    }
+
+    do {
+        index = end + 1;
+        end = find_line_end(code, index);
+    } while (index < string_len(code) && string_get(code, index) != '}');
+
+    return end;
+}
+
+// Splits generated code into the declarations that every translation unit
+// needs (types, macros, function prototypes and extern declarations of the
+// globals) and the definitions of the functions and globals. This only has
+// to handle the layout of the code that glasscc generates, where every
+// top-level item starts in the first column
+void split_definitions(const String *code, String *decls, String *defs) {
+    String *pending = new_string();
+    size_t index = 0;
+
+    while (index < string_len(code)) {
+        size_t line_end = find_line_end(code, index);
+        size_t end = find_item_end(code, index);
+        String *line = string_substr(code, index, line_end - index);
+        size_t len = string_len(line);
+        const char *chars = string_get_c_str(line);
+
+        // Comments and blank lines go with the item that follows them
+        if (len == 0 || strncmp(chars, "//", 2) == 0) {
+            string_add_str(pending, line);
+            string_add_char(pending, '\n');
+            free_string(line);
+            index = end + 1;
+            continue;
+        }
+
+        bool is_type = chars[0] == '#' || strncmp(chars, "typedef", 7) == 0 || strncmp(chars, "struct", 6) == 0;
+        bool is_func = !is_type && chars[len - 1] == '{' && strchr(chars, '(') != NULL && strchr(chars, '=') == NULL;
+        bool is_global = !is_type && !is_func && (strchr(chars, '=') != NULL || strchr(chars, '(') == NULL);
+
+        if (is_func || is_global) {
+            string_add_str(defs, pending);
+            string_add_buf(defs, string_data(code) + index, end - index);
+            string_add_char(defs, '\n');
+
+            if (is_func) {
+                // Drop the " {"
+                string_add_buf(decls, chars, len - 2);
+            }
+            else {
+                const char *value = strstr(chars, " =");
+                string_add_chars(decls, "extern ");
+                string_add_buf(decls, chars, value != NULL ? (size_t) (value - chars) : len - 1);
+            }
+            string_add_chars(decls, ";\n");
+        }
+        else {
+            string_add_str(decls, pending);
+            string_add_buf(decls, string_data(code) + index, end - index);
+            string_add_char(decls, '\n');
+        }
+
+        free_string(pending);
+        pending = new_string();
+        free_string(line);
+        index = end + 1;
+    }
+
+    free_string(pending);
+}
+
+Map *compile_classes_split(const Map *classes) {
+    Map *files = new_map(STRING_HASH_OPS, STRING_COPY_OPS);
+    String *shared = new_string();
+    List *class_codes = new_list(STRING_COPY_OPS);
+
+    generate_name_enum(shared, classes);
+    add_runtime_library(shared);
+    add_builtin_funcs(shared);
+    generate_name_literals(shared, classes);
+    generate_string_literals(shared, classes);
+    generate_class_definitions(shared, classes);
+    add_main_func(shared);
+
+    String *header = string_from_chars("#ifndef GLASS_H\n#define GLASS_H\n\n");
+    String *runtime = string_from_chars("#include \"glass.h\"\n\n");
+    split_definitions(shared, header, runtime);
+    string_add_chars(header, "\n#endif\n");
+
+    String *name = string_from_chars("glass.h");
+    map_set(files, name, header);
+    free_string(name);
+
+    name = string_from_chars("runtime.c");
+    map_set(files, name, runtime);
+    free_string(name);
+
+    // Each class's functions only change when the class does, or when what's
+    // known about the variables it uses does
+    generate_functions(class_codes, classes);
+    List *class_names = map_get_keys(classes);
+
+    for (size_t i = 0; i < list_len(class_names); i++) {
+        String *class_code = string_from_chars("#include \"glass.h\"\n\n");
+        string_add_str(class_code, list_get(class_codes, i));
+
+        name = string_from_chars("class_");
+        string_add_str(name, list_get(class_names, i));
+        string_add_chars(name, ".c");
+        map_set(files, name, class_code);
+
+        free_string(name);
+        free_string(class_code);
+    }
+
+    free_list(class_names);
+    free_list(class_codes);
+    free_string(header);
+    free_string(runtime);
+    free_string(shared);
+
+    return files;
+}
@@ -1,30 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "compiler/compiler.h"
+#include "glasstypes/glass-program.h"
+#include "optimizer/optimizer.h"
 #include "parser/parser.h"
 #include "utils/list.h"
 #include "utils/map.h"
 #include "utils/string.h"
 
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 typedef struct Options {
     List *files;
 
     String *out_name;
+
+    // Set to build an executable with the system's C compiler
+    String *exe_name;
+
+    // The arguments for a training run, which are set to build the
+    // executable with profile-guided optimization
+    String *pgo_args;
+
+    // Set to write a directory of separately compiled files
+    String *split_dir;
+
+    int opt_level;
 } Options;
 
 void usage(const char *exe_name) {
-    printf("Usage: %s <glass files...> [--out out_file]\n", exe_name);
+    printf("Usage: %s <glass files...> [-O<level>] [--out out_file | --split out_dir] [--exe exe_file [--pgo training_args]]\n", exe_name);
+    printf("\n");
+    printf("--split only rewrites the files that changed, but every name and string literal\n");
+    printf("in the program is declared in glass.h, so adding one changes it, and every file\n");
+    printf("including it has to be rebuilt.\n");
 }
 
 void free_options(Options *opts) {
     free_list(opts->files);
     free_string(opts->out_name);
+    free_string(opts->exe_name);
+    free_string(opts->split_dir);
+    if (opts->pgo_args != NULL) {
+        free_string(opts->pgo_args);
+    }
+}
+
+// Reads the value following an option into value, returning true if there
+// isn't one
+bool parse_option_value(String **value, int *i, int argc, char **argv, const char *what) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "%s must be followed by %s.\n", argv[*i], what);
+        return true;
+    }
+
+    free_string(*value);
+    *value = string_from_chars(argv[*i + 1]);
+    (*i)++;
+    return false;
+}
+
+// Reads the level from an -O<level> option, which is 1 if it's left out.
+// Returns true if the level isn't a non-negative number
+bool parse_opt_level(const char *arg, int *level) {
+    if (arg[2] == '\0') {
+        *level = 1;
+        return false;
+    }
+
+    char *end;
+    errno = 0;
+    long value = strtol(arg + 2, &end, 10);
+    if (!isdigit((unsigned char) arg[2]) || *end != '\0' || errno != 0 || value > INT_MAX) {
+        fprintf(stderr, "%s isn't a valid optimization level.\n", arg);
+        return true;
+    }
+
+    *level = (int) value;
+    return false;
 }
 
 bool parse_command_line(Options *opts, int argc, char **argv) {
     opts->files = new_list(STRING_COPY_OPS);
     opts->out_name = new_string();
+    opts->exe_name = new_string();
+    opts->split_dir = new_string();
+    opts->pgo_args = NULL;
+    opts->opt_level = 0;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--help") == 0) {
@@ -32,15 +103,35 @@ bool parse_command_line(Options *opts, int argc, char **argv) {
             usage(argv[0]);
             return true;
         }
-        else if (strcmp(argv[i], "--out") == 0) {
-            if (i + 1 >= argc) {
-                fprintf(stderr, "--out must be followed by a filename.\n");
+        else if (strcmp(argv[i], "--out") == 0 || strcmp(argv[i], "--exe") == 0) {
+            String **value = strcmp(argv[i], "--out") == 0 ? &opts->out_name : &opts->exe_name;
+
+            if (parse_option_value(value, &i, argc, argv, "a filename")) {
+                free_options(opts);
+                return true;
+            }
+        }
+        else if (strncmp(argv[i], "-O", 2) == 0) {
+            if (parse_opt_level(argv[i], &opts->opt_level)) {
+                free_options(opts);
+                return true;
+            }
+        }
+        else if (strcmp(argv[i], "--split") == 0) {
+            if (parse_option_value(&opts->split_dir, &i, argc, argv, "a directory")) {
+                free_options(opts);
+                return true;
+            }
+        }
+        else if (strcmp(argv[i], "--pgo") == 0) {
+            if (opts->pgo_args == NULL) {
+                opts->pgo_args = new_string();
+            }
+
+            if (parse_option_value(&opts->pgo_args, &i, argc, argv, "the training arguments")) {
                 free_options(opts);
                 return true;
             }
-            free_string(opts->out_name);
-            opts->out_name = string_from_chars(argv[i + 1]);
-            i++;
         }
         else {
             String *arg = string_from_chars(argv[i]);
@@ -55,9 +146,256 @@ bool parse_command_line(Options *opts, int argc, char **argv) {
         return true;
     }
 
+    if (opts->pgo_args != NULL && string_len(opts->exe_name) == 0) {
+        fprintf(stderr, "--pgo can only be used with --exe.\n");
+        free_options(opts);
+        return true;
+    }
+
+    if (string_len(opts->split_dir) > 0 && (string_len(opts->out_name) > 0 || string_len(opts->exe_name) > 0)) {
+        fprintf(stderr, "--split can't be used with --out or --exe.\n");
+        free_options(opts);
+        return true;
+    }
+
+    return false;
+}
+
+bool write_file(const char *filename, const String *compiled) {
+    FILE *fp = fopen(filename, "w");
+
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open %s!\n", filename);
+        return true;
+    }
+
+    fwrite(string_data(compiled), sizeof(char), string_len(compiled), fp);
+    fclose(fp);
+
+    return false;
+}
+
+// Returns true if the file already holds exactly the given contents
+bool file_has_contents(const char *filename, const String *contents) {
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        return false;
+    }
+
+    char *buf = malloc(string_len(contents) + 1);
+    size_t len = fread(buf, sizeof(char), string_len(contents) + 1, fp);
+    bool same = len == string_len(contents) && memcmp(buf, string_data(contents), len) == 0;
+
+    free(buf);
+    fclose(fp);
+    return same;
+}
+
+// Removes the class files that an earlier --split left in the directory for
+// classes that are gone, so that they don't get built along with the rest
+bool remove_stale_class_files(String *dir, const Map *files) {
+    DIR *dir_stream = opendir(string_get_c_str(dir));
+    if (dir_stream == NULL) {
+        fprintf(stderr, "Unable to open %s!\n", string_get_c_str(dir));
+        return true;
+    }
+
+    bool error = false;
+    struct dirent *entry;
+
+    while (!error && (entry = readdir(dir_stream)) != NULL) {
+        const char *filename = entry->d_name;
+        size_t len = strlen(filename);
+
+        if (strncmp(filename, "class_", 6) != 0 || len < 8 || strcmp(filename + len - 2, ".c") != 0) {
+            continue;
+        }
+
+        String *name = string_from_chars(filename);
+        if (!map_has(files, name)) {
+            String *path = copy_string(dir);
+            string_add_char(path, '/');
+            string_add_str(path, name);
+
+            if (remove(string_get_c_str(path)) != 0) {
+                fprintf(stderr, "Unable to remove %s!\n", string_get_c_str(path));
+                error = true;
+            }
+            free_string(path);
+        }
+        free_string(name);
+    }
+
+    closedir(dir_stream);
+    return error;
+}
+
+// Writes every file from compile_classes_split into the directory. Files
+// that haven't changed are left alone, so that build tools can skip them
+bool write_split_files(String *dir, const Map *files) {
+    mkdir(string_get_c_str(dir), 0755);
+
+    if (remove_stale_class_files(dir, files)) {
+        return true;
+    }
+
+    List *names = map_get_keys(files);
+    bool error = false;
+
+    for (size_t i = 0; i < list_len(names) && !error; i++) {
+        const String *contents = map_get(files, list_get(names, i));
+        String *path = copy_string(dir);
+        string_add_char(path, '/');
+        string_add_str(path, list_get(names, i));
+
+        const char *filename = string_get_c_str(path);
+        if (!file_has_contents(filename, contents)) {
+            error = write_file(filename, contents);
+        }
+
+        free_string(path);
+    }
+
+    free_list(names);
+    return error;
+}
+
+// Runs a program with the given NULL-terminated arguments, returning true if
+// it couldn't be run or didn't succeed
+bool run_command(char **args) {
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Unable to run %s!\n", args[0]);
+        return true;
+    }
+
+    if (pid == 0) {
+        execvp(args[0], args);
+        fprintf(stderr, "Unable to run %s!\n", args[0]);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed!\n", args[0]);
+        return true;
+    }
+
     return false;
 }
 
+// Compiles the generated C with the compiler named by $CC, adding profile_flag
+// if it isn't NULL. $CC is split on whitespace, so it can hold a wrapper like
+// ccache, or flags
+bool run_c_compiler(String *c_name, String *exe_name, String *profile_flag) {
+    const char *cc = getenv("CC");
+    String *cc_copy = string_from_chars(cc != NULL ? cc : "");
+    char *cc_buf = (char *) string_get_c_str(cc_copy);
+    char **args = malloc(sizeof(char *) * (string_len(cc_copy) / 2 + 9));
+    size_t num_args = 0;
+
+    for (char *arg = strtok(cc_buf, " \t\n"); arg != NULL; arg = strtok(NULL, " \t\n")) {
+        args[num_args++] = arg;
+    }
+    if (num_args == 0) {
+        args[num_args++] = "cc";
+    }
+    args[num_args++] = "-std=c11";
+    args[num_args++] = "-O2";
+    if (profile_flag != NULL) {
+        args[num_args++] = (char *) string_get_c_str(profile_flag);
+    }
+    args[num_args++] = (char *) string_get_c_str(c_name);
+    args[num_args++] = "-o";
+    args[num_args++] = (char *) string_get_c_str(exe_name);
+    args[num_args++] = "-lm";
+    args[num_args] = NULL;
+
+    bool error = run_command(args);
+
+    free(args);
+    free_string(cc_copy);
+
+    return error;
+}
+
+// Runs the instrumented executable on the training arguments, which are
+// split on whitespace. It reads the compiler's own standard input
+bool run_training(String *exe_name, const String *pgo_args) {
+    // Executables in the current directory need a path, or they'd be looked
+    // up on $PATH
+    String *exe_path = new_string();
+    if (strchr(string_get_c_str(exe_name), '/') == NULL) {
+        string_add_chars(exe_path, "./");
+    }
+    string_add_str(exe_path, exe_name);
+
+    String *args_copy = copy_string(pgo_args);
+    char *args_buf = (char *) string_get_c_str(args_copy);
+    char **args = malloc(sizeof(char *) * (string_len(pgo_args) / 2 + 3));
+    size_t num_args = 0;
+
+    args[num_args++] = (char *) string_get_c_str(exe_path);
+    for (char *arg = strtok(args_buf, " \t\n"); arg != NULL; arg = strtok(NULL, " \t\n")) {
+        args[num_args++] = arg;
+    }
+    args[num_args] = NULL;
+
+    bool error = run_command(args);
+
+    free(args);
+    free_string(args_copy);
+    free_string(exe_path);
+
+    return error;
+}
+
+// Builds an executable from the generated C. With --pgo, an instrumented
+// build is run on the training arguments first, and its profile is used to
+// rebuild it. The C file is only kept if --out was given
+bool build_executable(Options *opts, const String *compiled) {
+    String *c_name = copy_string(opts->out_name);
+    if (string_len(c_name) == 0) {
+        string_add_str(c_name, opts->exe_name);
+        string_add_chars(c_name, ".c");
+    }
+
+    if (write_file(string_get_c_str(c_name), compiled)) {
+        free_string(c_name);
+        return true;
+    }
+
+    bool error;
+
+    if (opts->pgo_args == NULL) {
+        error = run_c_compiler(c_name, opts->exe_name, NULL);
+    }
+    else {
+        String *generate_flag = string_from_chars("-fprofile-generate=");
+        String *use_flag = string_from_chars("-fprofile-use=");
+        string_add_str(generate_flag, opts->exe_name);
+        string_add_chars(generate_flag, ".profile");
+        string_add_str(use_flag, opts->exe_name);
+        string_add_chars(use_flag, ".profile");
+
+        error = run_c_compiler(c_name, opts->exe_name, generate_flag) ||
+            run_training(opts->exe_name, opts->pgo_args) ||
+            run_c_compiler(c_name, opts->exe_name, use_flag);
+
+        free_string(generate_flag);
+        free_string(use_flag);
+    }
+
+    if (string_len(opts->out_name) == 0) {
+        remove(string_get_c_str(c_name));
+    }
+    free_string(c_name);
+
+    return error;
+}
+
 int main(int argc, char **argv) {
     Options opts;
 
@@ -65,25 +403,34 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    Map *classes = classes_from_files(opts.files, true, true);
-    String *compiled = compile_classes(classes);
+    GlassProgram *program = classes_from_files(opts.files, true, true, false);
+    if (program == NULL) {
+        free_options(&opts);
+        return 1;
+    }
 
-    if (string_len(opts.out_name) > 0) {
-        const char *filename = string_get_c_str(opts.out_name);
-        FILE *fp = fopen(filename, "w");
+    optimize_program(program, opts.opt_level);
 
-        if (fp == NULL) {
-            fprintf(stderr, "Unable to open %s!\n", filename);
-            free_string(compiled);
-            free_map(classes);
-            free_options(&opts);
-            return 1; 
-        }
+    if (string_len(opts.split_dir) > 0) {
+        Map *files = compile_classes_split(program_get_classes(program));
+        bool error = write_split_files(opts.split_dir, files);
+
+        free_map(files);
+        free_glass_program(program);
+        free_options(&opts);
 
-        const char *compiled_str = string_data(compiled);
-        fwrite(compiled_str, sizeof(char), string_len(compiled), fp);
+        return error ? 1 : 0;
+    }
+
+    String *compiled = compile_classes(program_get_classes(program));
 
-        fclose(fp);
+    bool error = false;
+
+    if (string_len(opts.exe_name) > 0) {
+        error = build_executable(&opts, compiled);
+    }
+    else if (string_len(opts.out_name) > 0) {
+        error = write_file(string_get_c_str(opts.out_name), compiled);
     }
     else {
         for (size_t i = 0; i < string_len(compiled); i++) {
@@ -92,8 +439,8 @@ int main(int argc, char **argv) {
     }
 
     free_string(compiled);
-    free_map(classes);
+    free_glass_program(program);
     free_options(&opts);
 
-    return 0;
+    return error ? 1 : 0;
 }
@@ -0,0 +1,54 @@
+#ifndef INTERPRETER_CLASS_TABLE_H
+#define INTERPRETER_CLASS_TABLE_H
+
+#include "glasstypes/glass-symbol.h"
+
+// The classes of a running program, laid out so that finding a class by name
+// and a function by name are both array lookups. Each class gets a dense id,
+// and a vtable with a slot for every function name used by any class
+typedef struct ClassTable ClassTable;
+typedef struct RuntimeClass RuntimeClass;
+struct GlassClass;
+struct GlassFunction;
+struct List;
+struct Map;
+struct PureFunc;
+struct PureFuncs;
+
+// Builds the table from a map of built classes. Every class and function
+// name has to have been interned already, which building a program does
+ClassTable *new_class_table(const struct Map *classes);
+
+void free_class_table(ClassTable *table);
+
+// Returns the class with the given name, or NULL if there isn't one
+const RuntimeClass *class_table_get(const ClassTable *table, Symbol name);
+
+const struct GlassClass *runtime_class_get_class(const RuntimeClass *rclass);
+
+// Returns the class's function with the given name without parsing its body,
+// or NULL if the class has no such function
+const struct GlassFunction *class_table_get_func(const ClassTable *table,
+                                                 const RuntimeClass *rclass,
+                                                 Symbol name);
+
+// Records which functions of the table's classes are pure
+void class_table_set_pure_funcs(ClassTable *table, const struct PureFuncs *pure);
+
+// Returns how the class's function uses the stack if it's pure, and otherwise
+// NULL. Nothing is pure until class_table_set_pure_funcs has been called
+const struct PureFunc *class_table_get_pure_func(const ClassTable *table,
+                                                 const RuntimeClass *rclass,
+                                                 Symbol name);
+
+// Works out which locals of each function only ever hold instances that can be
+// freed as soon as it returns
+void class_table_find_scoped_locals(ClassTable *table, const struct Map *classes);
+
+// Returns the function's locals whose instances are freed when it returns.
+// That's NULL until class_table_find_scoped_locals has been called
+const struct List *class_table_get_scoped_locals(const ClassTable *table,
+                                                const RuntimeClass *rclass,
+                                                Symbol name);
+
+#endif
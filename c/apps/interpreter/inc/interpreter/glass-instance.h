@@ -1,35 +1,56 @@
 #ifndef INTERPRETER_GLASS_INSTANCE_H
 #define INTERPRETER_GLASS_INSTANCE_H
 
+#include "glasstypes/glass-symbol.h"
+
 #include <stdbool.h>
 #include <stddef.h>
 
 typedef size_t GlassInstance;
+struct ClassTable;
 struct GlassClass;
 struct GlassFunction;
 struct GlassValue;
+struct List;
 struct Map;
+struct PureFunc;
+struct RuntimeClass;
 struct String;
 
-void init_instances(const struct Map *globals);
+void init_instances(const struct Map *globals, const struct ClassTable *table);
 
 void free_instances(void);
 
+// Keeps the instance and the local variables reachable until the scope is
+// exited. The local variables can be NULL
 void register_new_scope(const struct Map *local_vars, GlassInstance inst);
 
 void exit_scope(void);
 
-GlassInstance new_glass_instance(const struct GlassClass *gclass);
+GlassInstance new_glass_instance(const struct RuntimeClass *rclass);
 
 GlassInstance copy_glass_instance(GlassInstance inst);
 
 void release_glass_instance(GlassInstance inst);
 
+// Frees an instance straight away, for when nothing can reach it any more.
+// Its slot is reused before any others
+void free_glass_instance(GlassInstance inst);
+
 bool instance_has_var(const GlassInstance inst, const struct String *name);
 
-bool instance_has_func(const GlassInstance inst, const struct String *name);
+bool instance_has_func(const GlassInstance inst, Symbol name);
+
+// Returns the function without parsing its body, which has to be done with
+// func_parse_body before running it
+const struct GlassFunction *instance_get_func(const GlassInstance inst, Symbol name);
 
-const struct GlassFunction *instance_get_func(const GlassInstance inst, const struct String *name);
+// Returns how the function uses the stack if it's pure, and otherwise NULL
+const struct PureFunc *instance_get_pure_func(const GlassInstance inst, Symbol name);
+
+// Returns the function's locals whose instances are freed when it returns, or
+// NULL if they aren't known
+const struct List *instance_get_scoped_locals(const GlassInstance inst, Symbol name);
 
 const struct GlassValue *instance_get_var(const GlassInstance inst, const struct String *name);
 
@@ -37,4 +58,7 @@ const struct GlassClass *instance_get_class(const GlassInstance inst);
 
 void instance_set_var(GlassInstance inst, const struct String *name, const struct GlassValue *val);
 
+// Returns the values held by an instance of L, which the instance owns
+struct List *instance_get_elements(GlassInstance inst);
+
 #endif
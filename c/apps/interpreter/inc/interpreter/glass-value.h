@@ -30,6 +30,9 @@ typedef struct GlassValue {
             };
 
             struct String *str;
+
+            // The symbol of a name, or of a function's name
+            Symbol sym;
         };
 
         double num;
@@ -38,13 +41,13 @@ typedef struct GlassValue {
 
 extern const struct CopyInterface *VALUE_COPY_OPS;
 
-GlassValue *new_func_value(GlassInstance inst, const struct String *name);
+GlassValue *new_func_value(GlassInstance inst, const struct String *name, Symbol sym);
 
 GlassValue *new_in_file_value(const struct String *name);
 
 GlassValue *new_inst_value(GlassInstance inst);
 
-GlassValue *new_name_value(const struct String *name);
+GlassValue *new_name_value(const struct String *name, Symbol sym);
 
 GlassValue *new_number_value(double num);
 
@@ -52,7 +55,7 @@ GlassValue *new_out_file_value(const struct String *name);
 
 GlassValue *new_str_value(const struct String *str);
 
-GlassValue *copy_value(const GlassValue *val);
+GlassValue *copy_glass_value(const GlassValue *value);
 
 void free_glass_value(GlassValue *value);
 
@@ -1,9 +1,21 @@
 #ifndef INTERPRETER_INTERPRETER_H
 #define INTERPRETER_INTERPRETER_H
 
+#include <stdbool.h>
+
 struct List;
 struct Map;
 
-int run_interpreter(const struct Map *classes, const struct List *args);
+typedef struct InterpreterOptions {
+    // Cache calls to functions that only depend on their arguments, keyed on
+    // the values they're called with
+    bool memoize;
+
+    // Free the instances that a function creates when it returns, if nothing
+    // else can reach them, instead of leaving them to garbage collection
+    bool scope_instances;
+} InterpreterOptions;
+
+int run_interpreter(const struct Map *classes, const struct List *args, InterpreterOptions opts);
 
 #endif
@@ -0,0 +1,34 @@
+#ifndef INTERPRETER_MEMO_CACHE_H
+#define INTERPRETER_MEMO_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The results of calls to pure functions, keyed on the function and the
+// values it was called with. Once the cache is full, the least recently used
+// results are dropped to make room
+typedef struct MemoCache MemoCache;
+typedef struct MemoKey MemoKey;
+struct List;
+
+MemoCache *new_memo_cache(size_t max_entries);
+
+void free_memo_cache(MemoCache *cache);
+
+// Returns the key for calling func with the top num_args values of the stack,
+// or NULL if the call can't be cached. Only numbers and strings can be used
+// as keys
+MemoKey *new_memo_key(const void *func, const struct List *stack, size_t num_args);
+
+void free_memo_key(MemoKey *key);
+
+// If there are cached results for the key, replaces its arguments on the
+// stack with them and returns true
+bool memo_cache_apply(MemoCache *cache, const MemoKey *key, struct List *stack);
+
+// Caches the top num_results values of the stack as the results for the key,
+// taking ownership of the key. Nothing is cached unless they're all numbers
+// and strings
+void memo_cache_add(MemoCache *cache, MemoKey *key, const struct List *stack, size_t num_results);
+
+#endif
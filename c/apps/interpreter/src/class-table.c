@@ -0,0 +1,203 @@
+#include "interpreter/class-table.h"
+
+#include "analysis/escape.h"
+#include "analysis/purity.h"
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-function.h"
+#include "utils/list.h"
+#include "utils/map.h"
+#include "utils/set.h"
+#include "utils/string.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define NO_SLOT UINT32_MAX
+
+struct RuntimeClass {
+    const GlassClass *gclass;
+
+    // Indexed by the slot of a function name, NULL where the class doesn't
+    // have a function by that name
+    const GlassFunction **vtable;
+
+    // Laid out like the vtable, NULL where the function isn't pure
+    const PureFunc **pure_funcs;
+
+    // Laid out like the vtable, and NULL until the scoped locals are found
+    List **scoped_locals;
+};
+
+struct ClassTable {
+    RuntimeClass *classes;
+
+    size_t num_classes;
+
+    // Both of these are indexed by symbol, and cover every symbol that had
+    // been interned when the table was built. Names interned later can't be
+    // the name of any class or function
+    uint32_t *class_ids;
+
+    uint32_t *func_slots;
+
+    size_t num_symbols;
+
+    size_t num_slots;
+};
+
+ClassTable *new_class_table(const Map *classes) {
+    ClassTable *table = malloc(sizeof(ClassTable));
+    List *class_names = map_get_keys(classes);
+
+    table->num_classes = list_len(class_names);
+    table->classes = malloc(sizeof(RuntimeClass) * table->num_classes);
+    table->num_symbols = num_symbols();
+    table->class_ids = malloc(sizeof(uint32_t) * table->num_symbols);
+    table->func_slots = malloc(sizeof(uint32_t) * table->num_symbols);
+    table->num_slots = 0;
+
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        table->class_ids[i] = NO_SLOT;
+        table->func_slots[i] = NO_SLOT;
+    }
+
+    // Give every function name a slot first, so the vtables can be sized
+    for (size_t i = 0; i < table->num_classes; i++) {
+        const GlassClass *gclass = map_get(classes, list_get(class_names, i));
+        List *func_names = class_get_func_names(gclass);
+
+        for (size_t j = 0; j < list_len(func_names); j++) {
+            Symbol sym = lookup_symbol(list_get(func_names, j));
+            if (table->func_slots[sym] == NO_SLOT) {
+                table->func_slots[sym] = table->num_slots++;
+            }
+        }
+
+        free_list(func_names);
+    }
+
+    for (size_t i = 0; i < table->num_classes; i++) {
+        const String *class_name = list_get(class_names, i);
+        RuntimeClass *rclass = &table->classes[i];
+
+        rclass->gclass = map_get(classes, class_name);
+        rclass->vtable = calloc(table->num_slots, sizeof(GlassFunction *));
+        rclass->pure_funcs = calloc(table->num_slots, sizeof(PureFunc *));
+        rclass->scoped_locals = calloc(table->num_slots, sizeof(List *));
+        table->class_ids[lookup_symbol(class_name)] = i;
+
+        List *func_names = class_get_func_names(rclass->gclass);
+
+        for (size_t j = 0; j < list_len(func_names); j++) {
+            const String *func_name = list_get(func_names, j);
+            uint32_t slot = table->func_slots[lookup_symbol(func_name)];
+            rclass->vtable[slot] = class_find_func(rclass->gclass, func_name);
+        }
+
+        free_list(func_names);
+    }
+
+    free_list(class_names);
+
+    return table;
+}
+
+void free_class_table(ClassTable *table) {
+    for (size_t i = 0; i < table->num_classes; i++) {
+        free(table->classes[i].vtable);
+        free(table->classes[i].pure_funcs);
+
+        for (size_t slot = 0; slot < table->num_slots; slot++) {
+            if (table->classes[i].scoped_locals[slot] != NULL) {
+                free_list(table->classes[i].scoped_locals[slot]);
+            }
+        }
+
+        free(table->classes[i].scoped_locals);
+    }
+
+    free(table->classes);
+    free(table->class_ids);
+    free(table->func_slots);
+    free(table);
+}
+
+const RuntimeClass *class_table_get(const ClassTable *table, Symbol name) {
+    if (name >= table->num_symbols || table->class_ids[name] == NO_SLOT) {
+        return NULL;
+    }
+
+    return &table->classes[table->class_ids[name]];
+}
+
+const GlassClass *runtime_class_get_class(const RuntimeClass *rclass) {
+    return rclass->gclass;
+}
+
+const GlassFunction *class_table_get_func(const ClassTable *table,
+                                          const RuntimeClass *rclass,
+                                          Symbol name)
+{
+    if (name >= table->num_symbols || table->func_slots[name] == NO_SLOT) {
+        return NULL;
+    }
+
+    return rclass->vtable[table->func_slots[name]];
+}
+
+void class_table_set_pure_funcs(ClassTable *table, const PureFuncs *pure) {
+    for (size_t i = 0; i < table->num_classes; i++) {
+        RuntimeClass *rclass = &table->classes[i];
+        const String *class_name = class_get_name(rclass->gclass);
+
+        for (size_t slot = 0; slot < table->num_slots; slot++) {
+            const GlassFunction *func = rclass->vtable[slot];
+            if (func != NULL) {
+                rclass->pure_funcs[slot] = get_pure_func(pure, class_name, func_get_name(func));
+            }
+        }
+    }
+}
+
+const PureFunc *class_table_get_pure_func(const ClassTable *table,
+                                          const RuntimeClass *rclass,
+                                          Symbol name)
+{
+    if (name >= table->num_symbols || table->func_slots[name] == NO_SLOT) {
+        return NULL;
+    }
+
+    return rclass->pure_funcs[table->func_slots[name]];
+}
+
+void class_table_find_scoped_locals(ClassTable *table, const Map *classes) {
+    Set *escaped = get_escaped_locals(classes);
+
+    for (size_t i = 0; i < table->num_classes; i++) {
+        RuntimeClass *rclass = &table->classes[i];
+
+        for (size_t slot = 0; slot < table->num_slots; slot++) {
+            const GlassFunction *func = rclass->vtable[slot];
+
+            // Finding the escaped locals parsed every valid body
+            if (func != NULL && class_get_func(rclass->gclass, func_get_name(func)) != NULL) {
+                Set *scoped = get_scoped_locals(classes, func, escaped);
+                rclass->scoped_locals[slot] = set_to_list(scoped);
+                free_set(scoped);
+            }
+        }
+    }
+
+    free_set(escaped);
+}
+
+const List *class_table_get_scoped_locals(const ClassTable *table,
+                                         const RuntimeClass *rclass,
+                                         Symbol name)
+{
+    if (name >= table->num_symbols || table->func_slots[name] == NO_SLOT) {
+        return NULL;
+    }
+
+    return rclass->scoped_locals[table->func_slots[name]];
+}
@@ -1,6 +1,8 @@
 #include "interpreter/glass-instance.h"
+#include "interpreter/class-table.h"
 #include "interpreter/glass-value.h"
 
+#include "analysis/purity.h"
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-function.h"
 #include "utils/copy-interface.h"
@@ -12,10 +14,14 @@
 #include <string.h>
 
 typedef struct GlassInstImpl {
-    const GlassClass *gclass;
+    const RuntimeClass *rclass;
 
     Map *vars;
 
+    // The values held by an instance of L, which is only created once one is
+    // added
+    List *elements;
+
     unsigned ref_count;
 } GlassInstImpl;
 
@@ -24,31 +30,58 @@ static size_t cur_inst;
 static size_t used_insts;
 static size_t alloc_insts;
 static const Map *global_vars;
+static const ClassTable *class_table;
 static List *this_insts_list;
 static List *local_vars_list;
 
+// Slots freed outside of garbage collection, which are used before looking
+// for a free slot. Some of them could have been used since
+static List *free_insts_list;
+
+// Instances that have been marked as reachable, but whose variables haven't
+// been looked at yet. Long chains of instances would overflow the C stack if
+// they were followed recursively
+static size_t *mark_list;
+static size_t mark_len;
+static size_t mark_alloc;
+
 #define INIT_ALLOC_INSTS 1024
 
-void init_instances(const Map *globals) {
+void init_instances(const Map *globals, const ClassTable *table) {
     inst_array = calloc(INIT_ALLOC_INSTS, sizeof(GlassInstImpl));
     alloc_insts = INIT_ALLOC_INSTS;
     cur_inst = 0;
     used_insts = 0;
 
     global_vars = globals;
+    class_table = table;
     this_insts_list = new_list(SIZE_T_COPY_OPS);
     local_vars_list = new_list(VOID_PTR_COPY_OPS);
+    free_insts_list = new_list(SIZE_T_COPY_OPS);
+}
+
+static void free_inst_impl(GlassInstImpl *inst) {
+    free_map(inst->vars);
+
+    if (inst->elements != NULL) {
+        free_list(inst->elements);
+        inst->elements = NULL;
+    }
 }
 
 void free_instances(void) {
     for (size_t i = 0; i < alloc_insts; i++) {
         if (inst_array[i].ref_count > 0) {
-            free_map(inst_array[i].vars);
+            free_inst_impl(&inst_array[i]);
         }
     }
 
     free_list(this_insts_list);
     free_list(local_vars_list);
+    free_list(free_insts_list);
+    free(mark_list);
+    mark_list = NULL;
+    mark_alloc = 0;
     free(inst_array);
 }
 
@@ -62,21 +95,29 @@ void exit_scope(void) {
     free(list_pop(this_insts_list));
 }
 
+static void mark_inst_as_reachable(GlassInstance inst) {
+    if (inst_array[inst].ref_count == 0) {
+        inst_array[inst].ref_count = 1;
+
+        if (mark_len == mark_alloc) {
+            mark_alloc = mark_alloc > 0 ? mark_alloc * 2 : INIT_ALLOC_INSTS;
+            mark_list = realloc(mark_list, sizeof(size_t) * mark_alloc);
+        }
+        mark_list[mark_len++] = inst;
+    }
+}
+
+static void mark_value_as_reachable(const GlassValue *val) {
+    if (val->type == VALUE_FUNCTION || val->type == VALUE_INSTANCE) {
+        mark_inst_as_reachable(val->inst);
+    }
+}
+
 static void mark_var_map_as_reachable(const Map *vars) {
     List *keys = map_get_keys(vars);
 
     for (size_t i = 0; i < list_len(keys); i++) {
-        const String *key = list_get(keys, i);
-        const GlassValue *val = map_get(vars, key);
-
-        if (val->type == VALUE_FUNCTION || val->type == VALUE_INSTANCE) {
-            GlassInstImpl *inst = &inst_array[val->inst];
-
-            if (inst->ref_count == 0) {
-                inst->ref_count = 1;
-                mark_var_map_as_reachable(inst->vars);
-            }
-        }
+        mark_value_as_reachable(map_get(vars, list_get(keys, i)));
     }
 
     free_list(keys);
@@ -86,15 +127,23 @@ static void mark_globals_and_locals(void) {
     mark_var_map_as_reachable(global_vars);
 
     for (size_t i = 0; i < list_len(local_vars_list); i++) {
-        mark_var_map_as_reachable(* (Map **) list_get(local_vars_list, i));
+        const Map *local_vars = * (Map **) list_get(local_vars_list, i);
+        if (local_vars != NULL) {
+            mark_var_map_as_reachable(local_vars);
+        }
     }
 
     for (size_t i = 0; i < list_len(this_insts_list); i++) {
-        size_t inst_index = * (size_t *) list_get(this_insts_list, i);
+        mark_inst_as_reachable(* (size_t *) list_get(this_insts_list, i));
+    }
 
-        GlassInstImpl *inst = &inst_array[inst_index];
-        inst->ref_count = 1;
+    while (mark_len > 0) {
+        const GlassInstImpl *inst = &inst_array[mark_list[--mark_len]];
         mark_var_map_as_reachable(inst->vars);
+
+        for (size_t i = 0; inst->elements != NULL && i < list_len(inst->elements); i++) {
+            mark_value_as_reachable(list_get(inst->elements, i));
+        }
     }
 }
 
@@ -109,7 +158,7 @@ static void free_unreachable(void) {
 
     for (size_t i = 0; i < alloc_insts; i++) {
         if (inst_array[i].ref_count == 0) {
-            free_map(inst_array[i].vars);
+            free_inst_impl(&inst_array[i]);
         }
         else {
             used_insts++;
@@ -119,6 +168,8 @@ static void free_unreachable(void) {
 
 static void do_garbage_collection(void) {
     free_unreachable();
+    free_list(free_insts_list);
+    free_insts_list = new_list(SIZE_T_COPY_OPS);
 
     if (used_insts > alloc_insts / 2) {
         GlassInstImpl *new_insts = calloc(alloc_insts * 2, sizeof(GlassInstImpl));
@@ -132,6 +183,16 @@ static void do_garbage_collection(void) {
 }
 
 static size_t get_free_inst_index(void) {
+    while (!list_empty(free_insts_list)) {
+        size_t *free_index = list_pop(free_insts_list);
+        size_t index = *free_index;
+        free(free_index);
+
+        if (inst_array[index].ref_count == 0) {
+            return index;
+        }
+    }
+
     while (cur_inst < alloc_insts && inst_array[cur_inst].ref_count > 0) {
         cur_inst++;
     }
@@ -142,11 +203,12 @@ static size_t get_free_inst_index(void) {
     return get_free_inst_index();
 }
 
-GlassInstance new_glass_instance(const GlassClass *gclass) {
+GlassInstance new_glass_instance(const RuntimeClass *rclass) {
     size_t index = get_free_inst_index();
     GlassInstImpl *inst = &inst_array[index];
-    inst->gclass = gclass;
+    inst->rclass = rclass;
     inst->vars = new_map(STRING_HASH_OPS, VALUE_COPY_OPS);
+    inst->elements = NULL;
     inst->ref_count = 1;
     used_insts++;
     return index;
@@ -168,16 +230,31 @@ void release_glass_instance(GlassInstance inst) {
     */
 }
 
+void free_glass_instance(GlassInstance inst) {
+    free_inst_impl(&inst_array[inst]);
+    inst_array[inst].ref_count = 0;
+    used_insts--;
+    list_add(free_insts_list, &inst);
+}
+
 bool instance_has_var(const GlassInstance inst, const String *name) {
     return map_has(inst_array[inst].vars, name);
 }
 
-bool instance_has_func(const GlassInstance inst, const String *name) {
-    return class_has_func(inst_array[inst].gclass, name);
+bool instance_has_func(const GlassInstance inst, Symbol name) {
+    return instance_get_func(inst, name) != NULL;
 }
 
-const GlassFunction *instance_get_func(const GlassInstance inst, const String *name) {
-    return class_get_func(inst_array[inst].gclass, name);
+const GlassFunction *instance_get_func(const GlassInstance inst, Symbol name) {
+    return class_table_get_func(class_table, inst_array[inst].rclass, name);
+}
+
+const PureFunc *instance_get_pure_func(const GlassInstance inst, Symbol name) {
+    return class_table_get_pure_func(class_table, inst_array[inst].rclass, name);
+}
+
+const List *instance_get_scoped_locals(const GlassInstance inst, Symbol name) {
+    return class_table_get_scoped_locals(class_table, inst_array[inst].rclass, name);
 }
 
 const GlassValue *instance_get_var(const GlassInstance inst, const String *name) {
@@ -185,9 +262,16 @@ const GlassValue *instance_get_var(const GlassInstance inst, const String *name)
 }
 
 const GlassClass *instance_get_class(const GlassInstance inst) {
-    return inst_array[inst].gclass;
+    return runtime_class_get_class(inst_array[inst].rclass);
 }
 
 void instance_set_var(GlassInstance inst, const String *name, const GlassValue *val) {
     map_set(inst_array[inst].vars, name, val);
 }
+
+List *instance_get_elements(GlassInstance inst) {
+    if (inst_array[inst].elements == NULL) {
+        inst_array[inst].elements = new_list(VALUE_COPY_OPS);
+    }
+    return inst_array[inst].elements;
+}
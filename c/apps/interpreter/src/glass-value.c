@@ -14,10 +14,11 @@ static GlassValue *new_glass_value(ValueType type) {
     return val;
 }
 
-GlassValue *new_func_value(GlassInstance inst, const String *name) {
+GlassValue *new_func_value(GlassInstance inst, const String *name, Symbol sym) {
     GlassValue *val = new_glass_value(VALUE_FUNCTION);
     val->inst = copy_glass_instance(inst);
     val->str = copy_string(name);
+    val->sym = sym;
     return val;
 }
 
@@ -34,9 +35,10 @@ GlassValue *new_inst_value(GlassInstance inst) {
     return val;
 }
 
-GlassValue *new_name_value(const String *name) {
+GlassValue *new_name_value(const String *name, Symbol sym) {
     GlassValue *val = new_glass_value(VALUE_NAME);
     val->str = copy_string(name);
+    val->sym = sym;
     return val;
 }
 
@@ -76,9 +78,14 @@ GlassValue *copy_glass_value(const GlassValue *value) {
         case VALUE_FUNCTION:
             copy->inst = copy_glass_instance(value->inst);
             copy->str = copy_string(value->str);
+            copy->sym = value->sym;
             break;
 
         case VALUE_NAME:
+            copy->str = copy_string(value->str);
+            copy->sym = value->sym;
+            break;
+
         case VALUE_STRING:
             copy->str = copy_string(value->str);
             break;
@@ -1,10 +1,16 @@
 #include "interpreter/interpreter.h"
+#include "interpreter/class-table.h"
 #include "interpreter/glass-instance.h"
 #include "interpreter/glass-value.h"
+#include "interpreter/memo-cache.h"
 
+#include "analysis/purity.h"
+#include "glasstypes/glass-builders.h"
 #include "glasstypes/glass-command.h"
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-function.h"
+#include "glasstypes/glass-source.h"
+#include "glasstypes/glass-symbol.h"
 #include "utils/list.h"
 #include "utils/map.h"
 #include "utils/string.h"
@@ -16,6 +22,9 @@
 
 #define MAX_OP_ARGS 5
 
+// How many calls to pure functions have their results cached when memoizing
+#define MEMO_CACHE_ENTRIES 65536
+
 typedef enum VarScope {
     SCOPE_LOCAL,
     SCOPE_CLASS,
@@ -36,7 +45,11 @@ typedef enum ArgType {
 } ArgType;
 
 typedef struct InterpreterState {
-    const Map *classes;
+    const ClassTable *classes;
+
+    const String *ctor_name;
+
+    Symbol ctor_sym;
 
     List *stack;
 
@@ -45,6 +58,9 @@ typedef struct InterpreterState {
     const List *args;
 
     unsigned cur_arg;
+
+    // NULL unless pure functions are being memoized
+    MemoCache *memo;
 } InterpreterState;
 
 const char *arg_name_str(ArgType type) {
@@ -160,7 +176,9 @@ bool check_stack(const List *stack, const char *op_name, size_t size, ...) {
     return false;
 }
 
-int execute_builtin(BuiltinFunc func, InterpreterState *state) {
+// Runs a builtin for a function called on inst, which only matters for the
+// builtins that use their instance
+int execute_builtin(BuiltinFunc func, GlassInstance inst, InterpreterState *state) {
     List *stack = state->stack;
 
     switch (func) {
@@ -295,6 +313,74 @@ int execute_builtin(BuiltinFunc func, InterpreterState *state) {
             break;
         }
 
+        case BUILTIN_LIST_GET: {
+            if (check_stack(stack, "L.g", 1, ARG_INT)) {
+                return 1;
+            }
+            const List *elements = instance_get_elements(inst);
+            GlassValue *idx_val = list_pop(stack);
+            if (idx_val->num < 0 || idx_val->num >= list_len(elements)) {
+                fprintf(stderr,
+                        "Error! Index %g is out of range for L.g operation with list of length %u.\nStack trace:\n",
+                        idx_val->num, (unsigned) list_len(elements));
+                free_glass_value(idx_val);
+                return 1;
+            }
+            list_add(stack, list_get(elements, (size_t) idx_val->num));
+            free_glass_value(idx_val);
+            break;
+        }
+
+        case BUILTIN_LIST_LENGTH: {
+            GlassValue *len_val = new_number_value(list_len(instance_get_elements(inst)));
+            list_add(stack, len_val);
+            free_glass_value(len_val);
+            break;
+        }
+
+        case BUILTIN_LIST_POP: {
+            List *elements = instance_get_elements(inst);
+            if (list_empty(elements)) {
+                fprintf(stderr, "Error! Cannot pop from an empty list with L.po operation!\nStack trace:\n");
+                return 1;
+            }
+            GlassValue *val = list_pop(elements);
+            list_add(stack, val);
+            free_glass_value(val);
+            break;
+        }
+
+        case BUILTIN_LIST_PUSH: {
+            if (check_stack(stack, "L.p", 1, ARG_ANY)) {
+                return 1;
+            }
+            GlassValue *val = list_pop(stack);
+            list_add(instance_get_elements(inst), val);
+            free_glass_value(val);
+            break;
+        }
+
+        case BUILTIN_LIST_SET: {
+            if (check_stack(stack, "L.s", 2, ARG_INT, ARG_ANY)) {
+                return 1;
+            }
+            List *elements = instance_get_elements(inst);
+            GlassValue *val = list_pop(stack);
+            GlassValue *idx_val = list_pop(stack);
+            if (idx_val->num < 0 || idx_val->num >= list_len(elements)) {
+                fprintf(stderr,
+                        "Error! Index %g is out of range for L.s operation with list of length %u.\nStack trace:\n",
+                        idx_val->num, (unsigned) list_len(elements));
+                free_glass_value(val);
+                free_glass_value(idx_val);
+                return 1;
+            }
+            list_set(elements, (size_t) idx_val->num, val);
+            free_glass_value(val);
+            free_glass_value(idx_val);
+            break;
+        }
+
         case BUILTIN_MATH_ADD: {
             if (check_stack(stack, "A.a", 2, ARG_NUM, ARG_NUM)) {
                 return 1;
@@ -663,7 +749,7 @@ int execute_builtin(BuiltinFunc func, InterpreterState *state) {
             sprintf(buf, "<Anonymous Var %d>", var_index);
             var_index++;
             String *str = string_from_chars(buf);
-            GlassValue *val = new_name_value(str);
+            GlassValue *val = new_name_value(str, NO_SYMBOL);
             list_add(stack, val);
             free_glass_value(val);
             free_string(str);
@@ -724,15 +810,19 @@ void set_var(const String *name, const GlassValue *val, Map *globals, GlassInsta
 void output_stack_trace_line(const GlassValue *func_val, const GlassCommand *cmd) {
     const GlassClass *gclass = instance_get_class(func_val->inst);
 
+    const String *source_name;
+    unsigned line, col;
+    source_pos_lookup(cmd->pos, &source_name, &line, &col);
+
     String *class_name = copy_string(class_get_name(gclass));
     String *func_name = copy_string(func_val->str);
-    String *file_name = copy_string(cmd->filename);
+    String *file_name = copy_string(source_name);
 
     fprintf(stderr,
             "    %s.%s on line %u, column %u of '%s'\n",
             string_get_c_str(class_name),
             string_get_c_str(func_name),
-            cmd->line, cmd->col,
+            line, col,
             string_get_c_str(file_name));
 
     free_string(class_name);
@@ -740,12 +830,54 @@ void output_stack_trace_line(const GlassValue *func_val, const GlassCommand *cmd
     free_string(file_name);
 }
 
-int execute_function(GlassValue *func_val, InterpreterState *state) {
-    const GlassFunction *func = instance_get_func(func_val->inst, func_val->str);
+int execute_function(GlassValue *func_val, InterpreterState *state);
+
+int call_function(GlassValue *func_val, InterpreterState *state);
+
+bool is_scoped_local(const List *scoped, const String *name) {
+    for (size_t i = 0; scoped != NULL && i < list_len(scoped); i++) {
+        if (strings_equal(list_get(scoped, i), name)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Frees the instances held by locals that nothing else can reach, once their
+// function has returned. The instance a tail call runs on is kept
+void free_scoped_instances(const List *scoped, const Map *local_vars, const GlassValue *tail_call) {
+    for (size_t i = 0; scoped != NULL && i < list_len(scoped); i++) {
+        const GlassValue *val = map_get(local_vars, list_get(scoped, i));
+        if (val != NULL && val->type == VALUE_INSTANCE && (tail_call == NULL || val->inst != tail_call->inst)) {
+            free_glass_instance(val->inst);
+        }
+    }
+}
+
+// Returns whether nothing runs after the command at cmd_idx before the
+// function returns
+bool is_tail_command(const GlassFunction *func, size_t cmd_idx) {
+    return cmd_idx + 1 == func_len(func) || func_get_command(func, cmd_idx + 1)->type == CMD_RETURN;
+}
+
+// Runs a function until it returns or ends by calling another function. Then
+// its frame is already gone, and the other function is left in tail_call for
+// the caller to run in its place, so deep tail recursion uses constant space
+int run_function(GlassValue *func_val, InterpreterState *state, GlassValue **tail_call) {
+    const GlassFunction *func = instance_get_func(func_val->inst, func_val->sym);
+    if (func == NULL || func_parse_body(func)) {
+        // The function's body was invalid, which the parser has reported
+        fprintf(stderr, "Stack trace:\n");
+        return 1;
+    }
+
     List *stack = state->stack;
     Map *globals = state->global_vars;
     GlassInstance inst = func_val->inst;
 
+    const List *scoped = instance_get_scoped_locals(inst, func_val->sym);
+
     Map *local_vars = new_map(STRING_HASH_OPS, VALUE_COPY_OPS);
     register_new_scope(local_vars, inst);
 
@@ -781,7 +913,7 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
             }
 
             case CMD_BUILTIN: {
-                int ret = execute_builtin(cmd->builtin, state);
+                int ret = execute_builtin(cmd->builtin, inst, state);
                 if (ret != 0) {
                     output_stack_trace_line(func_val, cmd);
                     free_map(local_vars);
@@ -809,7 +941,16 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
                     return 1;
                 }
                 GlassValue *new_func = list_pop(stack);
-                int ret = execute_function(new_func, state);
+                // A memoized caller caches the results of the tail call as
+                // its own, so skipping the cache for it loses little
+                if (is_tail_command(func, cmd_idx)) {
+                    free_scoped_instances(scoped, local_vars, new_func);
+                    free_map(local_vars);
+                    exit_scope();
+                    *tail_call = new_func;
+                    return 0;
+                }
+                int ret = call_function(new_func, state);
                 free_glass_value(new_func);
                 if (ret != 0) {
                     output_stack_trace_line(func_val, cmd);
@@ -847,7 +988,7 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
                     free_map(local_vars);
                     return 1;
                 }
-                else if (!instance_has_func(obj_val->inst, fname_val->str)) {
+                else if (!instance_has_func(obj_val->inst, fname_val->sym)) {
                     fprintf(stderr, "Error! %s has no %s function!\nStack trace:\n",
                             string_get_c_str(oname_val->str),
                             string_get_c_str(fname_val->str));
@@ -857,7 +998,7 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
                     free_map(local_vars);
                     return 1;
                 }
-                GlassValue *new_func = new_func_value(obj_val->inst, fname_val->str);
+                GlassValue *new_func = new_func_value(obj_val->inst, fname_val->str, fname_val->sym);
                 list_add(stack, new_func);
                 free_glass_value(new_func);
                 free_glass_value(fname_val);
@@ -922,8 +1063,8 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
                 }
                 GlassValue *cname_val = list_pop(stack);
                 GlassValue *oname_val = list_pop(stack);
-                const GlassClass *gclass = map_get(state->classes, cname_val->str);
-                if (gclass == NULL) {
+                const RuntimeClass *rclass = class_table_get(state->classes, cname_val->sym);
+                if (rclass == NULL) {
                     fprintf(stderr, "Error! (%s) is not a class!\nStack trace:\n",
                             string_get_c_str(cname_val->str));
                     output_stack_trace_line(func_val, cmd);
@@ -932,11 +1073,27 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
                     free_map(local_vars);
                     return 1;
                 }
-                GlassInstance new_inst = new_glass_instance(gclass);
-                String *ctor_name = string_from_chars("c__");
+                GlassInstance new_inst = new_glass_instance(rclass);
+                // A local is gone along with this function's frame, so it
+                // never needs to be set, and the constructor can run in place
+                // of this function. Anything else has to be set after the
+                // constructor, which could read it
+                if (is_tail_command(func, cmd_idx) && get_var_scope(oname_val->str) == SCOPE_LOCAL
+                    && instance_has_func(new_inst, state->ctor_sym))
+                {
+                    free_glass_value(cname_val);
+                    free_glass_value(oname_val);
+
+                    GlassValue *ctor_val = new_func_value(new_inst, state->ctor_name, state->ctor_sym);
+                    free_scoped_instances(scoped, local_vars, ctor_val);
+                    free_map(local_vars);
+                    exit_scope();
+                    *tail_call = ctor_val;
+                    return 0;
+                }
                 int ctor_ret = 0;
-                if (instance_has_func(new_inst, ctor_name)) {
-                    GlassValue *ctor_val = new_func_value(new_inst, ctor_name);
+                if (instance_has_func(new_inst, state->ctor_sym)) {
+                    GlassValue *ctor_val = new_func_value(new_inst, state->ctor_name, state->ctor_sym);
                     ctor_ret = execute_function(ctor_val, state);
                     free_glass_value(ctor_val);
                 }
@@ -946,12 +1103,18 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
                     exit_scope();
                     return 1;
                 }
+                // Nothing else can reach the local's last instance
+                if (is_scoped_local(scoped, oname_val->str)) {
+                    const GlassValue *old_val = map_get(local_vars, oname_val->str);
+                    if (old_val != NULL && old_val->type == VALUE_INSTANCE) {
+                        free_glass_instance(old_val->inst);
+                    }
+                }
                 GlassValue *inst_val = new_inst_value(new_inst);
                 set_var(oname_val->str, inst_val, globals, inst, local_vars);
                 free_glass_value(inst_val);
                 free_glass_value(cname_val);
                 free_glass_value(oname_val);
-                free_string(ctor_name);
                 break;
             }
 
@@ -967,7 +1130,7 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
             }
 
             case CMD_PUSH_NAME: {
-                GlassValue *name_val = new_name_value(cmd->str);
+                GlassValue *name_val = new_name_value(cmd->str, cmd->index);
                 list_add(stack, name_val);
                 free_glass_value(name_val);
                 break;
@@ -988,6 +1151,7 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
             }
 
             case CMD_RETURN: {
+                free_scoped_instances(scoped, local_vars, NULL);
                 free_map(local_vars);
                 exit_scope();
                 return 0;
@@ -999,12 +1163,66 @@ int execute_function(GlassValue *func_val, InterpreterState *state) {
         }
     }
 
+    free_scoped_instances(scoped, local_vars, NULL);
     free_map(local_vars);
     exit_scope();
     return 0;
 }
 
-int run_interpreter(const Map *classes, const List *args) {
+int execute_function(GlassValue *func_val, InterpreterState *state) {
+    GlassValue *tail_call = NULL;
+    int ret = run_function(func_val, state, &tail_call);
+    if (tail_call == NULL) {
+        return ret;
+    }
+
+    // The caller could be the only one holding the instance, like one whose
+    // constructor is running, so it stays reachable until the calls finish
+    register_new_scope(NULL, func_val->inst);
+
+    while (tail_call != NULL) {
+        GlassValue *next_func = tail_call;
+        tail_call = NULL;
+        ret = run_function(next_func, state, &tail_call);
+        free_glass_value(next_func);
+    }
+
+    exit_scope();
+    return ret;
+}
+
+// Runs a function that's been called with ?, using the results of an earlier
+// call with the same arguments instead if it's pure and they were cached
+int call_function(GlassValue *func_val, InterpreterState *state) {
+    if (state->memo == NULL) {
+        return execute_function(func_val, state);
+    }
+
+    const PureFunc *pure = instance_get_pure_func(func_val->inst, func_val->sym);
+    MemoKey *key = pure != NULL ? new_memo_key(pure, state->stack, pure->num_args) : NULL;
+
+    if (key == NULL) {
+        return execute_function(func_val, state);
+    }
+    else if (memo_cache_apply(state->memo, key, state->stack)) {
+        free_memo_key(key);
+        return 0;
+    }
+
+    size_t stack_len = list_len(state->stack);
+    int ret = execute_function(func_val, state);
+
+    if (ret == 0 && list_len(state->stack) + pure->num_args == stack_len + pure->num_results) {
+        memo_cache_add(state->memo, key, state->stack, pure->num_results);
+    }
+    else {
+        free_memo_key(key);
+    }
+
+    return ret;
+}
+
+int run_interpreter(const Map *classes, const List *args, InterpreterOptions opts) {
     String *main_class_name = string_from_char('M');
 
     if (!map_has(classes, main_class_name)) {
@@ -1014,40 +1232,55 @@ int run_interpreter(const Map *classes, const List *args) {
     }
 
     const GlassClass *main_class = map_get(classes, main_class_name);
-    free_string(main_class_name);
     String *main_func_name = string_from_char('m');
 
     if (!class_has_func(main_class, main_func_name)) {
         fprintf(stderr, "M class has no m function defined!");
+        free_string(main_class_name);
+        free_string(main_func_name);
         return 1;
     }
 
+    ClassTable *table = new_class_table(classes);
     List *stack = new_list(VALUE_COPY_OPS);
     Map *globals = new_map(STRING_HASH_OPS, VALUE_COPY_OPS);
+    String *ctor_name = string_from_chars("c__");
     int ret_val = 0;
 
-    init_instances(globals);
+    init_instances(globals, table);
+
+    PureFuncs *pure = NULL;
+    if (opts.scope_instances) {
+        class_table_find_scoped_locals(table, classes);
+    }
+
+    if (opts.memoize) {
+        pure = find_pure_funcs(classes);
+        class_table_set_pure_funcs(table, pure);
+    }
 
     InterpreterState state = {
-        .classes = classes,
+        .classes = table,
+        .ctor_name = ctor_name,
+        .ctor_sym = lookup_symbol(ctor_name),
         .stack = stack,
         .global_vars = globals,
         .args = args,
         .cur_arg = 0,
+        .memo = opts.memoize ? new_memo_cache(MEMO_CACHE_ENTRIES) : NULL,
     };
 
-    GlassInstance main_inst = new_glass_instance(main_class);
-    String *ctor_name = string_from_chars("c__");
-    if (instance_has_func(main_inst, ctor_name)) {
-        GlassValue *ctor_val = new_func_value(main_inst, ctor_name);
+    GlassInstance main_inst = new_glass_instance(class_table_get(table, lookup_symbol(main_class_name)));
+    if (instance_has_func(main_inst, state.ctor_sym)) {
+        GlassValue *ctor_val = new_func_value(main_inst, ctor_name, state.ctor_sym);
         ret_val = execute_function(ctor_val, &state);
         free_glass_value(ctor_val);
     }
-    free_string(ctor_name);
 
     if (ret_val == 0) {
         GlassValue val = {
-            VALUE_FUNCTION, .inst = main_inst, .str = main_func_name
+            VALUE_FUNCTION, .inst = main_inst, .str = main_func_name,
+            .sym = lookup_symbol(main_func_name),
         };
 
         ret_val = execute_function(&val, &state);
@@ -1055,9 +1288,17 @@ int run_interpreter(const Map *classes, const List *args) {
 
     free_map(globals);
     free_list(stack);
+    free_string(main_class_name);
     free_string(main_func_name);
+    free_string(ctor_name);
+
+    if (opts.memoize) {
+        free_memo_cache(state.memo);
+        free_pure_funcs(pure);
+    }
 
     free_instances();
+    free_class_table(table);
 
     return ret_val;
 }
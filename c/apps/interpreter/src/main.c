@@ -1,28 +1,74 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "interpreter/interpreter.h"
+#include "analysis/reachability.h"
+#include "glasstypes/glass-builders.h"
+#include "glasstypes/glass-cache.h"
 #include "glasstypes/glass-class.h"
+#include "glasstypes/glass-program.h"
+#include "glasstypes/glass-source.h"
+#include "glasstypes/glass-symbol.h"
+#include "optimizer/optimizer.h"
 #include "parser/parser.h"
 #include "utils/list.h"
 #include "utils/map.h"
 #include "utils/string.h"
 #include "utils/stream.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 typedef struct Options {
     List *files;
 
     List *args;
+
+    bool use_cache;
+
+    bool strict_parse;
+
+    int opt_level;
+
+    bool memoize;
 } Options;
 
 void usage(const char *exe_name) {
-    printf("Usage: %s <glass files> ... -- <program args>\n", exe_name);
+    printf("Usage: %s [--no-cache] [--strict-parse] [--memoize] [-O<level>] <glass files> ... -- <program args>\n", exe_name);
+}
+
+// Reads the level from an -O<level> option, which is 1 if it's left out.
+// Returns true if the level isn't a non-negative number
+bool parse_opt_level(const char *arg, int *level) {
+    if (arg[2] == '\0') {
+        *level = 1;
+        return false;
+    }
+
+    char *end;
+    errno = 0;
+    long value = strtol(arg + 2, &end, 10);
+    if (!isdigit((unsigned char) arg[2]) || *end != '\0' || errno != 0 || value > INT_MAX) {
+        fprintf(stderr, "%s isn't a valid optimization level.\n", arg);
+        return true;
+    }
+
+    *level = (int) value;
+    return false;
 }
 
 bool parse_command_line(Options *opts, int argc, char **argv) {
     opts->files = new_list(STRING_COPY_OPS);
     opts->args = new_list(STRING_COPY_OPS);
+    opts->use_cache = true;
+    opts->strict_parse = false;
+    opts->opt_level = 0;
+    opts->memoize = false;
 
     bool collecting_args = false;
 
@@ -41,6 +87,21 @@ bool parse_command_line(Options *opts, int argc, char **argv) {
             usage(argv[i]);
             return true;
         }
+        else if (strcmp(argv[i], "--no-cache") == 0) {
+            opts->use_cache = false;
+        }
+        else if (strcmp(argv[i], "--strict-parse") == 0) {
+            opts->strict_parse = true;
+        }
+        else if (strcmp(argv[i], "--memoize") == 0) {
+            opts->memoize = true;
+        }
+        else if (strncmp(argv[i], "-O", 2) == 0) {
+            if (parse_opt_level(argv[i], &opts->opt_level)) {
+                free_string(str);
+                return true;
+            }
+        }
         else {
             list_add(opts->files, str);
         }
@@ -61,6 +122,81 @@ void free_options(Options *opts) {
     free_list(opts->args);
 }
 
+// Returns the path that the program with the given key is cached at, creating
+// the cache directory if needed. The directory is $CGLASS_CACHE_DIR if it's
+// set, and otherwise cglass in the user's cache directory. Returns NULL if
+// there's nowhere to put the cache
+String *get_cache_path(uint64_t key) {
+    const char *cache_dir = getenv("CGLASS_CACHE_DIR");
+    const char *xdg_dir = getenv("XDG_CACHE_HOME");
+    const char *home_dir = getenv("HOME");
+    String *path;
+
+    if (cache_dir != NULL && *cache_dir != '\0') {
+        path = string_from_chars(cache_dir);
+    }
+    else if (xdg_dir != NULL && *xdg_dir != '\0') {
+        path = string_from_chars(xdg_dir);
+        mkdir(string_get_c_str(path), 0755);
+        string_add_chars(path, "/cglass");
+    }
+    else if (home_dir != NULL && *home_dir != '\0') {
+        path = string_from_chars(home_dir);
+        string_add_chars(path, "/.cache");
+        mkdir(string_get_c_str(path), 0755);
+        string_add_chars(path, "/cglass");
+    }
+    else {
+        return NULL;
+    }
+
+    mkdir(string_get_c_str(path), 0755);
+
+    char filename[32];
+    snprintf(filename, sizeof(filename), "/%016llx.glassc", (unsigned long long) key);
+    string_add_chars(path, filename);
+
+    return path;
+}
+
+// Loads the program from the cache if it's been run with the same sources
+// before, and otherwise parses it and adds it to the cache. Function bodies
+// are only parsed once they're called, unless a strict parse was asked for,
+// whether or not the program comes from the cache
+GlassProgram *load_program(const Options *opts) {
+    uint64_t key;
+    String *cache_path = NULL;
+    bool lazy_bodies = !opts->strict_parse;
+
+    if (opts->use_cache && !hash_source_files(opts->files, &key)) {
+        cache_path = get_cache_path(key);
+    }
+
+    if (cache_path != NULL) {
+        // A strict parse can't use a cache with unparsed bodies, so it parses
+        // the sources again and replaces the cache with a fully parsed one
+        const LazyParser *lazy_parser = lazy_bodies ? GLASS_LAZY_PARSER : NULL;
+        GlassProgram *program = read_program_cache(cache_path, key, lazy_parser);
+        if (program != NULL) {
+            free_string(cache_path);
+            return program;
+        }
+    }
+
+    GlassProgram *program = classes_from_files(opts->files, true, true, lazy_bodies);
+
+    if (program != NULL && cache_path != NULL) {
+        // Failing to write the cache only means the next run has to parse
+        write_program_cache(cache_path, program, key);
+    }
+
+    if (cache_path != NULL) {
+        free_string(cache_path);
+    }
+
+    return program;
+}
+
 int main(int argc, char **argv) {
     Options opts;
 
@@ -68,14 +204,24 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    Map *classes = classes_from_files(opts.files, true, true);
-    if (classes == NULL) {
+    GlassProgram *program = load_program(&opts);
+    if (program == NULL) {
         return 1;
     }
 
-    int ret_code = run_interpreter(classes, opts.args);
+    prune_unreachable(program);
+    optimize_program(program, opts.opt_level);
+
+    InterpreterOptions interp_opts = {
+        .memoize = opts.memoize,
+        .scope_instances = opts.opt_level >= 1,
+    };
+
+    int ret_code = run_interpreter(program_get_classes(program), opts.args, interp_opts);
     free_options(&opts);
-    free_map(classes);
+    free_glass_program(program);
+    free_sources();
+    free_symbols();
 
     return ret_code;
 }
@@ -0,0 +1,280 @@
+#include "interpreter/memo-cache.h"
+#include "interpreter/glass-value.h"
+
+#include "utils/list.h"
+#include "utils/string.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct MemoKey {
+    const void *func;
+
+    size_t hash;
+
+    size_t num_args;
+
+    GlassValue *args[];
+};
+
+typedef struct MemoEntry {
+    MemoKey *key;
+
+    GlassValue **results;
+
+    size_t num_results;
+
+    struct MemoEntry *next_in_bucket;
+
+    // Entries are kept in order of when they were last used, newest first
+    struct MemoEntry *newer;
+
+    struct MemoEntry *older;
+} MemoEntry;
+
+struct MemoCache {
+    MemoEntry **buckets;
+
+    size_t num_buckets;
+
+    size_t num_entries;
+
+    size_t max_entries;
+
+    MemoEntry *newest;
+
+    MemoEntry *oldest;
+};
+
+static bool is_cacheable(const GlassValue *val) {
+    return val->type == VALUE_NUMBER || val->type == VALUE_STRING;
+}
+
+static size_t hash_value(const GlassValue *val) {
+    if (val->type == VALUE_STRING) {
+        return hash_string(val->str) ^ 0x9e3779b9;
+    }
+
+    // Zero and negative zero are equal, so they need the same hash
+    double num = val->num == 0.0 ? 0.0 : val->num;
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+
+    // Small whole numbers only differ in their high bits, so they're mixed down
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+
+    return (size_t) bits;
+}
+
+static bool values_equal(const GlassValue *val1, const GlassValue *val2) {
+    if (val1->type != val2->type) {
+        return false;
+    }
+    else if (val1->type == VALUE_STRING) {
+        return strings_equal(val1->str, val2->str);
+    }
+    else {
+        return val1->num == val2->num;
+    }
+}
+
+static bool keys_equal(const MemoKey *key1, const MemoKey *key2) {
+    if (key1->func != key2->func || key1->hash != key2->hash || key1->num_args != key2->num_args) {
+        return false;
+    }
+
+    for (size_t i = 0; i < key1->num_args; i++) {
+        if (!values_equal(key1->args[i], key2->args[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+MemoCache *new_memo_cache(size_t max_entries) {
+    MemoCache *cache = malloc(sizeof(MemoCache));
+
+    cache->num_buckets = 1;
+    while (cache->num_buckets < max_entries) {
+        cache->num_buckets *= 2;
+    }
+
+    cache->buckets = calloc(cache->num_buckets, sizeof(MemoEntry *));
+    cache->num_entries = 0;
+    cache->max_entries = max_entries;
+    cache->newest = NULL;
+    cache->oldest = NULL;
+
+    return cache;
+}
+
+static void free_memo_entry(MemoEntry *entry) {
+    for (size_t i = 0; i < entry->num_results; i++) {
+        free_glass_value(entry->results[i]);
+    }
+
+    free_memo_key(entry->key);
+    free(entry->results);
+    free(entry);
+}
+
+void free_memo_cache(MemoCache *cache) {
+    MemoEntry *entry = cache->newest;
+
+    while (entry != NULL) {
+        MemoEntry *older = entry->older;
+        free_memo_entry(entry);
+        entry = older;
+    }
+
+    free(cache->buckets);
+    free(cache);
+}
+
+MemoKey *new_memo_key(const void *func, const List *stack, size_t num_args) {
+    size_t stack_len = list_len(stack);
+    if (stack_len < num_args) {
+        return NULL;
+    }
+
+    for (size_t i = stack_len - num_args; i < stack_len; i++) {
+        if (!is_cacheable(list_get(stack, i))) {
+            return NULL;
+        }
+    }
+
+    MemoKey *key = malloc(sizeof(MemoKey) + sizeof(GlassValue *) * num_args);
+    key->func = func;
+    key->hash = (size_t) (uintptr_t) func;
+    key->num_args = num_args;
+
+    for (size_t i = 0; i < num_args; i++) {
+        key->args[i] = copy_glass_value(list_get(stack, stack_len - num_args + i));
+        key->hash = key->hash * 31 + hash_value(key->args[i]);
+    }
+
+    return key;
+}
+
+void free_memo_key(MemoKey *key) {
+    for (size_t i = 0; i < key->num_args; i++) {
+        free_glass_value(key->args[i]);
+    }
+
+    free(key);
+}
+
+static void unlink_entry(MemoCache *cache, MemoEntry *entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    }
+    else {
+        cache->newest = entry->older;
+    }
+
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    }
+    else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static void link_newest(MemoCache *cache, MemoEntry *entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+
+    if (cache->newest != NULL) {
+        cache->newest->newer = entry;
+    }
+    else {
+        cache->oldest = entry;
+    }
+
+    cache->newest = entry;
+}
+
+static void evict_oldest(MemoCache *cache) {
+    MemoEntry *entry = cache->oldest;
+    MemoEntry **link = &cache->buckets[entry->key->hash & (cache->num_buckets - 1)];
+
+    while (*link != entry) {
+        link = &(*link)->next_in_bucket;
+    }
+
+    *link = entry->next_in_bucket;
+    unlink_entry(cache, entry);
+    free_memo_entry(entry);
+    cache->num_entries--;
+}
+
+static MemoEntry *find_entry(const MemoCache *cache, const MemoKey *key) {
+    MemoEntry *entry = cache->buckets[key->hash & (cache->num_buckets - 1)];
+
+    while (entry != NULL && !keys_equal(entry->key, key)) {
+        entry = entry->next_in_bucket;
+    }
+
+    return entry;
+}
+
+bool memo_cache_apply(MemoCache *cache, const MemoKey *key, List *stack) {
+    MemoEntry *entry = find_entry(cache, key);
+    if (entry == NULL) {
+        return false;
+    }
+
+    unlink_entry(cache, entry);
+    link_newest(cache, entry);
+
+    for (size_t i = 0; i < key->num_args; i++) {
+        free_glass_value(list_pop(stack));
+    }
+
+    for (size_t i = 0; i < entry->num_results; i++) {
+        list_add(stack, entry->results[i]);
+    }
+
+    return true;
+}
+
+void memo_cache_add(MemoCache *cache, MemoKey *key, const List *stack, size_t num_results) {
+    size_t stack_len = list_len(stack);
+
+    // A recursive call with the same arguments could have cached them already
+    if (find_entry(cache, key) != NULL) {
+        free_memo_key(key);
+        return;
+    }
+
+    for (size_t i = stack_len - num_results; i < stack_len; i++) {
+        if (!is_cacheable(list_get(stack, i))) {
+            free_memo_key(key);
+            return;
+        }
+    }
+
+    if (cache->num_entries == cache->max_entries) {
+        evict_oldest(cache);
+    }
+
+    MemoEntry *entry = malloc(sizeof(MemoEntry));
+    entry->key = key;
+    entry->num_results = num_results;
+    entry->results = malloc(sizeof(GlassValue *) * (num_results > 0 ? num_results : 1));
+
+    for (size_t i = 0; i < num_results; i++) {
+        entry->results[i] = copy_glass_value(list_get(stack, stack_len - num_results + i));
+    }
+
+    MemoEntry **bucket = &cache->buckets[key->hash & (cache->num_buckets - 1)];
+    entry->next_in_bucket = *bucket;
+    *bucket = entry;
+
+    link_newest(cache, entry);
+    cache->num_entries++;
+}
@@ -1,4 +1,5 @@
 #include "minifier/minification.h"
+#include "glasstypes/glass-program.h"
 #include "parser/parser.h"
 #include "utils/list.h"
 #include "utils/map.h"
@@ -52,17 +53,17 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    Map *classes = classes_from_files(opts.files, false, false);
-    if (classes == NULL) {
+    GlassProgram *program = classes_from_files(opts.files, false, false, false);
+    if (program == NULL) {
         return 1;
     }
 
-    String *source = minify_glass_classes(classes);
+    String *source = minify_glass_classes(program_get_classes(program));
     for (size_t i = 0; i < string_len(source); i++) {
         putchar(string_get(source, i));
     }
 
-    free_map(classes);
+    free_glass_program(program);
     free_string(source);
     free_options(&opts);
 
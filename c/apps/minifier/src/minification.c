@@ -1,8 +1,10 @@
 #include "minifier/minification.h"
 
+#include "analysis/reachability.h"
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-command.h"
 #include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
 #include "parser/parser.h"
 #include "utils/copy-interface.h"
 #include "utils/list.h"
@@ -110,113 +112,10 @@ String *inc_name(const String *name, NameScope scope) {
     return new_name;
 }
 
-void add_name(const Map *classes, Map *name_counts, List *class_names,
-              List *func_names, const String *name);
-
-void count_names_in_func(const Map *classes, Map *name_counts, List *class_names,
-                         List *func_names, const GlassFunction *func)
-{
-    const String *last_name = NULL;
-
-    for (size_t i = 0; i < func_len(func); i++) {
-        const GlassCommand *cmd = func_get_command(func, i);
-
-        if (cmd->type == CMD_PUSH_NAME) {
-            if (last_name == NULL || !strings_equal(last_name, cmd->str)) {
-                add_name(classes, name_counts, class_names, func_names, cmd->str);
-            }
-            last_name = cmd->str;
-        }
-        else {
-            if (cmd->type == CMD_LOOP_BEGIN) {
-                add_name(classes, name_counts, class_names, func_names, cmd->str);
-            }
-            last_name = NULL;
-        }
-    }
-}
-
-void add_name(const Map *classes, Map *name_counts, List *class_names,
-              List *func_names, const String *name)
-{
-    if (map_has(name_counts, name)) {
-        int *count = map_get_mutable(name_counts, name);
-        *count += 1;
-        return;
-    }
-
-    int count = 1;
-    map_set(name_counts, name, &count);
-
-    NameScope scope = get_name_scope(name);
-
-    if (scope == NAME_CLASSWIDE) {
-        list_add(func_names, name);
-
-        List *class_name_copy = copy_list(class_names);
-
-        for (size_t i = 0; i < list_len(class_name_copy); i++) {
-            const String *class_name = list_get(class_name_copy, i);
-            const GlassClass *gclass = map_get(classes, class_name);           
-
-            if (class_has_func(gclass, name)) {
-                const GlassFunction *func = class_get_func(gclass, name);
-                count_names_in_func(classes, name_counts, class_names, func_names, func);
-            }
-        }
-
-        free_list(class_name_copy);
-    }
-    else if (map_has(classes, name)) {
-        list_add(class_names, name);
-
-        List *func_name_copy = copy_list(func_names);
-        const GlassClass *gclass = map_get(classes, name);
-
-        for (size_t i = 0; i < list_len(func_name_copy); i++) {
-            const String *func_name = list_get(func_name_copy, i);
-
-            if (class_has_func(gclass, func_name)) {
-                const GlassFunction *func = class_get_func(gclass, func_name);
-                count_names_in_func(classes, name_counts, class_names, func_names, func);
-            }
-        }
-
-        const List *parents = class_get_parents(gclass);
-        for (size_t i = 0; i < list_len(parents); i++) {
-            const String *parent_name = list_get(parents, i);
-            add_name(classes, name_counts, class_names, func_names, parent_name);
-        }
-
-        free_list(func_name_copy);
-    }
-}
-
-Map *get_reachable_names(const Map *classes) {
-    Map *name_counts = new_map(STRING_HASH_OPS, INT_COPY_OPS);
-    List *class_names = new_list(STRING_COPY_OPS);
-    List *func_names = new_list(STRING_COPY_OPS);
-
-    String *main_class_name = string_from_char('M');
-    String *main_func_name = string_from_char('m');
-    String *ctor_name = string_from_chars("c__");
-
-    add_name(classes, name_counts, class_names, func_names, ctor_name);
-    add_name(classes, name_counts, class_names, func_names, main_func_name);
-    add_name(classes, name_counts, class_names, func_names, main_class_name);
-
-    free_string(main_class_name);
-    free_string(main_func_name);
-    free_string(ctor_name);
-    free_list(class_names);
-    free_list(func_names);
-
-    return name_counts;
-}
-
 Set *get_fixed_names(const Map *name_counts) {
     List *empty_list = new_list(STRING_COPY_OPS);
-    Map *builtins = classes_from_files(empty_list, true, false);
+    GlassProgram *builtin_program = classes_from_files(empty_list, true, false, false);
+    const Map *builtins = program_get_classes(builtin_program);
     Set *fixed_names = new_set(STRING_HASH_OPS);
 
     String *main_class_name = string_from_char('M');
@@ -252,7 +151,7 @@ Set *get_fixed_names(const Map *name_counts) {
     free_string(ctor_name);
     free_list(builtin_classes);
     free_list(empty_list);
-    free_map(builtins);
+    free_glass_program(builtin_program);
 
     return fixed_names;
 }
@@ -348,9 +247,8 @@ String *minify_source(const Map *classes, const Map *reassigned_names) {
         string_add_char(minified, '{');
         add_name_to_source(minified, class_name, reassigned_names);
 
-        const List *parents_list = class_get_parents(gclass);
-        for (size_t j = 0; j < list_len(parents_list); j++) {
-            const String *parent_name = list_get(parents_list, j);
+        for (size_t j = 0; j < class_num_parents(gclass); j++) {
+            const String *parent_name = class_get_parent(gclass, j);
             add_name_to_source(minified, parent_name, reassigned_names);
         }
 
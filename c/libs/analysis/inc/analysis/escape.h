@@ -0,0 +1,19 @@
+#ifndef ANALYSIS_ESCAPE_H
+#define ANALYSIS_ESCAPE_H
+
+struct GlassFunction;
+struct Map;
+struct Set;
+
+// Returns the local names that are pushed anywhere in the program other than
+// to assign them a new instance or to get a function from them. Any of them
+// could end up being used through a name that isn't known statically
+struct Set *get_escaped_locals(const struct Map *classes);
+
+// Returns the locals of the function that only ever hold instances it creates
+// itself, which can't be reached from anywhere else. Nothing can use those
+// instances once the function returns, or once the local is given another one
+struct Set *get_scoped_locals(const struct Map *classes, const struct GlassFunction *func,
+                              const struct Set *escaped);
+
+#endif
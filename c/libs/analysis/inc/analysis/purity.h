@@ -0,0 +1,34 @@
+#ifndef ANALYSIS_PURITY_H
+#define ANALYSIS_PURITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The functions of a program whose results only depend on the values they
+// take off the stack
+typedef struct PureFuncs PureFuncs;
+struct Map;
+struct String;
+
+// How a pure function uses the stack. Calling it takes num_args values off
+// the stack and leaves num_results values in their place
+typedef struct PureFunc {
+    size_t num_args;
+
+    size_t num_results;
+} PureFunc;
+
+// Finds every function that only uses its arguments, its own local variables,
+// and instances it creates of classes whose functions are pure. Pure
+// functions never touch class or global variables, and never run builtins
+// with side effects like input or output
+PureFuncs *find_pure_funcs(const struct Map *classes);
+
+void free_pure_funcs(PureFuncs *pure);
+
+// Returns how the class's function uses the stack, or NULL if it isn't pure.
+// The function is pure when called on any instance of exactly that class
+const PureFunc *get_pure_func(const PureFuncs *pure, const struct String *class_name,
+                              const struct String *func_name);
+
+#endif
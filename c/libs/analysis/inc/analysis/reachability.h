@@ -0,0 +1,17 @@
+#ifndef ANALYSIS_REACHABILITY_H
+#define ANALYSIS_REACHABILITY_H
+
+struct GlassProgram;
+struct Map;
+
+// Returns a map from every name that running the classes could use, starting
+// from the main class, main function and constructors, to how many times it's
+// referenced. Names can only come from literals in function bodies, so a
+// class or function that isn't in the map can never be looked up
+struct Map *get_reachable_names(const struct Map *classes);
+
+// Drops every class and function from the program that running it can never
+// reach
+void prune_unreachable(struct GlassProgram *program);
+
+#endif
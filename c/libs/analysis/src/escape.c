@@ -0,0 +1,135 @@
+#include "analysis/escape.h"
+
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-command.h"
+#include "glasstypes/glass-function.h"
+#include "utils/list.h"
+#include "utils/map.h"
+#include "utils/set.h"
+#include "utils/string.h"
+
+#include <ctype.h>
+
+static bool is_local_name(const String *name) {
+    char c = string_get(name, 0);
+    return !isupper(c) && !islower(c);
+}
+
+static bool is_type(const GlassFunction *func, size_t index, CommandType type) {
+    return index < func_len(func) && func_get_command(func, index)->type == type;
+}
+
+// Returns true if the name pushed at index is only used to assign a new
+// instance to it, or to get one of its functions. Either way, the name is
+// popped again straight away
+static bool is_contained_name(const GlassFunction *func, size_t index) {
+    if (!is_type(func, index + 1, CMD_PUSH_NAME)) {
+        return false;
+    }
+
+    return is_type(func, index + 2, CMD_NEW_INST) || is_type(func, index + 2, CMD_GET_FUNC);
+}
+
+Set *get_escaped_locals(const Map *classes) {
+    Set *escaped = new_set(STRING_HASH_OPS);
+    List *class_names = map_get_keys(classes);
+
+    for (size_t i = 0; i < list_len(class_names); i++) {
+        const GlassClass *gclass = map_get(classes, list_get(class_names, i));
+        List *func_names = class_get_func_names(gclass);
+
+        for (size_t j = 0; j < list_len(func_names); j++) {
+            const GlassFunction *func = class_get_func(gclass, list_get(func_names, j));
+            if (func == NULL) {
+                continue;
+            }
+
+            for (size_t k = 0; k < func_len(func); k++) {
+                const GlassCommand *cmd = func_get_command(func, k);
+
+                if (cmd->type == CMD_PUSH_NAME && is_local_name(cmd->str) && !is_contained_name(func, k)) {
+                    set_add(escaped, cmd->str);
+                }
+            }
+        }
+
+        free_list(func_names);
+    }
+
+    free_list(class_names);
+    return escaped;
+}
+
+// Returns whether running the class's function can't let the instance it's
+// run on escape. Only $ can give an instance a name, so without it the
+// instance can't be stored anywhere. Functions that don't exist or have an
+// invalid body can't be run at all
+static bool func_keeps_self(const Map *classes, const String *class_name, const String *func_name) {
+    const GlassClass *gclass = map_get(classes, class_name);
+    const GlassFunction *func = gclass != NULL ? class_get_func(gclass, func_name) : NULL;
+
+    for (size_t i = 0; func != NULL && i < func_len(func); i++) {
+        if (func_get_command(func, i)->type == CMD_ASSIGN_SELF) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Returns whether the local is given a new instance at index
+static bool is_new_inst(const GlassFunction *func, size_t index, const String *name) {
+    const GlassCommand *cmd = func_get_command(func, index);
+    return cmd->type == CMD_PUSH_NAME && strings_equal(cmd->str, name) && is_type(func, index + 2, CMD_NEW_INST);
+}
+
+Set *get_scoped_locals(const Map *classes, const GlassFunction *func, const Set *escaped) {
+    Set *unsafe = new_set(STRING_HASH_OPS);
+    String *ctor_name = string_from_chars("c__");
+
+    for (size_t i = 0; i < func_len(func); i++) {
+        const GlassCommand *cmd = func_get_command(func, i);
+        if (cmd->type != CMD_PUSH_NAME || !is_local_name(cmd->str) || set_has(escaped, cmd->str) ||
+            !is_contained_name(func, i))
+        {
+            continue;
+        }
+
+        bool get_func = is_type(func, i + 2, CMD_GET_FUNC);
+        const String *func_name = get_func ? func_get_command(func, i + 1)->str : ctor_name;
+
+        // A function that's got but not run straight away keeps its instance
+        // on the stack
+        if (get_func && !is_type(func, i + 3, CMD_EXECUTE_FUNC)) {
+            set_add(unsafe, cmd->str);
+            continue;
+        }
+
+        // The function could be run on an instance of any class the local is
+        // given
+        for (size_t j = 0; j < func_len(func); j++) {
+            if (is_new_inst(func, j, cmd->str) &&
+                !func_keeps_self(classes, func_get_command(func, j + 1)->str, func_name))
+            {
+                set_add(unsafe, cmd->str);
+            }
+        }
+    }
+
+    Set *scoped = new_set(STRING_HASH_OPS);
+
+    for (size_t i = 0; i < func_len(func); i++) {
+        const GlassCommand *cmd = func_get_command(func, i);
+
+        if (cmd->type == CMD_PUSH_NAME && is_local_name(cmd->str) && is_new_inst(func, i, cmd->str) &&
+            !set_has(escaped, cmd->str) && !set_has(unsafe, cmd->str))
+        {
+            set_add(scoped, cmd->str);
+        }
+    }
+
+    free_string(ctor_name);
+    free_set(unsafe);
+
+    return scoped;
+}
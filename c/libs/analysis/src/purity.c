@@ -0,0 +1,625 @@
+#include "analysis/purity.h"
+
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-command.h"
+#include "glasstypes/glass-function.h"
+#include "utils/copy-interface.h"
+#include "utils/list.h"
+#include "utils/map.h"
+#include "utils/string.h"
+
+#include <stdlib.h>
+
+// How many times a loop body is looked at before giving up on what the
+// variables in it settle to
+#define MAX_LOOP_PASSES 16
+
+typedef enum EntryType {
+    ENTRY_VALUE,
+    ENTRY_NAME,
+    ENTRY_INST,
+    ENTRY_FUNC,
+} EntryType;
+
+// What's known about a value on the stack or in a local variable
+typedef struct Entry {
+    EntryType type;
+
+    // The pushed name, or the name of a function
+    const String *name;
+
+    // The class of an instance, or of the instance a function belongs to
+    const String *class_name;
+} Entry;
+
+COPY_OPS_DEFINITION(Entry, ENTRY);
+
+typedef enum FuncStatus {
+    FUNC_UNKNOWN,
+    FUNC_PURE,
+    FUNC_IMPURE,
+} FuncStatus;
+
+typedef struct FuncInfo {
+    FuncStatus status;
+
+    PureFunc effect;
+} FuncInfo;
+
+COPY_OPS_DEFINITION(FuncInfo, FUNC_INFO);
+
+struct PureFuncs {
+    // From the class and function name, joined by a dot, to what's known about
+    // the function
+    Map *funcs;
+};
+
+// The stack and local variables at some point in a function. Stack positions
+// are relative to where the stack was when the function was called, so the
+// function's arguments are at negative positions. Only the entries from base
+// up are tracked, and anything below it is an unknown value
+typedef struct StackState {
+    bool reachable;
+
+    long depth;
+
+    long base;
+
+    List *entries;
+
+    Map *locals;
+} StackState;
+
+typedef struct Analysis {
+    const Map *classes;
+
+    const Map *funcs;
+
+    const String *class_name;
+
+    const String *ctor_name;
+
+    bool impure;
+
+    // Set when a path through the function calls something whose stack use
+    // isn't known yet, so the path couldn't be followed
+    bool incomplete;
+
+    // The lowest stack position the function reads or pops
+    long min_pos;
+
+    bool has_return;
+
+    long ret_depth;
+} Analysis;
+
+static String *func_key(const String *class_name, const String *func_name) {
+    String *key = copy_string(class_name);
+    string_add_char(key, '.');
+    string_add_str(key, func_name);
+    return key;
+}
+
+static const FuncInfo *get_info(const Map *funcs, const String *class_name, const String *func_name) {
+    String *key = func_key(class_name, func_name);
+    const FuncInfo *info = map_get(funcs, key);
+    free_string(key);
+    return info;
+}
+
+static bool is_local_name(const String *name) {
+    return string_get(name, 0) == '_';
+}
+
+static bool names_match(const String *name1, const String *name2) {
+    return name1 == name2 || (name1 != NULL && name2 != NULL && strings_equal(name1, name2));
+}
+
+static bool entries_equal(const Entry *entry1, const Entry *entry2) {
+    return entry1->type == entry2->type && names_match(entry1->name, entry2->name) &&
+           names_match(entry1->class_name, entry2->class_name);
+}
+
+static StackState copy_state(const StackState *state) {
+    return (StackState) {
+        .reachable = state->reachable,
+        .depth = state->depth,
+        .base = state->base,
+        .entries = copy_list(state->entries),
+        .locals = copy_map(state->locals),
+    };
+}
+
+static void free_state(StackState *state) {
+    free_list(state->entries);
+    free_map(state->locals);
+}
+
+static void push_entry(StackState *state, Entry entry) {
+    list_add(state->entries, &entry);
+    state->depth++;
+}
+
+static void push_value(StackState *state) {
+    push_entry(state, (Entry) {ENTRY_VALUE, NULL, NULL});
+}
+
+static Entry pop_entry(Analysis *analysis, StackState *state) {
+    Entry entry = {ENTRY_VALUE, NULL, NULL};
+
+    state->depth--;
+    if (state->depth < analysis->min_pos) {
+        analysis->min_pos = state->depth;
+    }
+
+    if (list_empty(state->entries)) {
+        state->base = state->depth;
+    }
+    else {
+        Entry *top = list_pop(state->entries);
+        entry = *top;
+        free(top);
+    }
+
+    return entry;
+}
+
+static Entry peek_entry(Analysis *analysis, const StackState *state, size_t index) {
+    long pos = state->depth - 1 - (long) index;
+    if (pos < analysis->min_pos) {
+        analysis->min_pos = pos;
+    }
+
+    if (pos < state->base) {
+        return (Entry) {ENTRY_VALUE, NULL, NULL};
+    }
+
+    return *(const Entry *) list_get(state->entries, pos - state->base);
+}
+
+// Pops a name, returning it if it's the name of a local variable. Using any
+// other variable makes the function impure
+static const String *pop_local_name(Analysis *analysis, StackState *state) {
+    Entry entry = pop_entry(analysis, state);
+
+    if (entry.type != ENTRY_NAME || !is_local_name(entry.name)) {
+        analysis->impure = true;
+        return NULL;
+    }
+
+    return entry.name;
+}
+
+// Merges another state into the first, so that it covers both. Returns whether
+// the first state changed
+static bool merge_states(Analysis *analysis, StackState *state, const StackState *other) {
+    if (!other->reachable) {
+        return false;
+    }
+    else if (!state->reachable) {
+        free_state(state);
+        *state = copy_state(other);
+        return true;
+    }
+    else if (state->depth != other->depth) {
+        // The stack would grow or shrink with every pass through a loop
+        analysis->impure = true;
+        return false;
+    }
+
+    bool changed = false;
+    long base = state->base > other->base ? state->base : other->base;
+    List *entries = new_list(ENTRY_COPY_OPS);
+
+    for (long pos = base; pos < state->depth; pos++) {
+        Entry entry = *(const Entry *) list_get(state->entries, pos - state->base);
+
+        if (!entries_equal(&entry, list_get(other->entries, pos - other->base))) {
+            entry = (Entry) {ENTRY_VALUE, NULL, NULL};
+            changed = true;
+        }
+
+        list_add(entries, &entry);
+    }
+
+    changed = changed || base != state->base;
+    free_list(state->entries);
+    state->entries = entries;
+    state->base = base;
+
+    // A local that's only set on one path can't be read on the other
+    List *names = map_get_keys(other->locals);
+
+    for (size_t i = 0; i < list_len(names); i++) {
+        const String *name = list_get(names, i);
+        const Entry *other_entry = map_get(other->locals, name);
+        const Entry *entry = map_get(state->locals, name);
+
+        if (entry == NULL) {
+            map_set(state->locals, name, other_entry);
+            changed = true;
+        }
+        else if (!entries_equal(entry, other_entry) && entry->type != ENTRY_VALUE) {
+            Entry value = {ENTRY_VALUE, NULL, NULL};
+            map_set(state->locals, name, &value);
+            changed = true;
+        }
+    }
+
+    free_list(names);
+
+    return changed;
+}
+
+// Returns whether the builtin only works on values from the stack, and
+// gets how it uses the stack if so
+static bool get_builtin_effect(BuiltinFunc builtin, PureFunc *effect) {
+    switch (builtin) {
+        case BUILTIN_MATH_FLOOR:
+        case BUILTIN_STR_LENGTH:
+        case BUILTIN_STR_NUM_TO_STR:
+        case BUILTIN_STR_STR_TO_NUM:
+            *effect = (PureFunc) {1, 1};
+            return true;
+
+        case BUILTIN_MATH_ADD:
+        case BUILTIN_MATH_DIVIDE:
+        case BUILTIN_MATH_EQUAL:
+        case BUILTIN_MATH_GREATER_OR_EQUAL:
+        case BUILTIN_MATH_GREATER_THAN:
+        case BUILTIN_MATH_LESS_OR_EQUAL:
+        case BUILTIN_MATH_LESS_THAN:
+        case BUILTIN_MATH_MODULO:
+        case BUILTIN_MATH_MULTIPLY:
+        case BUILTIN_MATH_NOT_EQUAL:
+        case BUILTIN_MATH_SUBTRACT:
+        case BUILTIN_STR_APPEND:
+        case BUILTIN_STR_EQUAL:
+        case BUILTIN_STR_INDEX:
+            *effect = (PureFunc) {2, 1};
+            return true;
+
+        case BUILTIN_STR_SPLIT:
+            *effect = (PureFunc) {2, 2};
+            return true;
+
+        case BUILTIN_STR_REPLACE:
+            *effect = (PureFunc) {3, 1};
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static void apply_effect(Analysis *analysis, StackState *state, const PureFunc *effect) {
+    for (size_t i = 0; i < effect->num_args; i++) {
+        pop_entry(analysis, state);
+    }
+
+    for (size_t i = 0; i < effect->num_results; i++) {
+        push_value(state);
+    }
+}
+
+static void analyze_call(Analysis *analysis, StackState *state, const String *class_name,
+                         const String *func_name)
+{
+    const FuncInfo *info = get_info(analysis->funcs, class_name, func_name);
+
+    if (info == NULL || info->status == FUNC_IMPURE) {
+        analysis->impure = true;
+    }
+    else if (info->status == FUNC_UNKNOWN) {
+        analysis->incomplete = true;
+        state->reachable = false;
+    }
+    else {
+        apply_effect(analysis, state, &info->effect);
+    }
+}
+
+static void analyze_return(Analysis *analysis, StackState *state) {
+    if (analysis->has_return && analysis->ret_depth != state->depth) {
+        analysis->impure = true;
+    }
+
+    analysis->has_return = true;
+    analysis->ret_depth = state->depth;
+    state->reachable = false;
+}
+
+static void analyze_commands(Analysis *analysis, const GlassFunction *func, size_t start, size_t end,
+                             StackState *state)
+{
+    for (size_t i = start; i < end && state->reachable && !analysis->impure; i++) {
+        const GlassCommand *cmd = func_get_command(func, i);
+
+        switch (cmd->type) {
+            case CMD_ASSIGN_SELF: {
+                const String *name = pop_local_name(analysis, state);
+                if (name != NULL) {
+                    Entry self = {ENTRY_INST, NULL, analysis->class_name};
+                    map_set(state->locals, name, &self);
+                }
+                break;
+            }
+
+            case CMD_ASSIGN_VAL: {
+                Entry val = pop_entry(analysis, state);
+                const String *name = pop_local_name(analysis, state);
+                if (name != NULL) {
+                    map_set(state->locals, name, &val);
+                }
+                break;
+            }
+
+            case CMD_BUILTIN: {
+                PureFunc effect;
+                if (get_builtin_effect(cmd->builtin, &effect)) {
+                    apply_effect(analysis, state, &effect);
+                }
+                else {
+                    analysis->impure = true;
+                }
+                break;
+            }
+
+            case CMD_DUPLICATE:
+                push_entry(state, peek_entry(analysis, state, cmd->index));
+                break;
+
+            case CMD_EXECUTE_FUNC: {
+                Entry func_entry = pop_entry(analysis, state);
+                if (func_entry.type == ENTRY_FUNC) {
+                    analyze_call(analysis, state, func_entry.class_name, func_entry.name);
+                }
+                else {
+                    analysis->impure = true;
+                }
+                break;
+            }
+
+            case CMD_GET_FUNC: {
+                Entry func_name = pop_entry(analysis, state);
+                const String *obj_name = pop_local_name(analysis, state);
+                const Entry *obj = obj_name != NULL ? map_get(state->locals, obj_name) : NULL;
+
+                if (func_name.type == ENTRY_NAME && obj != NULL && obj->type == ENTRY_INST) {
+                    push_entry(state, (Entry) {ENTRY_FUNC, func_name.name, obj->class_name});
+                }
+                else {
+                    analysis->impure = true;
+                }
+                break;
+            }
+
+            case CMD_GET_VAL: {
+                const String *name = pop_local_name(analysis, state);
+                const Entry *val = name != NULL ? map_get(state->locals, name) : NULL;
+
+                if (val != NULL) {
+                    push_entry(state, *val);
+                }
+                else {
+                    push_value(state);
+                }
+                break;
+            }
+
+            case CMD_LOOP_BEGIN: {
+                const GlassCommand *loop_end = func_get_command(func, cmd->index);
+                if (!is_local_name(cmd->str) || !is_local_name(loop_end->str)) {
+                    analysis->impure = true;
+                    break;
+                }
+
+                // The state before the loop is merged with the state after each
+                // pass through it, until that stops changing anything
+                for (unsigned pass = 0;; pass++) {
+                    if (pass == MAX_LOOP_PASSES) {
+                        analysis->impure = true;
+                        break;
+                    }
+
+                    StackState body = copy_state(state);
+                    analyze_commands(analysis, func, i + 1, cmd->index, &body);
+                    bool changed = !analysis->impure && merge_states(analysis, state, &body);
+                    free_state(&body);
+
+                    if (!changed) {
+                        break;
+                    }
+                }
+
+                i = cmd->index;
+                break;
+            }
+
+            case CMD_NEW_INST: {
+                Entry class_name = pop_entry(analysis, state);
+                const String *obj_name = pop_local_name(analysis, state);
+
+                if (obj_name == NULL || class_name.type != ENTRY_NAME ||
+                    !map_has(analysis->classes, class_name.name))
+                {
+                    analysis->impure = true;
+                    break;
+                }
+
+                const GlassClass *gclass = map_get(analysis->classes, class_name.name);
+                if (class_has_func(gclass, analysis->ctor_name)) {
+                    analyze_call(analysis, state, class_name.name, analysis->ctor_name);
+                }
+
+                Entry inst = {ENTRY_INST, NULL, class_name.name};
+                map_set(state->locals, obj_name, &inst);
+                break;
+            }
+
+            case CMD_POP_STACK:
+                pop_entry(analysis, state);
+                break;
+
+            case CMD_PUSH_NAME:
+                push_entry(state, (Entry) {ENTRY_NAME, cmd->str, NULL});
+                break;
+
+            case CMD_PUSH_NUM:
+            case CMD_PUSH_STR:
+                push_value(state);
+                break;
+
+            case CMD_RETURN:
+                analyze_return(analysis, state);
+                break;
+
+            default:
+                analysis->impure = true;
+                break;
+        }
+    }
+}
+
+// Works out how the function uses the stack, given what's known about the
+// functions it calls so far. Returns true if the function is impure.
+// Otherwise has_effect is set if any path through it returns, and complete is
+// set if every path could be followed
+static bool analyze_func(Analysis *analysis, const GlassFunction *func, PureFunc *effect,
+                         bool *has_effect, bool *complete)
+{
+    StackState state = {
+        .reachable = true,
+        .depth = 0,
+        .base = 0,
+        .entries = new_list(ENTRY_COPY_OPS),
+        .locals = new_map(STRING_HASH_OPS, ENTRY_COPY_OPS),
+    };
+
+    analysis->impure = false;
+    analysis->incomplete = false;
+    analysis->min_pos = 0;
+    analysis->has_return = false;
+
+    analyze_commands(analysis, func, 0, func_len(func), &state);
+    if (state.reachable && !analysis->impure) {
+        analyze_return(analysis, &state);
+    }
+
+    free_state(&state);
+
+    *has_effect = analysis->has_return;
+    *complete = !analysis->incomplete;
+
+    if (analysis->has_return) {
+        effect->num_args = (size_t) -analysis->min_pos;
+        effect->num_results = (size_t) (analysis->ret_depth - analysis->min_pos);
+    }
+
+    return analysis->impure;
+}
+
+// Looks at every function once with what's known about the others. Paths that
+// call functions that haven't been worked out yet are skipped, unless this is
+// the final pass, where any function with such a path is marked impure.
+// Returns whether anything changed
+static bool analyze_funcs(PureFuncs *pure, Analysis *analysis, const List *class_names, bool final_pass) {
+    bool changed = false;
+
+    for (size_t i = 0; i < list_len(class_names); i++) {
+        const String *class_name = list_get(class_names, i);
+        const GlassClass *gclass = map_get(analysis->classes, class_name);
+        List *func_names = class_get_func_names(gclass);
+
+        analysis->class_name = class_name;
+
+        for (size_t j = 0; j < list_len(func_names); j++) {
+            const String *func_name = list_get(func_names, j);
+            String *key = func_key(class_name, func_name);
+            FuncInfo *info = map_get_mutable(pure->funcs, key);
+            free_string(key);
+
+            if (info->status == FUNC_IMPURE) {
+                continue;
+            }
+
+            // A function whose body is invalid can't be run at all
+            const GlassFunction *func = class_get_func(gclass, func_name);
+            PureFunc effect;
+            bool has_effect = false;
+            bool complete = false;
+            bool impure = func == NULL || analyze_func(analysis, func, &effect, &has_effect, &complete);
+
+            if (impure || (final_pass && !complete) || (complete && !has_effect)) {
+                info->status = FUNC_IMPURE;
+                changed = true;
+            }
+            else if (has_effect && info->status == FUNC_UNKNOWN) {
+                info->status = FUNC_PURE;
+                info->effect = effect;
+                changed = true;
+            }
+            else if (has_effect && (info->effect.num_args != effect.num_args ||
+                                    info->effect.num_results != effect.num_results))
+            {
+                info->status = FUNC_IMPURE;
+                changed = true;
+            }
+        }
+
+        free_list(func_names);
+    }
+
+    return changed;
+}
+
+PureFuncs *find_pure_funcs(const Map *classes) {
+    PureFuncs *pure = malloc(sizeof(PureFuncs));
+    pure->funcs = new_map(STRING_HASH_OPS, FUNC_INFO_COPY_OPS);
+
+    List *class_names = map_get_keys(classes);
+    FuncInfo unknown = {.status = FUNC_UNKNOWN};
+
+    for (size_t i = 0; i < list_len(class_names); i++) {
+        const String *class_name = list_get(class_names, i);
+        List *func_names = class_get_func_names(map_get(classes, class_name));
+
+        for (size_t j = 0; j < list_len(func_names); j++) {
+            String *key = func_key(class_name, list_get(func_names, j));
+            map_set(pure->funcs, key, &unknown);
+            free_string(key);
+        }
+
+        free_list(func_names);
+    }
+
+    String *ctor_name = string_from_chars("c__");
+    Analysis analysis = {
+        .classes = classes,
+        .funcs = pure->funcs,
+        .ctor_name = ctor_name,
+    };
+
+    // Recursive functions only get a known stack use from their base cases, so
+    // the other paths are followed once that's been found
+    while (analyze_funcs(pure, &analysis, class_names, false)) {
+    }
+
+    while (analyze_funcs(pure, &analysis, class_names, true)) {
+    }
+
+    free_string(ctor_name);
+    free_list(class_names);
+
+    return pure;
+}
+
+void free_pure_funcs(PureFuncs *pure) {
+    free_map(pure->funcs);
+    free(pure);
+}
+
+const PureFunc *get_pure_func(const PureFuncs *pure, const String *class_name, const String *func_name) {
+    const FuncInfo *info = get_info(pure->funcs, class_name, func_name);
+    return info != NULL && info->status == FUNC_PURE ? &info->effect : NULL;
+}
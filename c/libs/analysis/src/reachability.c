@@ -0,0 +1,161 @@
+#include "analysis/reachability.h"
+
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-command.h"
+#include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "utils/copy-interface.h"
+#include "utils/list.h"
+#include "utils/map.h"
+#include "utils/string.h"
+
+#include <ctype.h>
+
+// Function names start with a lowercase letter, and everything else that
+// starts with one is a local or global variable
+static bool is_func_name(const String *name) {
+    return islower(string_get(name, 0));
+}
+
+static void add_name(const Map *classes, Map *name_counts, List *class_names,
+                     List *func_names, const String *name);
+
+typedef struct NameCounter {
+    const Map *classes;
+
+    Map *name_counts;
+
+    List *class_names;
+
+    List *func_names;
+
+    // The name pushed by the previous command, if it pushed one
+    String *last_name;
+} NameCounter;
+
+static void forget_last_name(NameCounter *counter) {
+    if (counter->last_name != NULL) {
+        free_string(counter->last_name);
+        counter->last_name = NULL;
+    }
+}
+
+static void count_name(const String *name, bool is_loop, void *data) {
+    NameCounter *counter = data;
+
+    if (name != NULL && !is_loop) {
+        if (counter->last_name == NULL || !strings_equal(counter->last_name, name)) {
+            add_name(counter->classes, counter->name_counts, counter->class_names,
+                     counter->func_names, name);
+            forget_last_name(counter);
+            counter->last_name = copy_string(name);
+        }
+        return;
+    }
+
+    if (is_loop) {
+        add_name(counter->classes, counter->name_counts, counter->class_names,
+                 counter->func_names, name);
+    }
+
+    forget_last_name(counter);
+}
+
+// Bodies that haven't been parsed yet are only scanned for their names, so
+// that finding what's reachable doesn't parse every function
+static void count_names_in_func(const Map *classes, Map *name_counts, List *class_names,
+                                List *func_names, const GlassFunction *func)
+{
+    NameCounter counter = {
+        .classes = classes,
+        .name_counts = name_counts,
+        .class_names = class_names,
+        .func_names = func_names,
+        .last_name = NULL,
+    };
+
+    func_visit_names(func, count_name, &counter);
+    forget_last_name(&counter);
+}
+
+static void add_name(const Map *classes, Map *name_counts, List *class_names,
+                     List *func_names, const String *name)
+{
+    if (map_has(name_counts, name)) {
+        int *count = map_get_mutable(name_counts, name);
+        *count += 1;
+        return;
+    }
+
+    int count = 1;
+    map_set(name_counts, name, &count);
+
+    if (is_func_name(name)) {
+        list_add(func_names, name);
+
+        List *class_name_copy = copy_list(class_names);
+
+        for (size_t i = 0; i < list_len(class_name_copy); i++) {
+            const String *class_name = list_get(class_name_copy, i);
+            const GlassClass *gclass = map_get(classes, class_name);           
+
+            // A function whose body is invalid can't use any names
+            const GlassFunction *func = class_find_func(gclass, name);
+            if (func != NULL) {
+                count_names_in_func(classes, name_counts, class_names, func_names, func);
+            }
+        }
+
+        free_list(class_name_copy);
+    }
+    else if (map_has(classes, name)) {
+        list_add(class_names, name);
+
+        List *func_name_copy = copy_list(func_names);
+        const GlassClass *gclass = map_get(classes, name);
+
+        for (size_t i = 0; i < list_len(func_name_copy); i++) {
+            const String *func_name = list_get(func_name_copy, i);
+
+            const GlassFunction *func = class_find_func(gclass, func_name);
+            if (func != NULL) {
+                count_names_in_func(classes, name_counts, class_names, func_names, func);
+            }
+        }
+
+        for (size_t i = 0; i < class_num_parents(gclass); i++) {
+            const String *parent_name = class_get_parent(gclass, i);
+            add_name(classes, name_counts, class_names, func_names, parent_name);
+        }
+
+        free_list(func_name_copy);
+    }
+}
+
+Map *get_reachable_names(const Map *classes) {
+    Map *name_counts = new_map(STRING_HASH_OPS, INT_COPY_OPS);
+    List *class_names = new_list(STRING_COPY_OPS);
+    List *func_names = new_list(STRING_COPY_OPS);
+
+    String *main_class_name = string_from_char('M');
+    String *main_func_name = string_from_char('m');
+    String *ctor_name = string_from_chars("c__");
+
+    add_name(classes, name_counts, class_names, func_names, ctor_name);
+    add_name(classes, name_counts, class_names, func_names, main_func_name);
+    add_name(classes, name_counts, class_names, func_names, main_class_name);
+
+    free_string(main_class_name);
+    free_string(main_func_name);
+    free_string(ctor_name);
+    free_list(class_names);
+    free_list(func_names);
+
+    return name_counts;
+}
+
+void prune_unreachable(GlassProgram *program) {
+    Map *names = get_reachable_names(program_get_classes(program));
+    program_retain_names(program, names);
+    free_map(names);
+}
@@ -0,0 +1,61 @@
+#include "analysis/escape.h"
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "test/test-program.h"
+#include "test/test.h"
+#include "utils/map.h"
+#include "utils/set.h"
+#include "utils/string.h"
+
+bool set_has_chars(const Set *set, const char *chars) {
+    String *str = string_from_chars(chars);
+    bool has = set_has(set, str);
+    free_string(str);
+    return has;
+}
+
+int main() {
+    GlassProgram *program = parse_test_program(
+        "{M[m(_a)A!(_a)a.?(_b)B!(_b)f.?(_c)C!(_c)*,(_d)A!(_d)a.,(_k)K!(_e)A!(_e)C!(_e)c.?]}"
+        "{B[f(_s)$]}"
+        "{C[c]}"
+        "{K[(c__)(_s)$]}",
+        true
+    );
+    if (ASSERT_NOT_NULL(program)) {
+        const Map *classes = program_get_classes(program);
+        Set *escaped = get_escaped_locals(classes);
+
+        // $ names a local with something other than a new instance
+        ASSERT_TRUE(set_has_chars(escaped, "_c"));
+        ASSERT_TRUE(set_has_chars(escaped, "_s"));
+        ASSERT_FALSE(set_has_chars(escaped, "_a"));
+
+        String *class_name = string_from_char('M');
+        String *func_name = string_from_char('m');
+        const GlassFunction *func = class_get_func(map_get(classes, class_name), func_name);
+        Set *scoped = get_scoped_locals(classes, func, escaped);
+
+        ASSERT_TRUE(set_has_chars(scoped, "_a"));
+        ASSERT_TRUE(set_has_chars(scoped, "_e"));
+
+        // B.f could keep its instance
+        ASSERT_FALSE(set_has_chars(scoped, "_b"));
+        ASSERT_FALSE(set_has_chars(scoped, "_c"));
+
+        // The function stays on the stack with its instance
+        ASSERT_FALSE(set_has_chars(scoped, "_d"));
+
+        // So could a constructor
+        ASSERT_FALSE(set_has_chars(scoped, "_k"));
+
+        free_set(scoped);
+        free_string(class_name);
+        free_string(func_name);
+        free_set(escaped);
+        free_glass_program(program);
+    }
+
+    return test_status();
+}
@@ -0,0 +1,83 @@
+#include "analysis/purity.h"
+#include "glasstypes/glass-program.h"
+#include "test/test-program.h"
+#include "test/test.h"
+#include "utils/string.h"
+
+#include <stddef.h>
+
+const PureFunc *get_func(const PureFuncs *pure, const char *class_chars, const char *func_chars) {
+    String *class_name = string_from_chars(class_chars);
+    String *func_name = string_from_chars(func_chars);
+    const PureFunc *func = get_pure_func(pure, class_name, func_name);
+    free_string(class_name);
+    free_string(func_name);
+    return func;
+}
+
+bool has_effect(const PureFuncs *pure, const char *class_chars, const char *func_chars,
+                size_t num_args, size_t num_results)
+{
+    const PureFunc *func = get_func(pure, class_chars, func_chars);
+    return func != NULL && func->num_args == num_args && func->num_results == num_results;
+}
+
+int main() {
+    GlassProgram *program = parse_test_program(
+        "{F[f(_f)$(_a)A!(_n)1=,(_cmp)(_n)*<1>(_a)(le).?=/(_cmp)<1>^\\"
+        "(_n)*<1>(_a)s.?(_f)f.?(_n)*<2>(_a)s.?(_f)f.?(_a)a.?]}"
+        "{M[m(_f)F!(_o)O!<10>(_f)f.?(_o)(on).?]}",
+        true
+    );
+    if (ASSERT_NOT_NULL(program)) {
+        PureFuncs *pure = find_pure_funcs(program_get_classes(program));
+
+        // Recursion is followed once the base case is known
+        ASSERT_TRUE(has_effect(pure, "F", "f", 1, 1));
+        ASSERT_TRUE(has_effect(pure, "A", "a", 2, 1));
+        ASSERT_TRUE(has_effect(pure, "S", "d", 2, 2));
+        ASSERT_NULL(get_func(pure, "M", "m"));
+        ASSERT_NULL(get_func(pure, "O", "o"));
+        ASSERT_NULL(get_func(pure, "I", "l"));
+
+        free_pure_funcs(pure);
+        free_glass_program(program);
+    }
+
+    program = parse_test_program(
+        "{C[(field)(v)*][(global)(V)<1>=][(grow)(_c)<1>=/(_c)<1>\\][(two)<1><2>]"
+        "[(loop)(_c)<1>=/(_c)(_c)<0>=\\<3>][(arg)(_x)1=,(_x)f.?][(out)(_s)$(_s)(global).?]}"
+        "{P[(f)<1>][(g)(_s)$(_s)f.?]}"
+        "{Q P[(f)(_o)O!\"x\"(_o)o.?<1>]}"
+        "{N[(c__)(v)<1>=][(make)(_n)N!<1>]}"
+        "{M[m]}",
+        true
+    );
+    if (ASSERT_NOT_NULL(program)) {
+        PureFuncs *pure = find_pure_funcs(program_get_classes(program));
+
+        ASSERT_NULL(get_func(pure, "C", "field"));
+        ASSERT_NULL(get_func(pure, "C", "global"));
+        ASSERT_NULL(get_func(pure, "C", "out"));
+        ASSERT_TRUE(has_effect(pure, "C", "two", 0, 2));
+        ASSERT_TRUE(has_effect(pure, "C", "loop", 0, 1));
+
+        // The stack would be a different size after each pass
+        ASSERT_NULL(get_func(pure, "C", "grow"));
+
+        // Arguments could be instances of anything
+        ASSERT_NULL(get_func(pure, "C", "arg"));
+
+        // Functions called through $ depend on the instance's class
+        ASSERT_TRUE(has_effect(pure, "P", "g", 0, 1));
+        ASSERT_NULL(get_func(pure, "Q", "g"));
+
+        // Constructors run when creating instances
+        ASSERT_NULL(get_func(pure, "N", "make"));
+
+        free_pure_funcs(pure);
+        free_glass_program(program);
+    }
+
+    return test_status();
+}
@@ -0,0 +1,142 @@
+#include "analysis/reachability.h"
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "glasstypes/glass-source.h"
+#include "parser/parser.h"
+#include "test/test-program.h"
+#include "test/test.h"
+#include "utils/list.h"
+#include "utils/map.h"
+#include "utils/string.h"
+
+#include <stdio.h>
+
+GlassProgram *get_lazy_program(const char *chars) {
+    const char *name = "reachability-test.tmp";
+    FILE *fp = fopen(name, "w");
+    fputs(chars, fp);
+    fclose(fp);
+
+    List *filenames = new_list(STRING_COPY_OPS);
+    String *filename = string_from_chars(name);
+    list_add(filenames, filename);
+
+    GlassProgram *program = classes_from_files(filenames, false, true, true);
+
+    remove(name);
+    free_string(filename);
+    free_list(filenames);
+
+    return program;
+}
+
+bool has_name(const Map *names, const char *chars) {
+    String *name = string_from_chars(chars);
+    bool has = map_has(names, name);
+    free_string(name);
+    return has;
+}
+
+bool func_is_parsed(const Map *classes, const char *class_chars, const char *func_chars) {
+    String *class_name = string_from_chars(class_chars);
+    String *func_name = string_from_chars(func_chars);
+    const GlassFunction *func = class_find_func(map_get(classes, class_name), func_name);
+    bool parsed = func_get_body_pos(func) == NO_SOURCE_POS;
+    free_string(class_name);
+    free_string(func_name);
+    return parsed;
+}
+
+bool class_has(const Map *classes, const char *class_chars, const char *func_chars) {
+    String *class_name = string_from_chars(class_chars);
+    const GlassClass *gclass = map_get(classes, class_name);
+    bool has = gclass != NULL;
+
+    if (has && func_chars != NULL) {
+        String *func_name = string_from_chars(func_chars);
+        has = class_has_func(gclass, func_name);
+        free_string(func_name);
+    }
+
+    free_string(class_name);
+    return has;
+}
+
+int main() {
+    GlassProgram *program = parse_test_program(
+        "{M[m(_a)A!(_a)(go).?]}"
+        "{A B[(go)(_c)C!(_c)(c__)*][(unused)(_u)U!]}"
+        "{B[(c__)(_o)O!][b]}"
+        "{C[(c__)][(go)]}"
+        "{U[(c__)]}",
+        false
+    );
+
+    if (ASSERT_NOT_NULL(program)) {
+        Map *names = get_reachable_names(program_get_classes(program));
+        ASSERT_TRUE(has_name(names, "M"));
+        ASSERT_TRUE(has_name(names, "A"));
+        ASSERT_TRUE(has_name(names, "C"));
+        ASSERT_TRUE(has_name(names, "O"));
+        ASSERT_FALSE(has_name(names, "U"));
+        ASSERT_FALSE(has_name(names, "unused"));
+        ASSERT_FALSE(has_name(names, "b"));
+        free_map(names);
+
+        prune_unreachable(program);
+
+        const Map *classes = program_get_classes(program);
+        ASSERT_TRUE(class_has(classes, "M", "m"));
+        ASSERT_TRUE(class_has(classes, "A", "go"));
+        ASSERT_TRUE(class_has(classes, "A", "c__"));
+        ASSERT_FALSE(class_has(classes, "A", "unused"));
+        ASSERT_FALSE(class_has(classes, "A", "b"));
+        ASSERT_TRUE(class_has(classes, "C", "c__"));
+        ASSERT_FALSE(class_has(classes, "U", NULL));
+
+        free_glass_program(program);
+    }
+
+    // Bodies that haven't been parsed are only scanned for names, so a body
+    // that's never called isn't parsed, and its errors go unreported
+    program = get_lazy_program(
+        "{M[m(_a)A!(_a)(go).?]}"
+        "{A[(go)(_c)C!'(_u)U!'][(bad)(_o)O! & ][(unused)(_u)U!]}"
+        "{C[(c__)\"(_u)U!\"(bad)]}"
+        "{O[o]}"
+        "{U[(c__)]}"
+    );
+
+    if (ASSERT_NOT_NULL(program)) {
+        Map *names = get_reachable_names(program_get_classes(program));
+        ASSERT_TRUE(has_name(names, "C"));
+        ASSERT_TRUE(has_name(names, "bad"));
+        ASSERT_TRUE(has_name(names, "O"));
+        ASSERT_FALSE(has_name(names, "U"));
+        ASSERT_FALSE(has_name(names, "unused"));
+        free_map(names);
+
+        prune_unreachable(program);
+
+        const Map *classes = program_get_classes(program);
+        ASSERT_TRUE(class_has(classes, "A", "bad"));
+        ASSERT_FALSE(class_has(classes, "A", "unused"));
+        ASSERT_FALSE(class_has(classes, "U", NULL));
+        ASSERT_FALSE(func_is_parsed(classes, "M", "m"));
+        ASSERT_FALSE(func_is_parsed(classes, "A", "bad"));
+
+        free_glass_program(program);
+    }
+    free_sources();
+
+    // Without a main class, nothing can run
+    program = parse_test_program("{A[a]}", false);
+    if (ASSERT_NOT_NULL(program)) {
+        prune_unreachable(program);
+        ASSERT_EQUAL(map_size(program_get_classes(program)), 0);
+        free_glass_program(program);
+    }
+
+    return test_status();
+}
@@ -1,50 +1,111 @@
 #ifndef GLASSTYPES_GLASS_BUILDERS_H
 #define GLASSTYPES_GLASS_BUILDERS_H
 
+#include "glasstypes/glass-function.h"
+#include "glasstypes/glass-source.h"
+
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct GlassClassBuilder GlassClassBuilder;
 typedef struct GlassFuncBuilder GlassFuncBuilder;
 typedef struct GlassProgramBuilder GlassProgramBuilder;
-struct CopyInterface;
+typedef struct LazySource LazySource;
+struct Arena;
 struct GlassClass;
 struct GlassCommand;
 struct GlassFunction;
+struct GlassProgram;
 struct Map;
+struct Stream;
 struct String;
 
-extern const struct CopyInterface *CLASS_BUILDER_COPY_OPS;
+// Parses the body of a function, from the given offset in the stream up to
+// and including the closing ']', adding its commands to the builder. Returns
+// true if the body is invalid, after reporting why
+typedef bool (*FuncBodyParser)(GlassFuncBuilder *builder, struct Stream *stream, SourcePos base, size_t offset);
+
+// Visits the names in a function body, from the given offset in the stream up
+// to the closing ']', without building its commands or reporting errors
+typedef void (*FuncBodyScanner)(struct Stream *stream, size_t offset, FuncNameVisitor visit, void *data);
+
+// How the bodies of lazily built functions get parsed, and scanned for names
+// before then
+typedef struct LazyParser {
+    FuncBodyParser parse;
+
+    FuncBodyScanner scan;
+} LazyParser;
 
-GlassClassBuilder *new_class_builder(const struct String *name,
-                                     const struct String *filename,
-                                     unsigned line, unsigned col);
+// Class and function builders allocate everything that ends up in the built
+// program from the arena of the program builder they're used with
+GlassClassBuilder *new_class_builder(struct Arena *arena, const struct String *name, SourcePos pos);
 
-GlassFuncBuilder *new_func_builder(const struct String *name,
-                                   const struct String *filename,
-                                   unsigned line, unsigned col);
+GlassFuncBuilder *new_func_builder(struct Arena *arena, const struct String *name, SourcePos pos);
 
 GlassProgramBuilder *new_program_builder(void);
 
+// Takes ownership of the stream. Lazy sources are normally created through
+// builder_add_lazy_source, which ties them to a program
+LazySource *new_lazy_source(struct Stream *stream, SourcePos base, const LazyParser *parser);
+
 void free_class_builder(GlassClassBuilder *builder);
 
 void free_func_builder(GlassFuncBuilder *builder);
 
 void free_program_builder(GlassProgramBuilder *builder);
 
-struct GlassClass *build_glass_class(const GlassClassBuilder *builder);
+void free_lazy_source(LazySource *source);
+
+// Returns the arena that the program's classes and functions are built in
+struct Arena *builder_get_arena(GlassProgramBuilder *builder);
+
+struct GlassClass *build_glass_class(const GlassClassBuilder *builder, struct Arena *arena);
 
 struct GlassFunction *build_glass_function(const GlassFuncBuilder *builder);
 
-struct Map *build_glass_program(const GlassProgramBuilder *builder, bool handle_inheritance);
+// Builds a function with no commands yet. Its body is parsed from the source,
+// starting at the given offset, the first time class_get_func returns it
+struct GlassFunction *build_lazy_function(const GlassFuncBuilder *builder, LazySource *source, size_t offset);
+
+// Parses the body of a lazily built function if that hasn't happened yet.
+// Returns true if the body is invalid
+bool func_parse_body(const struct GlassFunction *func);
 
-void builder_add_class(GlassProgramBuilder *builder, const GlassClassBuilder *free_class_builder);
+// Replaces the commands of a built function whose body has been parsed. There
+// can't be more new commands than old ones, since they're copied over them
+void func_replace_commands(struct GlassFunction *func, const struct GlassCommand *cmds, size_t len);
+
+// Interns the function's name and every name its commands push. A body that
+// hasn't been parsed yet has its names interned once it is
+void func_intern_names(struct GlassFunction *func);
+
+// Builds the program, which takes over the builder's arena. The builder's
+// classes are used up, so it should only be freed afterwards
+struct GlassProgram *build_glass_program(GlassProgramBuilder *builder, bool handle_inheritance);
+
+// Adds a class to the program, which takes ownership of the class builder
+void builder_add_class(GlassProgramBuilder *builder, GlassClassBuilder *class_builder);
+
+// Moves all of the classes in src to the end of dest, leaving src empty
+void builder_merge(GlassProgramBuilder *dest, GlassProgramBuilder *src);
+
+// Adds a source that function bodies can be lazily parsed from. The program
+// takes ownership of the stream, and keeps it open for as long as it exists
+LazySource *builder_add_lazy_source(GlassProgramBuilder *builder, struct Stream *stream, SourcePos base, const LazyParser *parser);
 
 void builder_add_func(GlassClassBuilder *builder, const struct GlassFunction *func);
 
+// Drops every function of a built class whose name isn't a key in names
+void class_retain_funcs(struct GlassClass *gclass, const struct Map *names);
+
 void builder_add_parent(GlassClassBuilder *builder, const struct String *name);
 
 bool builder_add_command(GlassFuncBuilder *builder, const struct GlassCommand *cmd);
 
+// Returns whether a loop has been started that hasn't been ended yet
+bool builder_in_loop(const GlassFuncBuilder *builder);
+
 void add_builtin_classes(GlassProgramBuilder *prog_builder);
 
 #endif
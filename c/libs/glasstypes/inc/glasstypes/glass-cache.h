@@ -0,0 +1,44 @@
+#ifndef GLASSTYPES_GLASS_CACHE_H
+#define GLASSTYPES_GLASS_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct GlassProgram;
+struct LazyParser;
+struct List;
+struct String;
+
+// Precompiled programs are stored in .glassc files, which hold every class
+// of a fully built program along with the registered source files, so that
+// the program can be loaded again without reading or parsing any sources.
+//
+// The file is a header followed by sections of fixed-size records, which
+// refer to each other and to the string pool by index. Every section starts
+// on an 8-byte boundary so the records can be read straight from the file.
+// The strings and commands are still copied out into the built program,
+// since it owns them and outlives the file.
+
+// Bump this whenever the format, or anything that ends up in a built
+// program such as the builtin classes, changes
+#define GLASSC_VERSION 3
+
+// Hashes the names and contents of the given source files, along with the
+// format version, to get the key a cached program is stored under. Returns
+// true if any of the files couldn't be read
+bool hash_source_files(struct List *filenames, uint64_t *key);
+
+// Writes the program, and every currently registered source file, to a cache
+// file at the given path. Bodies that haven't been parsed are stored as where
+// they are in the sources. Returns true if the file couldn't be written
+bool write_program_cache(struct String *path, const struct GlassProgram *program, uint64_t key);
+
+// Reads the program from a cache file, registering its source files. This has
+// to be done before any other source files are registered. Functions whose
+// bodies were never parsed are read back as lazy ones that lazy_parser parses
+// from the sources, which fails the read if lazy_parser is NULL. Returns NULL
+// if the file doesn't exist, is invalid, or has a different key
+struct GlassProgram *read_program_cache(struct String *path, uint64_t key,
+                                        const struct LazyParser *lazy_parser);
+
+#endif
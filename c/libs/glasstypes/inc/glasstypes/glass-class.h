@@ -1,32 +1,42 @@
 #ifndef GLASSTYPES_GLASS_CLASS_H
 #define GLASSTYPES_GLASS_CLASS_H
 
+#include "glasstypes/glass-source.h"
+
 #include <stdbool.h>
+#include <stddef.h>
 
+// Classes are allocated in the arena of the program they belong to, and are
+// freed along with it
 typedef struct GlassClass GlassClass;
-struct CopyInterface;
 struct GlassFunction;
 struct List;
 struct Map;
 struct String;
 
-extern const struct CopyInterface *CLASS_COPY_OPS;
-
 struct Map *get_builtin_classes(void);
 
-GlassClass *copy_glass_class(const GlassClass *gclass);
+const struct String *class_get_name(const GlassClass *gclass);
 
-void free_glass_class(GlassClass *gclass);
+SourcePos class_get_pos(const GlassClass *gclass);
 
-const struct String *class_get_name(const GlassClass *gclass);
+size_t class_num_parents(const GlassClass *gclass);
 
-const struct List *class_get_parents(const GlassClass *gclass);
+const struct String *class_get_parent(const GlassClass *gclass, size_t index);
 
 bool class_has_func(const GlassClass *gclass, const struct String *name);
 
+// Returns the function, parsing its body first if it was lazily built. Returns
+// NULL if the class has no such function, or if its body turned out to be
+// invalid
 const struct GlassFunction *class_get_func(const GlassClass *gclass,
                                            const struct String *name);
 
+// Returns the function without parsing its body, so func_parse_body has to be
+// called before using its commands. Returns NULL if there's no such function
+const struct GlassFunction *class_find_func(const GlassClass *gclass,
+                                            const struct String *name);
+
 struct List *class_get_func_names(const GlassClass *gclass);
 
 #endif
@@ -1,9 +1,11 @@
 #ifndef GLASSTYPES_GLASS_COMMAND_H
 #define GLASSTYPES_GLASS_COMMAND_H
 
+#include "glasstypes/glass-source.h"
+
+#include <stdbool.h>
 #include <stddef.h>
 
-struct CopyInterface;
 struct String;
 
 typedef enum CommandType {
@@ -38,6 +40,12 @@ typedef enum BuiltinFunc {
     BUILTIN_INPUT_LINE,            // I.l
     BUILTIN_INPUT_LINE_FROM_FILE,  // I.lf
 
+    BUILTIN_LIST_GET,              // L.g
+    BUILTIN_LIST_LENGTH,           // L.l
+    BUILTIN_LIST_POP,              // L.po
+    BUILTIN_LIST_PUSH,             // L.p
+    BUILTIN_LIST_SET,              // L.s
+
     BUILTIN_MATH_ADD,              // A.a
     BUILTIN_MATH_DIVIDE,           // A.d
     BUILTIN_MATH_EQUAL,            // A.e
@@ -72,19 +80,20 @@ typedef enum BuiltinFunc {
     BUILTIN_VAR_NEW,               // V.n
 } BuiltinFunc;
 
+#define NUM_BUILTIN_FUNCS (BUILTIN_VAR_NEW + 1)
+
 typedef struct GlassCommand {
     CommandType type;
 
-    struct String *filename;
-
-    unsigned line;
-
-    unsigned col;
+    SourcePos pos;
 
     union {
         struct {
             struct String *str;
 
+            // The matching loop command for loops, the stack index for
+            // duplicates, and the interned symbol of a pushed name once its
+            // program has been built
             size_t index;
         };
 
@@ -98,6 +107,8 @@ struct String *command_to_str(const GlassCommand *cmd);
 
 struct String *builtin_func_name(BuiltinFunc func);
 
-extern const struct CopyInterface *CMD_COPY_OPS;
+// Returns whether the builtin works on the instance it's called on, like the
+// elements of an L instance. These can't be run inline by their callers
+bool builtin_uses_instance(BuiltinFunc func);
 
 #endif
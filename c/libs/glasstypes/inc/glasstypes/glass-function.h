@@ -1,29 +1,36 @@
 #ifndef GLASSTYPES_GLASS_FUNCTION_H
 #define GLASSTYPES_GLASS_FUNCTION_H
 
+#include "glasstypes/glass-source.h"
+
+#include <stdbool.h>
 #include <stddef.h>
 
+// Functions are allocated in the arena of the program they belong to, and
+// are freed along with it
 typedef struct GlassFunction GlassFunction;
-struct CopyInterface;
 struct GlassCommand;
 struct String;
 
-extern const struct CopyInterface *FUNC_COPY_OPS;
-
-GlassFunction *copy_glass_func(const GlassFunction *func);
-
-void free_glass_func(GlassFunction *func);
-
 const struct String *func_get_name(const GlassFunction *func);
 
 const struct GlassCommand *func_get_command(const GlassFunction *func, size_t index);
 
-const struct String *func_get_filename(const GlassFunction *func);
+SourcePos func_get_pos(const GlassFunction *func);
 
-unsigned func_get_line(const GlassFunction *func);
+size_t func_len(const GlassFunction *func);
 
-unsigned func_get_col(const GlassFunction *func);
+// Called for each command of a function body in order, with the name that it
+// pushes or loops on, or NULL if it doesn't use a name
+typedef void (*FuncNameVisitor)(const struct String *name, bool is_loop, void *data);
 
-size_t func_len(const GlassFunction *func);
+// Visits the names in the function's body, scanning the source for them if
+// the body hasn't been parsed yet rather than parsing it. A body that's known
+// to be invalid has no names
+void func_visit_names(const GlassFunction *func, FuncNameVisitor visit, void *data);
+
+// Returns where the function's body starts in the source if the body hasn't
+// been parsed yet, or turned out to be invalid, and NO_SOURCE_POS otherwise
+SourcePos func_get_body_pos(const GlassFunction *func);
 
 #endif
@@ -0,0 +1,18 @@
+#ifndef GLASSTYPES_GLASS_PROGRAM_H
+#define GLASSTYPES_GLASS_PROGRAM_H
+
+// A fully built program. All of its classes, functions and commands live in
+// a single arena owned by the program, and are freed along with it
+typedef struct GlassProgram GlassProgram;
+struct Map;
+
+void free_glass_program(GlassProgram *program);
+
+// Returns a map from each class name to its GlassClass
+const struct Map *program_get_classes(const GlassProgram *program);
+
+// Drops every class, and every function of the classes left, whose name isn't
+// a key in names
+void program_retain_names(GlassProgram *program, const struct Map *names);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef GLASSTYPES_GLASS_SOURCE_H
+#define GLASSTYPES_GLASS_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Stream;
+struct String;
+
+// A position in any registered source file. Every registered file gets its
+// own range of positions, so a single 32-bit value identifies both the file
+// and the offset within it
+typedef uint32_t SourcePos;
+
+// The position of anything that doesn't come from a source file, like the
+// builtin classes
+#define NO_SOURCE_POS 0
+
+// Registers the stream's contents as a source file, returning the position
+// of its first char. The position of any other char is found by adding its
+// offset in the stream. Returns NO_SOURCE_POS without registering anything
+// if the registered files would no longer fit in a SourcePos
+SourcePos register_source(const struct Stream *stream);
+
+// Registers a source file from its already-computed line starts, such as
+// ones read back from a program cache. Files registered in the same order
+// with the same lengths get the same positions they had originally. Fails
+// the same way as register_source
+SourcePos register_source_lines(const struct String *name, size_t len,
+                                const size_t *line_starts, size_t num_lines);
+
+// Returns how many source files have been registered
+size_t num_sources(void);
+
+// Gets the details of the source file with the given index, in the order the
+// files were registered
+void source_get_info(size_t index, const struct String **name, size_t *len,
+                     const size_t **line_starts, size_t *num_lines);
+
+// Finds the file name, line and column that a source position refers to
+void source_pos_lookup(SourcePos pos, const struct String **filename,
+                       unsigned *line, unsigned *col);
+
+// Frees every registered source file
+void free_sources(void);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef GLASSTYPES_GLASS_SYMBOL_H
+#define GLASSTYPES_GLASS_SYMBOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct String;
+
+// A name interned into a dense id. Building a program interns the names of
+// its classes and functions, along with every name its commands push, so
+// they can be looked up by indexing arrays rather than hashing strings
+typedef uint32_t Symbol;
+
+// The symbol of any name that was never interned
+#define NO_SYMBOL UINT32_MAX
+
+// Returns the name's symbol, interning it if it hasn't been yet
+Symbol intern_symbol(const struct String *name);
+
+// Returns the name's symbol, or NO_SYMBOL if it was never interned
+Symbol lookup_symbol(const struct String *name);
+
+const struct String *symbol_name(Symbol sym);
+
+// Returns how many names have been interned. Every symbol is below this
+size_t num_symbols(void);
+
+// Frees every interned name
+void free_symbols(void);
+
+#endif
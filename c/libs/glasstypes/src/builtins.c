@@ -2,10 +2,11 @@
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-command.h"
 #include "glasstypes/glass-function.h"
+#include "utils/arena.h"
 #include "utils/map.h"
 #include "utils/string.h"
 
-#define NUM_BUILTIN_CLASSES  5
+#define NUM_BUILTIN_CLASSES  6
 #define MAX_BUILTIN_FUNCS   15
 
 typedef struct BuiltinFuncInfo {
@@ -48,6 +49,13 @@ const BuiltinInfo BUILTIN_CLASS_INFO[NUM_BUILTIN_CLASSES] = {
         {"l",  BUILTIN_INPUT_LINE},
         {"lf", BUILTIN_INPUT_LINE_FROM_FILE}},
     },
+    {"L", {
+        {"g",  BUILTIN_LIST_GET},
+        {"l",  BUILTIN_LIST_LENGTH},
+        {"p",  BUILTIN_LIST_PUSH},
+        {"po", BUILTIN_LIST_POP},
+        {"s",  BUILTIN_LIST_SET}},
+    },
     {"O", {
         {"f",   BUILTIN_OUTPUT_OPEN_FILE},
         {"fc",  BUILTIN_OUTPUT_CLOSE_FILE},
@@ -74,13 +82,13 @@ const BuiltinInfo BUILTIN_CLASS_INFO[NUM_BUILTIN_CLASSES] = {
 };
 
 void add_builtin_classes(GlassProgramBuilder *prog_builder) {
-    String *builtin_name = string_from_chars("<builtin>");
+    Arena *arena = builder_get_arena(prog_builder);
 
     for (size_t i = 0; i < NUM_BUILTIN_CLASSES; i++) {
         BuiltinInfo builtin_class = BUILTIN_CLASS_INFO[i];
 
         String *class_name = string_from_chars(builtin_class.class_name);
-        GlassClassBuilder *class_builder = new_class_builder(class_name, builtin_name, 0, 0);
+        GlassClassBuilder *class_builder = new_class_builder(arena, class_name, NO_SOURCE_POS);
         free_string(class_name);
 
         for (size_t j = 0; j < MAX_BUILTIN_FUNCS; j++) {
@@ -91,27 +99,21 @@ void add_builtin_classes(GlassProgramBuilder *prog_builder) {
             }
 
             String *func_name = string_from_chars(func_info.func_name);
-            GlassFuncBuilder *func_builder = new_func_builder(func_name, builtin_name, 0, 0);
+            GlassFuncBuilder *func_builder = new_func_builder(arena, func_name, NO_SOURCE_POS);
 
             GlassCommand cmd = {
                 .type = CMD_BUILTIN,
-                .filename = builtin_name,
-                .line = 0, .col = 0,
+                .pos = NO_SOURCE_POS,
                 .builtin = func_info.builtin_func,
             };
 
             builder_add_command(func_builder, &cmd);
-            GlassFunction *func = build_glass_function(func_builder);
-            builder_add_func(class_builder, func);
+            builder_add_func(class_builder, build_glass_function(func_builder));
 
-            free_glass_func(func);
             free_func_builder(func_builder);
             free_string(func_name);            
         }
 
         builder_add_class(prog_builder, class_builder);
-        free_class_builder(class_builder);
     }
-
-    free_string(builtin_name);
 }
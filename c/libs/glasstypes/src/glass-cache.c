@@ -0,0 +1,738 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "glasstypes/glass-cache.h"
+#include "glasstypes/glass-builders.h"
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-command.h"
+#include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "glasstypes/glass-source.h"
+#include "utils/arena.h"
+#include "utils/copy-interface.h"
+#include "utils/hash-interface.h"
+#include "utils/list.h"
+#include "utils/map.h"
+#include "utils/stream.h"
+#include "utils/string.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GLASSC_MAGIC 0x43534c47 // "GLSC" when read as little-endian
+
+#define NO_STRING UINT32_MAX
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct CacheHeader {
+    uint32_t magic;
+
+    uint32_t version;
+
+    uint64_t key;
+
+    uint32_t num_strings;
+
+    uint32_t num_sources;
+
+    uint32_t num_lines;
+
+    uint32_t num_classes;
+
+    uint32_t num_parents;
+
+    uint32_t num_funcs;
+
+    uint32_t num_cmds;
+
+    uint32_t string_bytes;
+} CacheHeader;
+
+typedef struct CacheString {
+    uint32_t offset;
+
+    uint32_t len;
+} CacheString;
+
+typedef struct CacheSource {
+    uint32_t name;
+
+    uint32_t len;
+
+    uint32_t first_line;
+
+    uint32_t num_lines;
+} CacheSource;
+
+typedef struct CacheClass {
+    uint32_t name;
+
+    uint32_t pos;
+
+    uint32_t first_parent;
+
+    uint32_t num_parents;
+
+    uint32_t first_func;
+
+    uint32_t num_funcs;
+} CacheClass;
+
+typedef struct CacheFunc {
+    uint32_t name;
+
+    uint32_t pos;
+
+    uint32_t first_cmd;
+
+    uint32_t num_cmds;
+
+    // Where the body starts in its source if it was never parsed, in which
+    // case the function has no commands and is read back as a lazy one
+    uint32_t body_pos;
+} CacheFunc;
+
+typedef struct CacheCommand {
+    uint32_t type;
+
+    uint32_t pos;
+
+    uint32_t str;
+
+    // The loop/duplicate index, or the builtin function
+    uint32_t index;
+
+    double number;
+} CacheCommand;
+
+// A growable buffer that one section of the file is built up in
+typedef struct Section {
+    char *data;
+
+    size_t len;
+
+    size_t alloc;
+} Section;
+
+typedef struct CacheWriter {
+    Map *string_ids;
+
+    Section strings;
+
+    Section string_bytes;
+
+    Section sources;
+
+    Section lines;
+
+    Section classes;
+
+    Section parents;
+
+    Section funcs;
+
+    Section cmds;
+} CacheWriter;
+
+static uint64_t fnv_hash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+bool hash_source_files(List *filenames, uint64_t *key) {
+    uint64_t hash = fnv_hash(FNV_OFFSET, &(uint32_t) { GLASSC_VERSION }, sizeof(uint32_t));
+
+    for (size_t i = 0; i < list_len(filenames); i++) {
+        const String *filename = list_get(filenames, i);
+        Stream *stream = stream_from_path(filename);
+        if (stream == NULL) {
+            return true;
+        }
+
+        size_t len;
+        const char *chars = stream_peek(stream, &len);
+        uint64_t sizes[2] = { string_len(filename), len };
+
+        hash = fnv_hash(hash, sizes, sizeof(sizes));
+        hash = fnv_hash(hash, string_data(filename), string_len(filename));
+        hash = fnv_hash(hash, chars, len);
+
+        free_stream(stream);
+    }
+
+    *key = hash;
+    return false;
+}
+
+static void section_add(Section *section, const void *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    if (section->len + len > section->alloc) {
+        do {
+            section->alloc = section->alloc == 0 ? 256 : section->alloc * 2;
+        } while (section->len + len > section->alloc);
+
+        section->data = realloc(section->data, section->alloc);
+    }
+
+    memcpy(section->data + section->len, data, len);
+    section->len += len;
+}
+
+static size_t padded_len(size_t len) {
+    return (len + 7) & ~(size_t) 7;
+}
+
+static bool write_section(FILE *fp, const Section *section) {
+    static const char padding[8] = {0};
+    size_t pad = padded_len(section->len) - section->len;
+
+    return (section->len > 0 && fwrite(section->data, section->len, 1, fp) != 1)
+        || (pad > 0 && fwrite(padding, pad, 1, fp) != 1);
+}
+
+static uint32_t intern_string(CacheWriter *writer, const String *str) {
+    const size_t *id = map_get(writer->string_ids, str);
+    if (id != NULL) {
+        return *id;
+    }
+
+    size_t new_id = writer->strings.len / sizeof(CacheString);
+    CacheString rec = {
+        .offset = writer->string_bytes.len,
+        .len = string_len(str),
+    };
+
+    section_add(&writer->strings, &rec, sizeof(rec));
+    section_add(&writer->string_bytes, string_data(str), string_len(str));
+    map_set(writer->string_ids, str, &new_id);
+
+    return new_id;
+}
+
+static void write_command(CacheWriter *writer, const GlassCommand *cmd) {
+    CacheCommand rec = {
+        .type = cmd->type,
+        .pos = cmd->pos,
+        .str = NO_STRING,
+        .index = 0,
+        .number = 0,
+    };
+
+    switch (cmd->type) {
+        case CMD_DUPLICATE:
+            rec.index = cmd->index;
+            break;
+
+        case CMD_PUSH_NAME:
+        case CMD_PUSH_STR:
+            rec.str = intern_string(writer, cmd->str);
+            break;
+
+        case CMD_LOOP_BEGIN:
+        case CMD_LOOP_END:
+            rec.str = intern_string(writer, cmd->str);
+            rec.index = cmd->index;
+            break;
+
+        case CMD_PUSH_NUM:
+            rec.number = cmd->number;
+            break;
+
+        case CMD_BUILTIN:
+            rec.index = cmd->builtin;
+            break;
+
+        default:
+            break;
+    }
+
+    section_add(&writer->cmds, &rec, sizeof(rec));
+}
+
+static void write_function(CacheWriter *writer, const GlassFunction *func) {
+    CacheFunc rec = {
+        .name = intern_string(writer, func_get_name(func)),
+        .pos = func_get_pos(func),
+        .first_cmd = writer->cmds.len / sizeof(CacheCommand),
+        .num_cmds = 0,
+        .body_pos = func_get_body_pos(func),
+    };
+
+    if (rec.body_pos == NO_SOURCE_POS) {
+        rec.num_cmds = func_len(func);
+        for (size_t i = 0; i < func_len(func); i++) {
+            write_command(writer, func_get_command(func, i));
+        }
+    }
+
+    section_add(&writer->funcs, &rec, sizeof(rec));
+}
+
+static void write_class(CacheWriter *writer, const GlassClass *gclass) {
+    List *func_names = class_get_func_names(gclass);
+
+    CacheClass rec = {
+        .name = intern_string(writer, class_get_name(gclass)),
+        .pos = class_get_pos(gclass),
+        .first_parent = writer->parents.len / sizeof(uint32_t),
+        .num_parents = class_num_parents(gclass),
+        .first_func = writer->funcs.len / sizeof(CacheFunc),
+        .num_funcs = list_len(func_names),
+    };
+
+    for (size_t i = 0; i < class_num_parents(gclass); i++) {
+        uint32_t parent = intern_string(writer, class_get_parent(gclass, i));
+        section_add(&writer->parents, &parent, sizeof(parent));
+    }
+
+    for (size_t i = 0; i < list_len(func_names); i++) {
+        write_function(writer, class_find_func(gclass, list_get(func_names, i)));
+    }
+
+    section_add(&writer->classes, &rec, sizeof(rec));
+    free_list(func_names);
+}
+
+static void write_sources(CacheWriter *writer) {
+    for (size_t i = 0; i < num_sources(); i++) {
+        const String *name;
+        size_t len, num_lines;
+        const size_t *line_starts;
+        source_get_info(i, &name, &len, &line_starts, &num_lines);
+
+        CacheSource rec = {
+            .name = intern_string(writer, name),
+            .len = len,
+            .first_line = writer->lines.len / sizeof(uint32_t),
+            .num_lines = num_lines,
+        };
+
+        for (size_t j = 0; j < num_lines; j++) {
+            uint32_t line_start = line_starts[j];
+            section_add(&writer->lines, &line_start, sizeof(line_start));
+        }
+
+        section_add(&writer->sources, &rec, sizeof(rec));
+    }
+}
+
+bool write_program_cache(String *path, const GlassProgram *program, uint64_t key) {
+    const Map *classes = program_get_classes(program);
+    CacheWriter writer = {
+        .string_ids = new_map(STRING_HASH_OPS, SIZE_T_COPY_OPS),
+    };
+
+    write_sources(&writer);
+
+    List *class_names = map_get_keys(classes);
+    for (size_t i = 0; i < list_len(class_names); i++) {
+        write_class(&writer, map_get(classes, list_get(class_names, i)));
+    }
+    free_list(class_names);
+
+    CacheHeader header = {
+        .magic = GLASSC_MAGIC,
+        .version = GLASSC_VERSION,
+        .key = key,
+        .num_strings = writer.strings.len / sizeof(CacheString),
+        .num_sources = writer.sources.len / sizeof(CacheSource),
+        .num_lines = writer.lines.len / sizeof(uint32_t),
+        .num_classes = writer.classes.len / sizeof(CacheClass),
+        .num_parents = writer.parents.len / sizeof(uint32_t),
+        .num_funcs = writer.funcs.len / sizeof(CacheFunc),
+        .num_cmds = writer.cmds.len / sizeof(CacheCommand),
+        .string_bytes = writer.string_bytes.len,
+    };
+
+    const Section *sections[] = {
+        &writer.strings, &writer.sources, &writer.lines, &writer.classes,
+        &writer.parents, &writer.funcs, &writer.cmds, &writer.string_bytes,
+    };
+
+    // Write to a temporary file first, so that other processes never see a
+    // partially written cache
+    String *tmp_path = copy_string(path);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long) getpid());
+    string_add_chars(tmp_path, suffix);
+
+    bool failed = true;
+    FILE *fp = fopen(string_get_c_str(tmp_path), "wb");
+
+    if (fp != NULL) {
+        failed = fwrite(&header, sizeof(header), 1, fp) != 1;
+
+        for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); i++) {
+            failed = failed || write_section(fp, sections[i]);
+        }
+
+        failed = fclose(fp) != 0 || failed;
+        failed = failed || rename(string_get_c_str(tmp_path), string_get_c_str(path)) != 0;
+
+        if (failed) {
+            remove(string_get_c_str(tmp_path));
+        }
+    }
+
+    free_string(tmp_path);
+    free_map(writer.string_ids);
+    for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); i++) {
+        free(sections[i]->data);
+    }
+
+    return failed;
+}
+
+// Pointers to each section of a mapped cache file
+typedef struct CacheReader {
+    const CacheHeader *header;
+
+    const CacheString *strings;
+
+    const CacheSource *sources;
+
+    const uint32_t *lines;
+
+    const CacheClass *classes;
+
+    const uint32_t *parents;
+
+    const CacheFunc *funcs;
+
+    const CacheCommand *cmds;
+
+    const char *string_bytes;
+
+    // Every string in the pool, created once up front
+    String **pool;
+
+    // Parses the bodies of the functions that were cached unparsed, or NULL
+    // if they aren't allowed
+    const LazyParser *lazy_parser;
+
+    // The position of the first char of each source once it's registered
+    SourcePos *bases;
+
+    // The source each lazy function body is read from, opened the first time
+    // one of its bodies is needed
+    LazySource **lazy_sources;
+} CacheReader;
+
+static bool in_bounds(uint32_t first, uint32_t num, uint32_t total) {
+    return first <= total && num <= total - first;
+}
+
+// Sets up the section pointers, returning true if the file is too short
+static bool find_sections(CacheReader *reader, const char *data, size_t len) {
+    const CacheHeader *header = reader->header;
+    size_t offset = sizeof(CacheHeader);
+
+#define NEXT_SECTION(FIELD, COUNT) \
+    reader->FIELD = (const void *) (data + offset); \
+    offset += padded_len((size_t) (COUNT) * sizeof(*reader->FIELD)); \
+    if (offset > len) { \
+        return true; \
+    }
+
+    NEXT_SECTION(strings, header->num_strings);
+    NEXT_SECTION(sources, header->num_sources);
+    NEXT_SECTION(lines, header->num_lines);
+    NEXT_SECTION(classes, header->num_classes);
+    NEXT_SECTION(parents, header->num_parents);
+    NEXT_SECTION(funcs, header->num_funcs);
+    NEXT_SECTION(cmds, header->num_cmds);
+    NEXT_SECTION(string_bytes, header->string_bytes);
+
+#undef NEXT_SECTION
+
+    return false;
+}
+
+static bool valid_string(const CacheReader *reader, uint32_t id) {
+    return id < reader->header->num_strings;
+}
+
+// Checks that every index in the file refers to something inside it, so that
+// a corrupted file is rejected instead of read out of bounds
+static bool validate_cache(const CacheReader *reader) {
+    const CacheHeader *header = reader->header;
+
+    for (uint32_t i = 0; i < header->num_strings; i++) {
+        const CacheString *str = &reader->strings[i];
+        if (!in_bounds(str->offset, str->len, header->string_bytes)) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->num_sources; i++) {
+        const CacheSource *source = &reader->sources[i];
+        if (!valid_string(reader, source->name) || source->num_lines == 0
+            || !in_bounds(source->first_line, source->num_lines, header->num_lines))
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->num_classes; i++) {
+        const CacheClass *gclass = &reader->classes[i];
+        if (!valid_string(reader, gclass->name)
+            || !in_bounds(gclass->first_parent, gclass->num_parents, header->num_parents)
+            || !in_bounds(gclass->first_func, gclass->num_funcs, header->num_funcs))
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->num_parents; i++) {
+        if (!valid_string(reader, reader->parents[i])) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->num_funcs; i++) {
+        const CacheFunc *func = &reader->funcs[i];
+        if (!valid_string(reader, func->name)
+            || !in_bounds(func->first_cmd, func->num_cmds, header->num_cmds)
+            || (func->body_pos != NO_SOURCE_POS && func->num_cmds != 0))
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->num_cmds; i++) {
+        const CacheCommand *cmd = &reader->cmds[i];
+        bool has_str = cmd->type == CMD_PUSH_NAME || cmd->type == CMD_PUSH_STR
+                    || cmd->type == CMD_LOOP_BEGIN || cmd->type == CMD_LOOP_END;
+
+        if (cmd->type > CMD_BUILTIN
+            || (cmd->type == CMD_BUILTIN && cmd->index >= NUM_BUILTIN_FUNCS)
+            || (has_str && !valid_string(reader, cmd->str)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool read_sources(CacheReader *reader) {
+    for (uint32_t i = 0; i < reader->header->num_sources; i++) {
+        const CacheSource *source = &reader->sources[i];
+        size_t *line_starts = malloc(sizeof(size_t) * source->num_lines);
+
+        for (uint32_t j = 0; j < source->num_lines; j++) {
+            line_starts[j] = reader->lines[source->first_line + j];
+        }
+
+        reader->bases[i] = register_source_lines(reader->pool[source->name], source->len,
+                                                 line_starts, source->num_lines);
+        free(line_starts);
+
+        if (reader->bases[i] == NO_SOURCE_POS) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Finds the source that a lazy function's body is in, along with the body's
+// offset in it. Returns NULL if lazy functions aren't allowed, or the source
+// can't be read as it was when the cache was written
+static LazySource *find_lazy_source(const CacheReader *reader, GlassProgramBuilder *prog_builder,
+                                    SourcePos body_pos, size_t *offset)
+{
+    if (reader->lazy_parser == NULL) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < reader->header->num_sources; i++) {
+        const CacheSource *source = &reader->sources[i];
+        if (body_pos < reader->bases[i] || body_pos - reader->bases[i] >= source->len) {
+            continue;
+        }
+
+        if (reader->lazy_sources[i] == NULL) {
+            Stream *stream = stream_from_path(reader->pool[source->name]);
+            if (stream == NULL) {
+                return NULL;
+            }
+            if (stream_len(stream) != source->len) {
+                free_stream(stream);
+                return NULL;
+            }
+            reader->lazy_sources[i] = builder_add_lazy_source(prog_builder, stream, reader->bases[i],
+                                                              reader->lazy_parser);
+        }
+
+        *offset = body_pos - reader->bases[i];
+        return reader->lazy_sources[i];
+    }
+
+    return NULL;
+}
+
+static GlassFunction *read_function(const CacheReader *reader, GlassProgramBuilder *prog_builder,
+                                    const CacheFunc *rec)
+{
+    Arena *arena = builder_get_arena(prog_builder);
+    GlassFuncBuilder *builder = new_func_builder(arena, reader->pool[rec->name], rec->pos);
+
+    if (rec->body_pos != NO_SOURCE_POS) {
+        size_t offset;
+        LazySource *source = find_lazy_source(reader, prog_builder, rec->body_pos, &offset);
+        GlassFunction *func = source != NULL ? build_lazy_function(builder, source, offset) : NULL;
+
+        free_func_builder(builder);
+        return func;
+    }
+
+    // Replaying the commands through the builder pairs up the loops again
+    for (uint32_t i = 0; i < rec->num_cmds; i++) {
+        const CacheCommand *cmd_rec = &reader->cmds[rec->first_cmd + i];
+        GlassCommand cmd = {
+            .type = cmd_rec->type,
+            .pos = cmd_rec->pos,
+        };
+
+        switch (cmd.type) {
+            case CMD_DUPLICATE:
+                cmd.index = cmd_rec->index;
+                break;
+
+            case CMD_PUSH_NAME:
+            case CMD_PUSH_STR:
+            case CMD_LOOP_BEGIN:
+            case CMD_LOOP_END:
+                cmd.str = reader->pool[cmd_rec->str];
+                cmd.index = cmd_rec->index;
+                break;
+
+            case CMD_PUSH_NUM:
+                cmd.number = cmd_rec->number;
+                break;
+
+            case CMD_BUILTIN:
+                cmd.builtin = cmd_rec->index;
+                break;
+
+            default:
+                break;
+        }
+
+        if (builder_add_command(builder, &cmd)) {
+            free_func_builder(builder);
+            return NULL;
+        }
+    }
+
+    GlassFunction *func = build_glass_function(builder);
+    free_func_builder(builder);
+
+    return func;
+}
+
+static GlassProgram *read_classes(const CacheReader *reader) {
+    GlassProgramBuilder *prog_builder = new_program_builder();
+    Arena *arena = builder_get_arena(prog_builder);
+
+    for (uint32_t i = 0; i < reader->header->num_classes; i++) {
+        const CacheClass *rec = &reader->classes[i];
+        GlassClassBuilder *builder = new_class_builder(arena, reader->pool[rec->name], rec->pos);
+        builder_add_class(prog_builder, builder);
+
+        for (uint32_t j = 0; j < rec->num_parents; j++) {
+            builder_add_parent(builder, reader->pool[reader->parents[rec->first_parent + j]]);
+        }
+
+        for (uint32_t j = 0; j < rec->num_funcs; j++) {
+            GlassFunction *func = read_function(reader, prog_builder, &reader->funcs[rec->first_func + j]);
+            if (func == NULL) {
+                free_program_builder(prog_builder);
+                return NULL;
+            }
+            builder_add_func(builder, func);
+        }
+    }
+
+    // The cached classes already have everything they inherit
+    GlassProgram *program = build_glass_program(prog_builder, false);
+    free_program_builder(prog_builder);
+
+    return program;
+}
+
+GlassProgram *read_program_cache(String *path, uint64_t key, const LazyParser *lazy_parser) {
+    // The positions in the cached classes are only right if the sources get
+    // the same bases they had when the cache was written
+    if (num_sources() != 0) {
+        return NULL;
+    }
+
+    Stream *stream = stream_from_path(path);
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    size_t len;
+    const char *data = stream_peek(stream, &len);
+
+    CacheReader reader = {
+        .header = (const CacheHeader *) data,
+        .lazy_parser = lazy_parser,
+    };
+
+    if (len < sizeof(CacheHeader)
+        || reader.header->magic != GLASSC_MAGIC
+        || reader.header->version != GLASSC_VERSION
+        || reader.header->key != key
+        || find_sections(&reader, data, len)
+        || !validate_cache(&reader))
+    {
+        free_stream(stream);
+        return NULL;
+    }
+
+    uint32_t num_strings = reader.header->num_strings;
+    reader.pool = malloc(sizeof(String *) * (num_strings + 1));
+    for (uint32_t i = 0; i < num_strings; i++) {
+        const CacheString *str = &reader.strings[i];
+        reader.pool[i] = string_from_buf(reader.string_bytes + str->offset, str->len);
+    }
+
+    // The sources are registered first, since lazy functions are found by
+    // where their bodies are
+    uint32_t num_cached_sources = reader.header->num_sources;
+    reader.bases = malloc(sizeof(SourcePos) * (num_cached_sources + 1));
+    reader.lazy_sources = calloc(num_cached_sources + 1, sizeof(LazySource *));
+
+    GlassProgram *program = NULL;
+    if (!read_sources(&reader)) {
+        program = read_classes(&reader);
+    }
+
+    // Nothing else can have been registered, so this leaves things the way
+    // they were before the cache was read
+    if (program == NULL) {
+        free_sources();
+    }
+
+    for (uint32_t i = 0; i < num_strings; i++) {
+        free_string(reader.pool[i]);
+    }
+    free(reader.pool);
+    free(reader.bases);
+    free(reader.lazy_sources);
+    free_stream(stream);
+
+    return program;
+}
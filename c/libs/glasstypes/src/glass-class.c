@@ -1,6 +1,8 @@
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-builders.h"
 #include "glasstypes/glass-function.h"
+#include "glasstypes/glass-source.h"
+#include "utils/arena.h"
 #include "utils/copy-interface.h"
 #include "utils/list.h"
 #include "utils/map.h"
@@ -8,17 +10,21 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 struct GlassClass {
     String *name;
 
-    Map *funcs;
+    // Sorted by name, so functions can be found with a binary search
+    const GlassFunction **funcs;
 
-    List *parents;
+    size_t num_funcs;
+
+    String **parents;
 
-    String *filename;
+    size_t num_parents;
 
-    unsigned line, col;
+    SourcePos pos;
 };
 
 enum InheritanceState {
@@ -34,68 +40,44 @@ struct GlassClassBuilder {
 
     enum InheritanceState inheritance;
 
+    // Pointers to functions in the program's arena, which can be shared with
+    // other classes through inheritance
     List *funcs;
 
-    String *filename;
-
-    unsigned line, col;
+    SourcePos pos;
 };
 
-GlassClass *copy_glass_class(const GlassClass *gclass) {
-    GlassClass *copy = malloc(sizeof(GlassClass));
-    copy->name = copy_string(gclass->name);
-    copy->funcs = copy_map(gclass->funcs);
-    copy->parents = copy_list(gclass->parents);
-    copy->filename = copy_string(gclass->filename);
-    copy->line = gclass->line;
-    copy->col = gclass->col;
-    return copy;
-}
-
-GlassClassBuilder *new_class_builder(const String *name, const String *filename,
-                                     unsigned line, unsigned col)
-{
+GlassClassBuilder *new_class_builder(Arena *arena, const String *name, SourcePos pos) {
     GlassClassBuilder *builder = malloc(sizeof(GlassClassBuilder));
-    builder->name = copy_string(name);
+    builder->name = arena_copy_string(arena, name);
     builder->parents = new_list(STRING_COPY_OPS);
     builder->inheritance = INHERITANCE_UNHANDLED;
-    builder->funcs = new_list(FUNC_COPY_OPS);
-    builder->filename = copy_string(filename);
-    builder->line = line;
-    builder->col = col;
+    builder->funcs = new_list(BORROWED_COPY_OPS);
+    builder->pos = pos;
     return builder;
 }
 
-GlassClassBuilder *copy_class_builder(const GlassClassBuilder *builder) {
-    GlassClassBuilder *copy = malloc(sizeof(GlassClassBuilder));
-    copy->name = copy_string(builder->name);
-    copy->parents = copy_list(builder->parents);
-    copy->inheritance = builder->inheritance;
-    copy->funcs = copy_list(builder->funcs);
-    copy->filename = copy_string(builder->filename);
-    copy->line = builder->line;
-    copy->col = builder->col;
-    return copy;
-}
-
-void free_glass_class(GlassClass *gclass) {
-    free_string(gclass->name);
-    free_string(gclass->filename);
-    free_list(gclass->parents);
-    free_map(gclass->funcs);
-    free(gclass);
-}
-
 void free_class_builder(GlassClassBuilder *builder) {
-    free_string(builder->name);
-    free_string(builder->filename);
     free_list(builder->parents);
     free_list(builder->funcs);
     free(builder);
 }
 
-GlassClass *build_glass_class(const GlassClassBuilder *builder) {
-    Map *func_map = new_map(STRING_HASH_OPS, FUNC_COPY_OPS);
+static int compare_names(const String *name1, const String *name2) {
+    size_t len1 = string_len(name1), len2 = string_len(name2);
+    int cmp = memcmp(string_data(name1), string_data(name2), len1 < len2 ? len1 : len2);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (len1 > len2) - (len1 < len2);
+}
+
+static int compare_funcs(const void *func1, const void *func2) {
+    return compare_names(func_get_name(*(const GlassFunction **) func1),
+                         func_get_name(*(const GlassFunction **) func2));
+}
+
+GlassClass *build_glass_class(const GlassClassBuilder *builder, Arena *arena) {
     Map *unique_funcs = new_map(STRING_HASH_OPS, LIST_COPY_OPS);
 
     for (size_t i = 0; i < list_len(builder->funcs); i++) {
@@ -107,8 +89,7 @@ GlassClass *build_glass_class(const GlassClassBuilder *builder) {
             list_add(idx_list, &i);
 
             map_set(unique_funcs, func_name, idx_list);
-            map_set(func_map, func_name, func);
-            
+
             free_list(idx_list);
         }
         else {
@@ -128,16 +109,20 @@ GlassClass *build_glass_class(const GlassClassBuilder *builder) {
 
             if (list_len(func_list) > 1) {
                 fprintf(stderr, "    Function '%s' defined multiple times:\n", string_get_c_str(func_name));
-                String *filename = copy_string(builder->filename);
 
                 for (size_t j = 0; j < list_len(func_list); j++) {
                     const size_t *idx = list_get(func_list, j);
                     const GlassFunction *func = list_get(builder->funcs, *idx);
 
-                    fprintf(stderr, "        Defined in '%s' on line %d, column %d\n",
-                                    string_get_c_str(filename),
-                                    func_get_line(func),
-                                    func_get_col(func));
+                    const String *source_name;
+                    unsigned line, col;
+                    source_pos_lookup(func_get_pos(func), &source_name, &line, &col);
+                    String *filename = copy_string(source_name);
+
+                    fprintf(stderr, "        Defined in '%s' on line %u, column %u\n",
+                                    string_get_c_str(filename), line, col);
+
+                    free_string(filename);
                 }
             }
 
@@ -145,21 +130,29 @@ GlassClass *build_glass_class(const GlassClassBuilder *builder) {
         }
 
         free_list(funcs);
-        free_map(func_map);
         free_map(unique_funcs);
         return NULL;
     }
 
-    GlassClass *gclass = malloc(sizeof(GlassClass));
-    gclass->filename = copy_string(builder->filename);
-    gclass->name = copy_string(builder->name);
-    gclass->funcs = func_map;
-    gclass->parents = copy_list(builder->parents);
-    gclass->line = builder->line;
-    gclass->col = builder->col;
-
     free_map(unique_funcs);
 
+    GlassClass *gclass = arena_alloc(arena, sizeof(GlassClass));
+    gclass->name = builder->name;
+    gclass->pos = builder->pos;
+
+    gclass->num_funcs = list_len(builder->funcs);
+    gclass->funcs = arena_alloc(arena, sizeof(GlassFunction *) * gclass->num_funcs);
+    for (size_t i = 0; i < gclass->num_funcs; i++) {
+        gclass->funcs[i] = list_get(builder->funcs, i);
+    }
+    qsort(gclass->funcs, gclass->num_funcs, sizeof(GlassFunction *), compare_funcs);
+
+    gclass->num_parents = list_len(builder->parents);
+    gclass->parents = arena_alloc(arena, sizeof(String *) * gclass->num_parents);
+    for (size_t i = 0; i < gclass->num_parents; i++) {
+        gclass->parents[i] = arena_copy_string(arena, list_get(builder->parents, i));
+    }
+
     return gclass;
 }
 
@@ -175,44 +168,69 @@ const String *class_get_name(const GlassClass *gclass) {
     return gclass->name;
 }
 
-const List *class_get_parents(const GlassClass *gclass) {
-    return gclass->parents;
+SourcePos class_get_pos(const GlassClass *gclass) {
+    return gclass->pos;
 }
 
-bool class_has_func(const GlassClass *gclass, const String *name) {
-    return map_has(gclass->funcs, name);
+size_t class_num_parents(const GlassClass *gclass) {
+    return gclass->num_parents;
 }
 
-const GlassFunction *class_get_func(const GlassClass *gclass, const String *name) {
-    return map_get(gclass->funcs, name);
+const String *class_get_parent(const GlassClass *gclass, size_t index) {
+    return gclass->parents[index];
 }
 
-List *class_get_func_names(const GlassClass *gclass) {
-    return map_get_keys(gclass->funcs);
-}
+const GlassFunction *class_find_func(const GlassClass *gclass, const String *name) {
+    size_t lo = 0, hi = gclass->num_funcs;
 
-static void *copy_glass_class_generic(const void *gclass) {
-    return copy_glass_class(gclass);
-}
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = compare_names(func_get_name(gclass->funcs[mid]), name);
+        if (cmp == 0) {
+            return gclass->funcs[mid];
+        }
+        else if (cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
 
-static void free_glass_class_generic(void *gclass) {
-    free_glass_class(gclass);
+    return NULL;
 }
 
-static void *copy_class_builder_generic(const void *builder) {
-    return copy_class_builder(builder);
+void class_retain_funcs(GlassClass *gclass, const Map *names) {
+    size_t num_kept = 0;
+
+    // Compacting in place keeps the functions sorted
+    for (size_t i = 0; i < gclass->num_funcs; i++) {
+        if (map_has(names, func_get_name(gclass->funcs[i]))) {
+            gclass->funcs[num_kept++] = gclass->funcs[i];
+        }
+    }
+
+    gclass->num_funcs = num_kept;
 }
 
-static void free_class_builder_generic(void *builder) {
-    free_class_builder(builder);
+bool class_has_func(const GlassClass *gclass, const String *name) {
+    return class_find_func(gclass, name) != NULL;
 }
 
-const CopyInterface *CLASS_COPY_OPS = &(CopyInterface) {
-    copy_glass_class_generic,
-    free_glass_class_generic,
-};
+const GlassFunction *class_get_func(const GlassClass *gclass, const String *name) {
+    const GlassFunction *func = class_find_func(gclass, name);
 
-const CopyInterface *CLASS_BUILDER_COPY_OPS = &(CopyInterface) {
-    copy_class_builder_generic,
-    free_class_builder_generic,
-};
+    if (func == NULL || func_parse_body(func)) {
+        return NULL;
+    }
+
+    return func;
+}
+
+List *class_get_func_names(const GlassClass *gclass) {
+    List *names = new_list(STRING_COPY_OPS);
+    for (size_t i = 0; i < gclass->num_funcs; i++) {
+        list_add(names, func_get_name(gclass->funcs[i]));
+    }
+    return names;
+}
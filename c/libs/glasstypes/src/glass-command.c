@@ -1,65 +1,9 @@
 #include "glasstypes/glass-command.h"
-#include "utils/copy-interface.h"
 #include "utils/string.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 
-void *copy_command(const GlassCommand *cmd) {
-    GlassCommand *copy = malloc(sizeof(GlassCommand));
-    copy->type = cmd->type;
-    copy->filename = copy_string(cmd->filename);
-    copy->line = cmd->line;
-    copy->col = cmd->col;
-
-    switch (cmd->type) {
-        case CMD_DUPLICATE:
-            copy->index = cmd->index;
-            break;
-
-        case CMD_PUSH_NAME:
-        case CMD_PUSH_STR:
-            copy->str = copy_string(cmd->str);
-            break;
-
-        case CMD_PUSH_NUM:
-            copy->number = cmd->number;
-            break;
-
-        case CMD_LOOP_BEGIN:
-        case CMD_LOOP_END:
-            copy->index = cmd->index;
-            copy->str = copy_string(cmd->str);
-            break;
-
-        case CMD_BUILTIN:
-            copy->builtin = cmd->builtin;
-            break;
-        
-        default:
-            break;
-    }
-
-    return copy;
-}
-
-void free_command(GlassCommand *cmd) {
-    switch (cmd->type) {
-        case CMD_LOOP_BEGIN:
-        case CMD_LOOP_END:
-        case CMD_PUSH_NAME:
-        case CMD_PUSH_STR:
-            free_string(cmd->str);
-            break;
-        
-        default:
-            break;
-    }
-
-    free_string(cmd->filename);
-    free(cmd);
-}
-
 String *command_to_str(const GlassCommand *cmd) {
     switch (cmd->type) {
         case CMD_ASSIGN_SELF:
@@ -196,20 +140,30 @@ String *builtin_func_name(BuiltinFunc func) {
             return string_from_chars("argument_count");
         case BUILTIN_INPUT_ARGUMENT:
             return string_from_chars("next_argument");
+        case BUILTIN_LIST_GET:
+            return string_from_chars("list_get");
+        case BUILTIN_LIST_LENGTH:
+            return string_from_chars("list_length");
+        case BUILTIN_LIST_POP:
+            return string_from_chars("list_pop");
+        case BUILTIN_LIST_PUSH:
+            return string_from_chars("list_push");
+        case BUILTIN_LIST_SET:
+            return string_from_chars("list_set");
         default:
             return string_from_chars("unimplemented");
     }
 }
 
-static void *copy_command_generic(const void *cmd) {
-    return copy_command(cmd);
-}
-
-static void free_command_generic(void *cmd) {
-    free_command(cmd);
+bool builtin_uses_instance(BuiltinFunc func) {
+    switch (func) {
+        case BUILTIN_LIST_GET:
+        case BUILTIN_LIST_LENGTH:
+        case BUILTIN_LIST_POP:
+        case BUILTIN_LIST_PUSH:
+        case BUILTIN_LIST_SET:
+            return true;
+        default:
+            return false;
+    }
 }
-
-const CopyInterface *CMD_COPY_OPS = &(CopyInterface) {
-    copy_command_generic,
-    free_command_generic,
-};
@@ -1,46 +1,76 @@
 #include "glasstypes/glass-builders.h"
 #include "glasstypes/glass-command.h"
 #include "glasstypes/glass-function.h"
+#include "glasstypes/glass-symbol.h"
+#include "utils/arena.h"
 #include "utils/copy-interface.h"
 #include "utils/list.h"
+#include "utils/stream.h"
 #include "utils/string.h"
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 struct GlassFunction {
     String *name;
 
-    List *cmds;
+    GlassCommand *cmds;
 
-    String *filename;
+    size_t len;
 
-    unsigned line, col;
+    SourcePos pos;
+
+    // Where the body still has to be parsed from, or NULL once it has been
+    LazySource *source;
+
+    SourcePos body_pos;
+
+    // Set if parsing the body failed, so the error is only reported once
+    bool invalid;
+};
+
+struct LazySource {
+    Stream *stream;
+
+    SourcePos base;
+
+    const LazyParser *parser;
+
+    // Bodies are parsed long after the arena their functions were built in
+    // has been merged into the program's, so they get an arena of their own
+    Arena *arena;
 };
 
 struct GlassFuncBuilder {
+    Arena *arena;
+
     String *name;
 
-    List *cmds;
+    // The commands are collected here, and copied into the arena in one
+    // contiguous block once the function is built
+    GlassCommand *cmds;
 
-    List *loop_starts;
+    size_t len;
 
-    String *filename;
+    size_t alloc;
+
+    List *loop_starts;
 
-    unsigned line, col;
+    SourcePos pos;
 };
 
-GlassFuncBuilder *new_func_builder(const struct String *name,
-                                   const struct String *filename,
-                                   unsigned line, unsigned col)
-{
+#define FUNC_BUILDER_INIT_ALLOC 16
+
+GlassFuncBuilder *new_func_builder(Arena *arena, const String *name, SourcePos pos) {
     GlassFuncBuilder *builder = malloc(sizeof(GlassFuncBuilder));
-    builder->name = copy_string(name);
-    builder->cmds = new_list(CMD_COPY_OPS);
+    builder->arena = arena;
+    builder->name = arena_copy_string(arena, name);
+    builder->cmds = malloc(sizeof(GlassCommand) * FUNC_BUILDER_INIT_ALLOC);
+    builder->len = 0;
+    builder->alloc = FUNC_BUILDER_INIT_ALLOC;
     builder->loop_starts = new_list(SIZE_T_COPY_OPS);
-    builder->filename = copy_string(filename);
-    builder->line = line;
-    builder->col = col;
+    builder->pos = pos;
     return builder;
 }
 
@@ -49,36 +79,94 @@ GlassFunction *build_glass_function(const GlassFuncBuilder *builder) {
         return NULL;
     }
 
-    GlassFunction *func = malloc(sizeof(GlassFunction));
-    func->name = copy_string(builder->name);
-    func->cmds = copy_list(builder->cmds);
-    func->filename = copy_string(builder->filename);
-    func->line = builder->line;
-    func->col = builder->col;
+    GlassFunction *func = arena_alloc(builder->arena, sizeof(GlassFunction));
+    func->name = builder->name;
+    func->cmds = arena_copy(builder->arena, builder->cmds, sizeof(GlassCommand) * builder->len);
+    func->len = builder->len;
+    func->pos = builder->pos;
+    func->source = NULL;
+    func->body_pos = NO_SOURCE_POS;
+    func->invalid = false;
     return func;
 }
 
-GlassFunction *copy_glass_func(const GlassFunction *func) {
-    GlassFunction *copy = malloc(sizeof(GlassFunction));
-    copy->name = copy_string(func->name);
-    copy->cmds = copy_list(func->cmds);
-    copy->filename = copy_string(func->filename);
-    copy->line = func->line;
-    copy->col = func->col;
-    return copy;
+GlassFunction *build_lazy_function(const GlassFuncBuilder *builder, LazySource *source, size_t offset) {
+    GlassFunction *func = arena_alloc(builder->arena, sizeof(GlassFunction));
+    func->name = builder->name;
+    func->cmds = NULL;
+    func->len = 0;
+    func->pos = builder->pos;
+    func->source = source;
+    func->body_pos = source->base + offset;
+    func->invalid = false;
+    return func;
+}
+
+bool func_parse_body(const GlassFunction *func) {
+    if (func->source == NULL) {
+        return func->invalid;
+    }
+
+    // Functions are otherwise immutable once built, but parsing the body
+    // doesn't change anything observable besides filling in the commands
+    GlassFunction *mut_func = (GlassFunction *) func;
+    LazySource *source = func->source;
+
+    GlassFuncBuilder *builder = new_func_builder(source->arena, func->name, func->pos);
+    mut_func->invalid = source->parser->parse(builder, source->stream, source->base,
+                                              func->body_pos - source->base);
+
+    mut_func->source = NULL;
+
+    if (!mut_func->invalid) {
+        mut_func->cmds = arena_copy(source->arena, builder->cmds, sizeof(GlassCommand) * builder->len);
+        mut_func->len = builder->len;
+        mut_func->body_pos = NO_SOURCE_POS;
+        func_intern_names(mut_func);
+    }
+
+    free_func_builder(builder);
+    return mut_func->invalid;
+}
+
+void func_replace_commands(GlassFunction *func, const GlassCommand *cmds, size_t len) {
+    assert(func->source == NULL && len <= func->len);
+
+    memmove(func->cmds, cmds, sizeof(GlassCommand) * len);
+    func->len = len;
+}
+
+void func_intern_names(GlassFunction *func) {
+    intern_symbol(func->name);
+
+    if (func->source != NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < func->len; i++) {
+        if (func->cmds[i].type == CMD_PUSH_NAME) {
+            func->cmds[i].index = intern_symbol(func->cmds[i].str);
+        }
+    }
 }
 
-void free_glass_func(GlassFunction *func) {
-    free_string(func->name);
-    free_string(func->filename);
-    free_list(func->cmds);
-    free(func);
+LazySource *new_lazy_source(Stream *stream, SourcePos base, const LazyParser *parser) {
+    LazySource *source = malloc(sizeof(LazySource));
+    source->stream = stream;
+    source->base = base;
+    source->parser = parser;
+    source->arena = new_arena();
+    return source;
+}
+
+void free_lazy_source(LazySource *source) {
+    free_stream(source->stream);
+    free_arena(source->arena);
+    free(source);
 }
 
 void free_func_builder(GlassFuncBuilder *builder) {
-    free_string(builder->name);
-    free_string(builder->filename);
-    free_list(builder->cmds);
+    free(builder->cmds);
     free_list(builder->loop_starts);
     free(builder);
 }
@@ -87,30 +175,72 @@ const String *func_get_name(const GlassFunction *func) {
     return func->name;
 }
 
-const String *func_get_filename(const GlassFunction *func) {
-    return func->filename;
+SourcePos func_get_pos(const GlassFunction *func) {
+    return func->pos;
 }
 
 const GlassCommand *func_get_command(const GlassFunction *func, size_t index) {
-    return list_get(func->cmds, index);
+    assert(func->source == NULL);
+    return &func->cmds[index];
 }
 
-unsigned func_get_line(const GlassFunction *func) {
-    return func->line;
+size_t func_len(const GlassFunction *func) {
+    assert(func->source == NULL);
+    return func->len;
 }
 
-unsigned func_get_col(const GlassFunction *func) {
-    return func->col;
+void func_visit_names(const GlassFunction *func, FuncNameVisitor visit, void *data) {
+    if (func->source != NULL) {
+        LazySource *source = func->source;
+        source->parser->scan(source->stream, func->body_pos - source->base, visit, data);
+        return;
+    }
+
+    for (size_t i = 0; i < func->len; i++) {
+        const GlassCommand *cmd = &func->cmds[i];
+
+        if (cmd->type == CMD_PUSH_NAME || cmd->type == CMD_LOOP_BEGIN) {
+            visit(cmd->str, cmd->type == CMD_LOOP_BEGIN, data);
+        }
+        else {
+            visit(NULL, false, data);
+        }
+    }
 }
 
-size_t func_len(const GlassFunction *func) {
-    return list_len(func->cmds);
+SourcePos func_get_body_pos(const GlassFunction *func) {
+    return func->body_pos;
+}
+
+// Adds a copy of the command, with its string copied into the arena, and
+// returns a pointer to it
+static GlassCommand *builder_push_command(GlassFuncBuilder *builder, const GlassCommand *cmd) {
+    if (builder->len == builder->alloc) {
+        builder->alloc *= 2;
+        builder->cmds = realloc(builder->cmds, sizeof(GlassCommand) * builder->alloc);
+    }
+
+    GlassCommand *copy = &builder->cmds[builder->len++];
+    *copy = *cmd;
+
+    switch (cmd->type) {
+        case CMD_LOOP_BEGIN:
+        case CMD_PUSH_NAME:
+        case CMD_PUSH_STR:
+            copy->str = arena_copy_string(builder->arena, cmd->str);
+            break;
+
+        default:
+            break;
+    }
+
+    return copy;
 }
 
 static void builder_start_loop(GlassFuncBuilder *builder, const GlassCommand *cmd) {
-    size_t index = list_len(builder->cmds);
+    size_t index = builder->len;
     list_add(builder->loop_starts, &index);
-    list_add(builder->cmds, cmd);
+    builder_push_command(builder, cmd);
 }
 
 static bool builder_end_loop(GlassFuncBuilder *builder, const GlassCommand *cmd) {
@@ -120,24 +250,21 @@ static bool builder_end_loop(GlassFuncBuilder *builder, const GlassCommand *cmd)
 
     size_t *index = list_pop(builder->loop_starts);
 
-    GlassCommand *loop_start = list_get_mutable(builder->cmds, *index);
+    GlassCommand *loop_start = &builder->cmds[*index];
     
     assert(loop_start->type == CMD_LOOP_BEGIN);
-    
-    GlassCommand *loop_end = &(GlassCommand) {
+
+    loop_start->index = builder->len;
+
+    // The loop end shares its name with the loop start, which is already in
+    // the arena
+    GlassCommand *loop_end = builder_push_command(builder, &(GlassCommand) {
         .type = CMD_LOOP_END,
-        .filename = copy_string(cmd->filename),
-        .line = cmd->line,
-        .col = cmd->col,
-        .str = copy_string(loop_start->str),
-        .index = *index,
-    };
-
-    loop_start->index = list_len(builder->cmds);
-    list_add(builder->cmds, loop_end);
-
-    free_string(loop_end->filename);
-    free_string(loop_end->str);
+        .pos = cmd->pos,
+    });
+    loop_end->str = builder->cmds[*index].str;
+    loop_end->index = *index;
+
     free(index);
 
     return false;
@@ -151,21 +278,12 @@ bool builder_add_command(GlassFuncBuilder *builder, const GlassCommand *cmd) {
         return builder_end_loop(builder, cmd);
     }
     else {
-        list_add(builder->cmds, cmd);
+        builder_push_command(builder, cmd);
     }
 
     return false;
 }
 
-static void *copy_glass_func_generic(const void *func) {
-    return copy_glass_func(func);
+bool builder_in_loop(const GlassFuncBuilder *builder) {
+    return !list_empty(builder->loop_starts);
 }
-
-static void free_glass_func_generic(void *func) {
-    free_glass_func(func);
-}
-
-const CopyInterface *FUNC_COPY_OPS = &(CopyInterface) {
-    copy_glass_func_generic,
-    free_glass_func_generic,
-};
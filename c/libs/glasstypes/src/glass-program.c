@@ -1,10 +1,16 @@
 #include "glasstypes/glass-builders.h"
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "glasstypes/glass-source.h"
+#include "glasstypes/glass-symbol.h"
 
+#include "utils/arena.h"
 #include "utils/copy-interface.h"
 #include "utils/list.h"
 #include "utils/map.h"
+#include "utils/set.h"
+#include "utils/stream.h"
 #include "utils/string.h"
 
 #include <stdio.h>
@@ -25,34 +31,118 @@ struct GlassClassBuilder {
 
     List *funcs;
 
-    String *filename;
-
-    unsigned line, col;
+    SourcePos pos;
 };
 
 struct GlassProgramBuilder {
+    Arena *arena;
+
     List *classes;
+
+    List *lazy_sources;
+};
+
+struct GlassProgram {
+    Arena *arena;
+
+    // The classes themselves are in the arena, so the map only points to them
+    Map *classes;
+
+    // The sources any functions that haven't been parsed yet are read from
+    List *lazy_sources;
+};
+
+static void *take_class_builder(const void *builder) {
+    return (void *) builder;
+}
+
+static void free_class_builder_generic(void *builder) {
+    free_class_builder(builder);
+}
+
+// The program builder owns its class builders, so they're added without
+// being copied, and freed along with it
+static const CopyInterface *OWNED_CLASS_BUILDER_OPS = &(CopyInterface) {
+    take_class_builder,
+    free_class_builder_generic,
+};
+
+static void *take_lazy_source(const void *source) {
+    return (void *) source;
+}
+
+static void free_lazy_source_generic(void *source) {
+    free_lazy_source(source);
+}
+
+static const CopyInterface *OWNED_LAZY_SOURCE_OPS = &(CopyInterface) {
+    take_lazy_source,
+    free_lazy_source_generic,
 };
 
 GlassProgramBuilder *new_program_builder(void) {
     GlassProgramBuilder *builder = malloc(sizeof(GlassProgramBuilder));
-    builder->classes = new_list(CLASS_BUILDER_COPY_OPS);
+    builder->arena = new_arena();
+    builder->classes = new_list(OWNED_CLASS_BUILDER_OPS);
+    builder->lazy_sources = new_list(OWNED_LAZY_SOURCE_OPS);
     return builder;
 }
 
 void free_program_builder(GlassProgramBuilder *builder) {
     free_list(builder->classes);
+    free_list(builder->lazy_sources);
+    free_arena(builder->arena);
     free(builder);
 }
 
-void builder_add_class(GlassProgramBuilder *builder, const GlassClassBuilder *class_builder) {
+Arena *builder_get_arena(GlassProgramBuilder *builder) {
+    return builder->arena;
+}
+
+void builder_add_class(GlassProgramBuilder *builder, GlassClassBuilder *class_builder) {
     list_add(builder->classes, class_builder);
 }
 
-bool func_matches_name(const void *str, const void *val) {
-    const String *func_name = (const String *) str;
-    const GlassFunction *func = (const GlassFunction *) val;
-    return strings_equal(func_get_name(func), func_name);
+void builder_merge(GlassProgramBuilder *dest, GlassProgramBuilder *src) {
+    list_move_all(dest->classes, src->classes);
+    list_move_all(dest->lazy_sources, src->lazy_sources);
+    arena_merge(dest->arena, src->arena);
+}
+
+LazySource *builder_add_lazy_source(GlassProgramBuilder *builder, Stream *stream, SourcePos base, const LazyParser *parser) {
+    LazySource *source = new_lazy_source(stream, base, parser);
+    list_add(builder->lazy_sources, source);
+    return source;
+}
+
+void free_glass_program(GlassProgram *program) {
+    free_map(program->classes);
+    free_list(program->lazy_sources);
+    free_arena(program->arena);
+    free(program);
+}
+
+const Map *program_get_classes(const GlassProgram *program) {
+    return program->classes;
+}
+
+void program_retain_names(GlassProgram *program, const Map *names) {
+    Map *kept = new_map(STRING_HASH_OPS, BORROWED_COPY_OPS);
+    List *class_names = map_get_keys(program->classes);
+
+    for (size_t i = 0; i < list_len(class_names); i++) {
+        const String *class_name = list_get(class_names, i);
+
+        if (map_has(names, class_name)) {
+            GlassClass *gclass = map_get_mutable(program->classes, class_name);
+            class_retain_funcs(gclass, names);
+            map_set(kept, class_name, gclass);
+        }
+    }
+
+    free_list(class_names);
+    free_map(program->classes);
+    program->classes = kept;
 }
 
 bool resolve_inheritance(Map *class_builders, const String *class_name, List *class_chain) {
@@ -76,36 +166,57 @@ bool resolve_inheritance(Map *class_builders, const String *class_name, List *cl
         builder->state = INHERITANCE_HANDLING;
         list_add(class_chain, class_name);
 
+        // Functions defined closer to the class override inherited ones, so
+        // a parent's function is only added if no function by that name is
+        // there yet
+        Set *func_names = new_set(STRING_HASH_OPS);
+        for (size_t i = 0; i < list_len(builder->funcs); i++) {
+            set_add(func_names, func_get_name(list_get(builder->funcs, i)));
+        }
+
+        Set *parent_names = new_set(STRING_HASH_OPS);
+        bool failed = false;
+
         for (size_t i = 0; i < list_len(builder->parents); i++) {
             String *parent_name = list_get_mutable(builder->parents, i);
 
             // Make sure we don't inherit from the same parent twice
-            for (size_t j = 0; j < i; j++) {
-                const String *other_parent_name = list_get(builder->parents, j);
-                if (strings_equal(parent_name, other_parent_name)) {
-                    fprintf(stderr, "Error! %s inherits from %s multiple times!\n",
-                                    string_get_c_str(builder->name),
-                                    string_get_c_str(parent_name));
-                    return true;
-                }
+            if (set_has(parent_names, parent_name)) {
+                fprintf(stderr, "Error! %s inherits from %s multiple times!\n",
+                                string_get_c_str(builder->name),
+                                string_get_c_str(parent_name));
+                failed = true;
+                break;
             }
+            set_add(parent_names, parent_name);
 
             if (resolve_inheritance(class_builders, parent_name, class_chain)) {
-                return true;
+                failed = true;
+                break;
             }
 
             const GlassClassBuilder *parent = map_get(class_builders, parent_name);
 
+            // The functions themselves are shared with the parent, only the
+            // pointers to them get added
             for (size_t j = 0; j < list_len(parent->funcs); j++) {
                 const GlassFunction *func = list_get(parent->funcs, j);
                 const String *func_name = func_get_name(func);
 
-                if (!list_has(builder->funcs, func_name, func_matches_name)) {
+                if (!set_has(func_names, func_name)) {
+                    set_add(func_names, func_name);
                     list_add(builder->funcs, func);
                 }
             }
         }
 
+        free_set(func_names);
+        free_set(parent_names);
+
+        if (failed) {
+            return true;
+        }
+
         builder->state = INHERITANCE_HANDLED;
         free_string(list_pop(builder->parents));
     }
@@ -113,8 +224,8 @@ bool resolve_inheritance(Map *class_builders, const String *class_name, List *cl
     return false;
 }
 
-Map *build_classes(Map *builders_map, bool handle_inheritance) {
-    Map *classes = new_map(STRING_HASH_OPS, CLASS_COPY_OPS);
+Map *build_classes(Map *builders_map, bool handle_inheritance, Arena *arena) {
+    Map *classes = new_map(STRING_HASH_OPS, BORROWED_COPY_OPS);
     List *class_names = map_get_keys(builders_map);
     List *parent_chain = new_list(STRING_COPY_OPS);
 
@@ -132,13 +243,15 @@ Map *build_classes(Map *builders_map, bool handle_inheritance) {
 
         const GlassClassBuilder *builder = map_get(builders_map, class_name);
 
-        GlassClass *gclass = build_glass_class(builder);
+        GlassClass *gclass = build_glass_class(builder, arena);
         if (gclass == NULL) {
+            free_map(classes);
+            free_list(class_names);
+            free_list(parent_chain);
             return NULL;
         }
 
         map_set(classes, class_name, gclass);
-        free_glass_class(gclass);
     }
 
     free_list(class_names);
@@ -147,12 +260,14 @@ Map *build_classes(Map *builders_map, bool handle_inheritance) {
     return classes;
 }
 
-Map *build_glass_program(const GlassProgramBuilder *builder, bool handle_inheritance) {
-    Map *builders_map = new_map(STRING_HASH_OPS, CLASS_BUILDER_COPY_OPS);
+GlassProgram *build_glass_program(GlassProgramBuilder *builder, bool handle_inheritance) {
+    // Inheritance is resolved on the builders in place, which the map only
+    // points to
+    Map *builders_map = new_map(STRING_HASH_OPS, BORROWED_COPY_OPS);
     Map *unique_classes = new_map(STRING_HASH_OPS, LIST_COPY_OPS);
 
     for (size_t i = 0; i < list_len(builder->classes); i++) {
-        const GlassClassBuilder *gclass = list_get(builder->classes, i);
+        GlassClassBuilder *gclass = list_get_mutable(builder->classes, i);
         const String *class_name = gclass->name;
 
         if (!map_has(unique_classes, class_name)) {
@@ -184,11 +299,14 @@ Map *build_glass_program(const GlassProgramBuilder *builder, bool handle_inherit
                 for (size_t j = 0; j < list_len(class_list); j++) {
                     const size_t *idx = list_get(class_list, j);
                     const GlassClassBuilder *gclass = list_get(builder->classes, *idx);
-                    String *filename = copy_string(gclass->filename);
 
-                    fprintf(stderr, "    Defined in '%s' on line %d, column %d\n",
-                                    string_get_c_str(filename),
-                                    gclass->line, gclass->col);
+                    const String *source_name;
+                    unsigned line, col;
+                    source_pos_lookup(gclass->pos, &source_name, &line, &col);
+                    String *filename = copy_string(source_name);
+
+                    fprintf(stderr, "    Defined in '%s' on line %u, column %u\n",
+                                    string_get_c_str(filename), line, col);
 
                     free_string(filename);
                 }
@@ -204,8 +322,32 @@ Map *build_glass_program(const GlassProgramBuilder *builder, bool handle_inherit
     }
 
     free_map(unique_classes);
-    Map *classes = build_classes(builders_map, handle_inheritance);
+
+    for (size_t i = 0; i < list_len(builder->classes); i++) {
+        GlassClassBuilder *gclass = list_get_mutable(builder->classes, i);
+        intern_symbol(gclass->name);
+
+        for (size_t j = 0; j < list_len(gclass->funcs); j++) {
+            func_intern_names(list_get_mutable(gclass->funcs, j));
+        }
+    }
+
+    Map *classes = build_classes(builders_map, handle_inheritance, builder->arena);
     free_map(builders_map);
 
-    return classes;
+    if (classes == NULL) {
+        return NULL;
+    }
+
+    GlassProgram *program = malloc(sizeof(GlassProgram));
+    program->arena = builder->arena;
+    program->classes = classes;
+    program->lazy_sources = builder->lazy_sources;
+
+    // The program owns everything in the arena now, so give the builder a
+    // fresh one
+    builder->arena = new_arena();
+    builder->lazy_sources = new_list(OWNED_LAZY_SOURCE_OPS);
+
+    return program;
 }
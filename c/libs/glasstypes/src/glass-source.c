@@ -0,0 +1,177 @@
+#include "glasstypes/glass-source.h"
+#include "utils/copy-interface.h"
+#include "utils/list.h"
+#include "utils/stream.h"
+#include "utils/string.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct SourceFile {
+    String *name;
+
+    SourcePos base;
+
+    size_t len;
+
+    size_t *line_starts;
+
+    size_t num_lines;
+} SourceFile;
+
+static void *copy_source_file(const void *val) {
+    const SourceFile *file = val;
+    SourceFile *copy = malloc(sizeof(SourceFile));
+    copy->name = copy_string(file->name);
+    copy->base = file->base;
+    copy->len = file->len;
+    copy->line_starts = malloc(sizeof(size_t) * file->num_lines);
+    memcpy(copy->line_starts, file->line_starts, sizeof(size_t) * file->num_lines);
+    copy->num_lines = file->num_lines;
+    return copy;
+}
+
+static void free_source_file(void *val) {
+    SourceFile *file = val;
+    free_string(file->name);
+    free(file->line_starts);
+    free(file);
+}
+
+static const CopyInterface *SOURCE_FILE_COPY_OPS = &(CopyInterface) {
+    copy_source_file,
+    free_source_file,
+};
+
+static List *source_files = NULL;
+
+// Position 0 is reserved for NO_SOURCE_POS
+static SourcePos next_base = 1;
+
+SourcePos register_source(const Stream *stream) {
+    String *name = stream_get_name(stream) != NULL
+        ? copy_string(stream_get_name(stream))
+        : new_string();
+
+    size_t num_lines;
+    size_t *line_starts = stream_line_starts(stream, &num_lines);
+
+    SourcePos base = register_source_lines(name, stream_len(stream),
+                                           line_starts, num_lines);
+
+    free_string(name);
+    free(line_starts);
+
+    return base;
+}
+
+SourcePos register_source_lines(const String *name, size_t len,
+                                const size_t *line_starts, size_t num_lines)
+{
+    // Every position in the file, and the one past its end, must fit in a
+    // SourcePos
+    if (len >= UINT32_MAX - next_base) {
+        return NO_SOURCE_POS;
+    }
+
+    if (source_files == NULL) {
+        source_files = new_list(SOURCE_FILE_COPY_OPS);
+    }
+
+    SourceFile file = {
+        .name = (String *) name,
+        .base = next_base,
+        .len = len,
+        .line_starts = (size_t *) line_starts,
+        .num_lines = num_lines,
+    };
+
+    // Leave room for a position one past the last char, for errors at EOF
+    next_base += len + 1;
+
+    list_add(source_files, &file);
+
+    return file.base;
+}
+
+size_t num_sources(void) {
+    return source_files != NULL ? list_len(source_files) : 0;
+}
+
+void source_get_info(size_t index, const String **name, size_t *len,
+                     const size_t **line_starts, size_t *num_lines)
+{
+    const SourceFile *file = list_get(source_files, index);
+
+    *name = file->name;
+    *len = file->len;
+    *line_starts = file->line_starts;
+    *num_lines = file->num_lines;
+}
+
+// Returns the index of the last element in the sorted array that is less
+// than or equal to the value
+static size_t last_at_or_before(const size_t *vals, size_t len, size_t val) {
+    size_t lo = 0, hi = len;
+
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (vals[mid] <= val) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static const SourceFile *find_source_file(SourcePos pos) {
+    size_t lo = 0, hi = list_len(source_files);
+
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        const SourceFile *file = list_get(source_files, mid);
+        if (file->base <= pos) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return list_get(source_files, lo);
+}
+
+void source_pos_lookup(SourcePos pos, const String **filename,
+                       unsigned *line, unsigned *col)
+{
+    static String *builtin_name = NULL;
+
+    if (pos == NO_SOURCE_POS || source_files == NULL || list_empty(source_files)) {
+        if (builtin_name == NULL) {
+            builtin_name = string_from_chars("<builtin>");
+        }
+        *filename = builtin_name;
+        *line = 0;
+        *col = 0;
+        return;
+    }
+
+    const SourceFile *file = find_source_file(pos);
+    size_t offset = pos - file->base;
+    size_t line_idx = last_at_or_before(file->line_starts, file->num_lines, offset);
+
+    *filename = file->name;
+    *line = line_idx + 1;
+    *col = offset - file->line_starts[line_idx] + 1;
+}
+
+void free_sources(void) {
+    if (source_files != NULL) {
+        free_list(source_files);
+        source_files = NULL;
+    }
+    next_base = 1;
+}
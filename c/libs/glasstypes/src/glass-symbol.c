@@ -0,0 +1,72 @@
+#include "glasstypes/glass-symbol.h"
+#include "utils/copy-interface.h"
+#include "utils/map.h"
+#include "utils/string.h"
+
+#include <stdlib.h>
+
+static Map *symbol_ids = NULL;
+
+// The interned names, indexed by their symbols
+static String **symbol_names = NULL;
+
+static size_t symbols_len = 0;
+
+static size_t symbols_alloc = 0;
+
+#define SYMBOLS_INIT_ALLOC 64
+
+Symbol intern_symbol(const String *name) {
+    Symbol sym = lookup_symbol(name);
+    if (sym != NO_SYMBOL) {
+        return sym;
+    }
+
+    if (symbol_ids == NULL) {
+        symbol_ids = new_map(STRING_HASH_OPS, SIZE_T_COPY_OPS);
+    }
+
+    if (symbols_len == symbols_alloc) {
+        symbols_alloc = symbols_alloc == 0 ? SYMBOLS_INIT_ALLOC : symbols_alloc * 2;
+        symbol_names = realloc(symbol_names, sizeof(String *) * symbols_alloc);
+    }
+
+    size_t id = symbols_len;
+    map_set(symbol_ids, name, &id);
+    symbol_names[symbols_len++] = copy_string(name);
+
+    return id;
+}
+
+Symbol lookup_symbol(const String *name) {
+    if (symbol_ids == NULL) {
+        return NO_SYMBOL;
+    }
+
+    const size_t *id = map_get(symbol_ids, name);
+    return id != NULL ? *id : NO_SYMBOL;
+}
+
+const String *symbol_name(Symbol sym) {
+    return symbol_names[sym];
+}
+
+size_t num_symbols(void) {
+    return symbols_len;
+}
+
+void free_symbols(void) {
+    for (size_t i = 0; i < symbols_len; i++) {
+        free_string(symbol_names[i]);
+    }
+
+    if (symbol_ids != NULL) {
+        free_map(symbol_ids);
+        symbol_ids = NULL;
+    }
+
+    free(symbol_names);
+    symbol_names = NULL;
+    symbols_len = 0;
+    symbols_alloc = 0;
+}
@@ -0,0 +1,16 @@
+#ifndef OPTIMIZER_OPTIMIZER_H
+#define OPTIMIZER_OPTIMIZER_H
+
+struct GlassProgram;
+
+// At level 1, constant builtin arithmetic is folded, values that are pushed
+// and then popped straight away are never pushed, and a variable read twice
+// in a row is only looked up once. Level 2 also runs builtins of known
+// classes inline, rather than calling them through their classes. Level 0
+// leaves the program alone.
+//
+// Reading an undefined variable and then dropping its value no longer fails,
+// but otherwise only the stack traces of failing programs change
+void optimize_program(struct GlassProgram *program, int level);
+
+#endif
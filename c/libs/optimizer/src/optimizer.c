@@ -0,0 +1,305 @@
+#include "optimizer/optimizer.h"
+
+#include "analysis/escape.h"
+#include "glasstypes/glass-builders.h"
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-command.h"
+#include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "utils/copy-interface.h"
+#include "utils/list.h"
+#include "utils/map.h"
+#include "utils/set.h"
+#include "utils/string.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The commands of a function while it's being optimized. Loop commands are
+// never part of a rewrite, so the loops are only linked up again at the end
+typedef struct Commands {
+    GlassCommand *cmds;
+
+    size_t len;
+} Commands;
+
+static bool is_local_name(const String *name) {
+    char c = string_get(name, 0);
+    return !isupper(c) && !islower(c);
+}
+
+static bool is_type(const Commands *cmds, size_t index, CommandType type) {
+    return index < cmds->len && cmds->cmds[index].type == type;
+}
+
+// Replaces num_old commands at index with the new ones, of which there can't
+// be more
+static void replace_commands(Commands *cmds, size_t index, size_t num_old, const GlassCommand *new_cmds,
+                             size_t num_new)
+{
+    if (num_new > 0) {
+        memcpy(&cmds->cmds[index], new_cmds, sizeof(GlassCommand) * num_new);
+    }
+    memmove(&cmds->cmds[index + num_new], &cmds->cmds[index + num_old],
+            sizeof(GlassCommand) * (cmds->len - index - num_old));
+    cmds->len -= num_old - num_new;
+}
+
+// Returns the class of the instance that a local always holds wherever it's
+// used, or NULL if that isn't known. That's the case when the local doesn't
+// escape, and it's first given a new instance outside of any loop, which is
+// the only thing ever assigned to it
+static const String *find_local_class(const Commands *cmds, const String *name, const Set *escaped) {
+    if (set_has(escaped, name)) {
+        return NULL;
+    }
+
+    const String *class_name = NULL;
+    int loop_depth = 0;
+
+    for (size_t i = 0; i < cmds->len; i++) {
+        const GlassCommand *cmd = &cmds->cmds[i];
+
+        if (cmd->type == CMD_LOOP_BEGIN) {
+            loop_depth++;
+        }
+        else if (cmd->type == CMD_LOOP_END) {
+            loop_depth--;
+        }
+        else if (cmd->type == CMD_PUSH_NAME && strings_equal(cmd->str, name) && is_type(cmds, i + 2, CMD_NEW_INST)) {
+            if (class_name != NULL || loop_depth > 0) {
+                return NULL;
+            }
+            class_name = cmds->cmds[i + 1].str;
+        }
+        else if (cmd->type == CMD_PUSH_NAME && strings_equal(cmd->str, name) && class_name == NULL) {
+            return NULL;
+        }
+    }
+
+    return class_name;
+}
+
+// Replaces calls like (_a)a.? with the builtin they run, when _a is known to
+// hold an instance of a class whose function just runs a builtin
+static bool inline_builtins(Commands *cmds, const Map *classes, const Set *escaped) {
+    bool changed = false;
+
+    for (size_t i = 0; i + 3 < cmds->len; i++) {
+        const GlassCommand *cmd = &cmds->cmds[i];
+
+        if (cmd->type != CMD_PUSH_NAME || !is_local_name(cmd->str) || !is_type(cmds, i + 1, CMD_PUSH_NAME) ||
+            !is_type(cmds, i + 2, CMD_GET_FUNC) || !is_type(cmds, i + 3, CMD_EXECUTE_FUNC)) {
+            continue;
+        }
+
+        const String *class_name = find_local_class(cmds, cmd->str, escaped);
+        const GlassClass *gclass = class_name != NULL ? map_get(classes, class_name) : NULL;
+        const GlassFunction *func = gclass != NULL ? class_get_func(gclass, cmds->cmds[i + 1].str) : NULL;
+
+        if (func != NULL && func_len(func) == 1 && func_get_command(func, 0)->type == CMD_BUILTIN &&
+            !builtin_uses_instance(func_get_command(func, 0)->builtin)) {
+            GlassCommand builtin = *func_get_command(func, 0);
+            builtin.pos = cmds->cmds[i + 3].pos;
+
+            replace_commands(cmds, i, 4, &builtin, 1);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// Computes a builtin on constant operands, returning false if it can't be
+// folded. num1 was pushed first
+static bool fold_math(BuiltinFunc builtin, double num1, double num2, double *result) {
+    switch (builtin) {
+        case BUILTIN_MATH_ADD: *result = num1 + num2; return true;
+        case BUILTIN_MATH_DIVIDE: *result = num1 / num2; return true;
+        case BUILTIN_MATH_EQUAL: *result = num1 == num2 ? 1.0 : 0.0; return true;
+        case BUILTIN_MATH_GREATER_OR_EQUAL: *result = num1 >= num2 ? 1.0 : 0.0; return true;
+        case BUILTIN_MATH_GREATER_THAN: *result = num1 > num2 ? 1.0 : 0.0; return true;
+        case BUILTIN_MATH_LESS_OR_EQUAL: *result = num1 <= num2 ? 1.0 : 0.0; return true;
+        case BUILTIN_MATH_LESS_THAN: *result = num1 < num2 ? 1.0 : 0.0; return true;
+        case BUILTIN_MATH_MODULO: *result = fmod(num1, num2); return true;
+        case BUILTIN_MATH_MULTIPLY: *result = num1 * num2; return true;
+        case BUILTIN_MATH_NOT_EQUAL: *result = num1 != num2 ? 1.0 : 0.0; return true;
+        case BUILTIN_MATH_SUBTRACT: *result = num1 - num2; return true;
+        default: return false;
+    }
+}
+
+static bool fold_constants(Commands *cmds) {
+    bool changed = false;
+    size_t i = 0;
+
+    while (i + 1 < cmds->len) {
+        const GlassCommand *cmd = &cmds->cmds[i];
+        GlassCommand folded = {.type = CMD_PUSH_NUM};
+
+        if (cmd->type != CMD_PUSH_NUM) {
+            i++;
+            continue;
+        }
+
+        if (is_type(cmds, i + 1, CMD_BUILTIN) && cmds->cmds[i + 1].builtin == BUILTIN_MATH_FLOOR) {
+            folded.pos = cmds->cmds[i + 1].pos;
+            folded.number = floor(cmd->number);
+            replace_commands(cmds, i, 2, &folded, 1);
+            changed = true;
+        }
+        else if (is_type(cmds, i + 1, CMD_PUSH_NUM) && is_type(cmds, i + 2, CMD_BUILTIN) &&
+                 fold_math(cmds->cmds[i + 2].builtin, cmd->number, cmds->cmds[i + 1].number, &folded.number)) {
+            folded.pos = cmds->cmds[i + 2].pos;
+            replace_commands(cmds, i, 3, &folded, 1);
+            changed = true;
+        }
+        else {
+            i++;
+            continue;
+        }
+
+        // The folded number could be the second operand of another builtin
+        i = i > 0 ? i - 1 : 0;
+    }
+
+    return changed;
+}
+
+// Drops pushes that are popped again straight away, along with the pops
+static bool remove_dead_pushes(Commands *cmds) {
+    bool changed = false;
+    size_t i = 0;
+
+    while (i + 1 < cmds->len) {
+        CommandType type = cmds->cmds[i].type;
+        size_t num_pushes = 0;
+
+        if ((type == CMD_PUSH_NUM || type == CMD_PUSH_STR || type == CMD_PUSH_NAME || type == CMD_DUPLICATE) &&
+            is_type(cmds, i + 1, CMD_POP_STACK))
+        {
+            num_pushes = 1;
+        }
+        else if (type == CMD_PUSH_NAME && is_type(cmds, i + 1, CMD_GET_VAL) && is_type(cmds, i + 2, CMD_POP_STACK)) {
+            num_pushes = 2;
+        }
+
+        if (num_pushes > 0) {
+            replace_commands(cmds, i, num_pushes + 1, NULL, 0);
+            changed = true;
+
+            // Removing them can leave another push right before a pop
+            i = i > 2 ? i - 2 : 0;
+        }
+        else {
+            i++;
+        }
+    }
+
+    return changed;
+}
+
+// Replaces the second of two reads of the same variable in a row with a
+// duplicate of the first
+static bool remove_redundant_loads(Commands *cmds) {
+    bool changed = false;
+
+    for (size_t i = 0; i + 3 < cmds->len; i++) {
+        const GlassCommand *cmd = &cmds->cmds[i];
+
+        if (cmd->type == CMD_PUSH_NAME && is_type(cmds, i + 1, CMD_GET_VAL) && is_type(cmds, i + 2, CMD_PUSH_NAME) &&
+            is_type(cmds, i + 3, CMD_GET_VAL) && strings_equal(cmd->str, cmds->cmds[i + 2].str))
+        {
+            GlassCommand dup = {.type = CMD_DUPLICATE, .pos = cmds->cmds[i + 3].pos};
+            dup.str = NULL;
+            dup.index = 0;
+
+            replace_commands(cmds, i + 2, 2, &dup, 1);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+static void link_loops(Commands *cmds) {
+    List *loop_starts = new_list(SIZE_T_COPY_OPS);
+
+    for (size_t i = 0; i < cmds->len; i++) {
+        if (cmds->cmds[i].type == CMD_LOOP_BEGIN) {
+            list_add(loop_starts, &i);
+        }
+        else if (cmds->cmds[i].type == CMD_LOOP_END) {
+            size_t *start = list_pop(loop_starts);
+            cmds->cmds[*start].index = i;
+            cmds->cmds[i].index = *start;
+            free(start);
+        }
+    }
+
+    free_list(loop_starts);
+}
+
+static void optimize_function(GlassFunction *func, const Map *classes, const Set *escaped, int level) {
+    Commands cmds = {
+        .cmds = malloc(sizeof(GlassCommand) * (func_len(func) + 1)),
+        .len = func_len(func),
+    };
+    memcpy(cmds.cmds, func_get_command(func, 0), sizeof(GlassCommand) * cmds.len);
+
+    bool changed = false;
+
+    if (level >= 2) {
+        changed |= inline_builtins(&cmds, classes, escaped);
+    }
+
+    // Folding constants can leave dead pushes, and removing those can leave
+    // more constants to fold
+    bool pass_changed;
+    do {
+        pass_changed = fold_constants(&cmds);
+        pass_changed |= remove_dead_pushes(&cmds);
+        pass_changed |= remove_redundant_loads(&cmds);
+        changed |= pass_changed;
+    } while (pass_changed);
+
+    if (changed) {
+        link_loops(&cmds);
+        func_replace_commands(func, cmds.cmds, cmds.len);
+    }
+
+    free(cmds.cmds);
+}
+
+void optimize_program(GlassProgram *program, int level) {
+    if (level <= 0) {
+        return;
+    }
+
+    const Map *classes = program_get_classes(program);
+    Set *escaped = level >= 2 ? get_escaped_locals(classes) : NULL;
+    List *class_names = map_get_keys(classes);
+
+    for (size_t i = 0; i < list_len(class_names); i++) {
+        const GlassClass *gclass = map_get(classes, list_get(class_names, i));
+        List *func_names = class_get_func_names(gclass);
+
+        for (size_t j = 0; j < list_len(func_names); j++) {
+            // The program owns its functions, so they can be changed through it
+            GlassFunction *func = (GlassFunction *) class_get_func(gclass, list_get(func_names, j));
+
+            if (func != NULL && func_len(func) > 0) {
+                optimize_function(func, classes, escaped, level);
+            }
+        }
+
+        free_list(func_names);
+    }
+
+    free_list(class_names);
+    if (escaped != NULL) {
+        free_set(escaped);
+    }
+}
@@ -0,0 +1,121 @@
+#include "optimizer/optimizer.h"
+#include "glasstypes/glass-class.h"
+#include "glasstypes/glass-command.h"
+#include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "test/test-program.h"
+#include "test/test.h"
+#include "utils/map.h"
+#include "utils/string.h"
+
+#include <math.h>
+
+// Returns M.m of the program, optimized at the given level
+const GlassFunction *optimize_main(GlassProgram *program, int level) {
+    optimize_program(program, level);
+
+    String *class_name = string_from_char('M');
+    String *func_name = string_from_char('m');
+    const GlassFunction *func = class_get_func(map_get(program_get_classes(program), class_name), func_name);
+    free_string(class_name);
+    free_string(func_name);
+
+    return func;
+}
+
+CommandType cmd_type(const GlassFunction *func, size_t index) {
+    return func_get_command(func, index)->type;
+}
+
+int main() {
+    const char *arith = "{M[m(_a)A!(_o)O!<1><2>(_a)a.?<4>(_a)m.?(_o)(on).?]}";
+
+    // Builtins are only run inline at level 2, and constants can only be
+    // folded once they are
+    GlassProgram *program = parse_test_program(arith, true);
+    if (ASSERT_NOT_NULL(program)) {
+        const GlassFunction *func = optimize_main(program, 1);
+        ASSERT_EQUAL(func_len(func), 21);
+        free_glass_program(program);
+    }
+
+    program = parse_test_program(arith, true);
+    if (ASSERT_NOT_NULL(program)) {
+        const GlassFunction *func = optimize_main(program, 2);
+        if (ASSERT_EQUAL(func_len(func), 8)) {
+            ASSERT_EQUAL(cmd_type(func, 6), CMD_PUSH_NUM);
+            ASSERT_EQUAL(func_get_command(func, 6)->number, 12.0);
+            ASSERT_EQUAL(cmd_type(func, 7), CMD_BUILTIN);
+            ASSERT_EQUAL(func_get_command(func, 7)->builtin, BUILTIN_OUTPUT_NUM);
+        }
+        free_glass_program(program);
+    }
+
+    // Folding can give infinities and negative zero
+    program = parse_test_program("{M[m(_a)A!(_o)O!<7><0>(_a)d.?(_o)(on).?<0><-1>(_a)m.?(_o)(on).?]}", true);
+    if (ASSERT_NOT_NULL(program)) {
+        const GlassFunction *func = optimize_main(program, 2);
+        if (ASSERT_EQUAL(func_len(func), 10)) {
+            ASSERT_EQUAL(cmd_type(func, 6), CMD_PUSH_NUM);
+            ASSERT_TRUE(isinf(func_get_command(func, 6)->number));
+            ASSERT_EQUAL(cmd_type(func, 8), CMD_PUSH_NUM);
+            ASSERT_EQUAL(func_get_command(func, 8)->number, 0.0);
+            ASSERT_TRUE(signbit(func_get_command(func, 8)->number));
+        }
+        free_glass_program(program);
+    }
+
+    // Locals that escape could be set to anything
+    program = parse_test_program("{M[m(_a)A!<1><2>(_a)a.?(_a)(_b)1=,]}", true);
+    if (ASSERT_NOT_NULL(program)) {
+        const GlassFunction *func = optimize_main(program, 2);
+        ASSERT_EQUAL(func_len(func), 14);
+        free_glass_program(program);
+    }
+
+    // Dead pushes and pops, including ones left behind by removing others
+    program = parse_test_program("{M[m<1>,\"s\",(_x)*,(x)0,,(_y)<2>=]}", true);
+    if (ASSERT_NOT_NULL(program)) {
+        const GlassFunction *func = optimize_main(program, 1);
+        if (ASSERT_EQUAL(func_len(func), 3)) {
+            ASSERT_EQUAL(cmd_type(func, 0), CMD_PUSH_NAME);
+            ASSERT_EQUAL(cmd_type(func, 2), CMD_ASSIGN_VAL);
+        }
+        free_glass_program(program);
+    }
+
+    // Reading a variable twice in a row
+    program = parse_test_program("{M[m(_x)<2>=(_x)*(_x)*(_y)1=,,]}", true);
+    if (ASSERT_NOT_NULL(program)) {
+        const GlassFunction *func = optimize_main(program, 1);
+        if (ASSERT_EQUAL(func_len(func), 11)) {
+            ASSERT_EQUAL(cmd_type(func, 4), CMD_GET_VAL);
+            ASSERT_EQUAL(cmd_type(func, 5), CMD_DUPLICATE);
+            ASSERT_EQUAL(func_get_command(func, 5)->index, 0);
+        }
+        free_glass_program(program);
+    }
+
+    // Loops are linked up again after commands are removed
+    program = parse_test_program("{M[m(_c)<1>=/(_c)<1>,(_c)<0>=\\<2>,]}", true);
+    if (ASSERT_NOT_NULL(program)) {
+        const GlassFunction *func = optimize_main(program, 1);
+        if (ASSERT_EQUAL(func_len(func), 8)) {
+            ASSERT_EQUAL(cmd_type(func, 3), CMD_LOOP_BEGIN);
+            ASSERT_EQUAL(func_get_command(func, 3)->index, 7);
+            ASSERT_EQUAL(cmd_type(func, 7), CMD_LOOP_END);
+            ASSERT_EQUAL(func_get_command(func, 7)->index, 3);
+        }
+        free_glass_program(program);
+    }
+
+    // Level 0 leaves everything alone
+    program = parse_test_program("{M[m<1>,]}", true);
+    if (ASSERT_NOT_NULL(program)) {
+        const GlassFunction *func = optimize_main(program, 0);
+        ASSERT_EQUAL(func_len(func), 2);
+        free_glass_program(program);
+    }
+
+    return test_status();
+}
@@ -3,16 +3,25 @@
 
 #include <stdbool.h>
 
+struct GlassProgram;
 struct GlassProgramBuilder;
+struct LazyParser;
 struct List;
-struct Map;
 struct Stream;
 
 bool parse_classes(struct GlassProgramBuilder *builder,
                    struct Stream *stream);
 
-struct Map *classes_from_files(struct List *filenames,
-                               bool include_builtins,
-                               bool resolve_inheritance);
+// Parses and scans the bodies of functions that classes_from_files only
+// skimmed, including ones read back from a program cache
+extern const struct LazyParser *GLASS_LAZY_PARSER;
+
+// Parses the files into a program. With lazy_bodies, function bodies are only
+// skimmed, and each one is parsed the first time it's used, so syntax errors
+// in functions that are never called go unreported
+struct GlassProgram *classes_from_files(struct List *filenames,
+                                        bool include_builtins,
+                                        bool resolve_inheritance,
+                                        bool lazy_bodies);
 
 #endif
@@ -1,53 +1,86 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "parser/parser.h"
 #include "glasstypes/glass-builders.h"
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-command.h"
 #include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "glasstypes/glass-source.h"
+#include "utils/arena.h"
 #include "utils/list.h"
 #include "utils/map.h"
+#include "utils/scan.h"
 #include "utils/stream.h"
 #include "utils/string.h"
 
 #include <assert.h>
 #include <math.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+// Where errors get written while parsing. Files parsed by the worker threads
+// in classes_from_files buffer their errors here, so that they can be output
+// in file order once every file has been parsed
+static _Thread_local FILE *error_out = NULL;
 
 void parser_error(const Stream *stream, const char *msg, ...) {
+    FILE *out = error_out != NULL ? error_out : stderr;
     String *name = copy_string(stream_get_name(stream));
 
-    fprintf(stderr, "Error in %s on line %u, column %u:\n    ",
-                    string_get_c_str(name),
-                    stream_get_line(stream),
-                    stream_get_col(stream));
+    fprintf(out, "Error in %s on line %u, column %u:\n    ",
+                 string_get_c_str(name),
+                 stream_get_line(stream),
+                 stream_get_col(stream));
     
     va_list args;
     va_start(args, msg);
-    vfprintf(stderr, msg, args);
+    vfprintf(out, msg, args);
     va_end(args);
 
-    fprintf(stderr, "\n");
+    fprintf(out, "\n");
+    free_string(name);
 }
 
-static bool skip_whitespace(Stream *stream) {
-    while (!stream_ended(stream)) {
-        char c = stream_get_char(stream);
-
-        // Skip over comments
-        if (c == '\'') {
-            do {
-                c = stream_get_char(stream);
-            } while (c != '\'' && !stream_ended(stream));
-        }
-        else if (!isspace(c)) {
-            stream_unget(stream);
-            return true;
+// Returns the index of the first char that isn't whitespace or in a comment
+static size_t skip_blank_chars(const char *chars, size_t len) {
+    size_t i = scan_skip_space(chars, len);
+
+    // Skip over comments, and any whitespace following them
+    while (i < len && chars[i] == '\'') {
+        i++;
+        i += scan_find_char(chars + i, len - i, '\'');
+        if (i < len) {
+            i++;
+            i += scan_skip_space(chars + i, len - i);
         }
     }
 
-    return false;
+    return i;
+}
+
+static bool skip_whitespace(Stream *stream) {
+    size_t len;
+    const char *chars = stream_peek(stream, &len);
+    size_t i = skip_blank_chars(chars, len);
+
+    stream_skip(stream, i);
+    return i < len;
+}
+
+// Reads the rest of a name whose first char has already been read, stopping
+// at the first char which can't be part of a name
+static void add_name_chars(Stream *stream, String *name) {
+    size_t len;
+    const char *chars = stream_peek(stream, &len);
+    size_t end = scan_name_end(chars, len);
+
+    string_add_buf(name, chars, end);
+    stream_skip(stream, end);
 }
 
 static String *parse_name(Stream *stream) {
@@ -61,17 +94,15 @@ static String *parse_name(Stream *stream) {
     }
     else if (c == '(') {
         String *name = new_string();
+        add_name_chars(stream, name);
 
-        c = stream_get_char(stream);
-
-        while (!stream_ended(stream) && c != ')') {
-            if (!isalnum(c) && c != '_') {
+        if (!stream_ended(stream)) {
+            c = stream_get_char(stream);
+            if (c != ')') {
                 parser_error(stream, "Invalid char '%c' encountered in the middle of a name.", c);
                 free_string(name);
                 return NULL;
             }
-            string_add_char(name, c);
-            c = stream_get_char(stream);
         }
 
         return name;
@@ -93,19 +124,17 @@ static bool parse_parenthesized(Stream *stream, GlassCommand *cmd) {
     if (isalpha(c) || c == '_') {
         cmd->type = CMD_PUSH_NAME;
         cmd->str = string_from_char(c);
+        add_name_chars(stream, cmd->str);
 
-        c = stream_get_char(stream);
-        while (c != ')' && !stream_ended(stream)) {
-            if (!isalnum(c) && c != '_') {
-                parser_error(stream, "Unexpected '%c' encountered while parsing name.", c);
-                return true;
-            }
-            string_add_char(cmd->str, c);
-            c = stream_get_char(stream);
+        if (stream_ended(stream)) {
+            parser_error(stream, "File ended unexpectedly while parsing name.");
+            free_string(cmd->str);
+            return true;
         }
 
+        c = stream_get_char(stream);
         if (c != ')') {
-            parser_error(stream, "File ended unexpectedly while parsing name.");
+            parser_error(stream, "Unexpected '%c' encountered while parsing name.", c);
             free_string(cmd->str);
             return true;
         }
@@ -146,33 +175,40 @@ static bool parse_quoted(Stream *stream, GlassCommand *cmd) {
     cmd->type = CMD_PUSH_STR;
     cmd->str = new_string();
 
-    c = stream_get_char(stream);
-    while (c != '"' && !stream_ended(stream)) {
-        if (c == '\\') {
-            if (stream_ended(stream)) {
-                parser_error(stream, "File ended uexpectedly in the middle of a string!");
-                free_string(cmd->str);
-                return true;
-            }
-            c = stream_get_char(stream);
-            switch (c) {
-                case 'n': c = '\n'; break;
-                case 't': c = '\t'; break;
-                case 'r': c = '\r'; break;
-                default: break;
-            }
+    while (true) {
+        // Copy everything up to the next quote or escape in one go
+        size_t len;
+        const char *chars = stream_peek(stream, &len);
+        size_t end = scan_find_either(chars, len, '"', '\\');
+
+        string_add_buf(cmd->str, chars, end);
+        stream_skip(stream, end);
+
+        if (end == len) {
+            break;
         }
-        string_add_char(cmd->str, c);
+
         c = stream_get_char(stream);
-    }
+        if (c == '"') {
+            return false;
+        }
 
-    if (c != '"') {
-        parser_error(stream, "File ended uexpectedly in the middle of a string!");
-        free_string(cmd->str);
-        return true;
+        if (stream_ended(stream)) {
+            break;
+        }
+        c = stream_get_char(stream);
+        switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            default: break;
+        }
+        string_add_char(cmd->str, c);
     }
 
-    return false;
+    parser_error(stream, "File ended uexpectedly in the middle of a string!");
+    free_string(cmd->str);
+    return true;
 }
 
 static bool parse_angled(Stream *stream, GlassCommand *cmd) {
@@ -180,48 +216,39 @@ static bool parse_angled(Stream *stream, GlassCommand *cmd) {
 
     assert(c == '<');
 
-    String *num_str = new_string();
     cmd->type = CMD_PUSH_NUM;
-    
-    c = stream_get_char(stream);
-    while (c != '>' && !stream_ended(stream)) {
-        string_add_char(num_str, c);
-        c = stream_get_char(stream);
-    }
 
-    if (c != '>') {
-        free_string(num_str);
+    size_t len;
+    const char *chars = stream_peek(stream, &len);
+    size_t end = scan_find_char(chars, len, '>');
+
+    if (end == len) {
+        stream_skip(stream, len);
         return true;
     }
 
+    String *num_str = string_from_buf(chars, end);
+    stream_skip(stream, end + 1);
+
     cmd->number = atof(string_get_c_str(num_str));
     free_string(num_str);
 
     return false;
 }
 
-static GlassFunction *parse_function(Stream *stream) {
-    char c = stream_get_char(stream);
-    assert(c == '[');
-
-    unsigned line = stream_get_line(stream);
-    unsigned col = stream_get_col(stream);
-
-    String *name = parse_name(stream);
-    if (name == NULL) {
-        return NULL;
-    }
-
-    GlassFuncBuilder *builder = new_func_builder(name, stream_get_name(stream), line, col);
-    free_string(name);
+// Returns the source position of the last char read from the stream
+static SourcePos last_char_pos(const Stream *stream, SourcePos base) {
+    return base + stream_get_offset(stream) - 1;
+}
 
+// Parses the commands of a function body, up to and including the ']' that
+// ends it
+static bool parse_function_body(Stream *stream, SourcePos base, GlassFuncBuilder *builder) {
     skip_whitespace(stream);
-    c = stream_get_char(stream);
+    char c = stream_get_char(stream);
     while (!stream_ended(stream) && c != ']') {
         GlassCommand cmd;
-        cmd.filename = copy_string(stream_get_name(stream));
-        cmd.line = stream_get_line(stream);
-        cmd.col = stream_get_col(stream);
+        cmd.pos = last_char_pos(stream, base);
 
         switch (c) {
             case '.':
@@ -251,30 +278,26 @@ static GlassFunction *parse_function(Stream *stream) {
             case '(':
                 stream_unget(stream);
                 if (parse_parenthesized(stream, &cmd)) {
-                    free_func_builder(builder);
-                    return NULL;
+                    return true;
                 }
                 break;
             case '"':
                 stream_unget(stream);
                 if (parse_quoted(stream, &cmd)) {
-                    free_func_builder(builder);
-                    return NULL;
+                    return true;
                 }
                 break;
             case '<':
                 stream_unget(stream);
                 if (parse_angled(stream, &cmd)) {
-                    free_func_builder(builder);
-                    return NULL;
+                    return true;
                 }
                 break;
             case '/':
                 cmd.type = CMD_LOOP_BEGIN;
                 cmd.str = parse_name(stream);
                 if (cmd.str == NULL) {
-                    free_func_builder(builder);
-                    return NULL;
+                    return true;
                 }
                 break;
             case '\\':
@@ -291,8 +314,7 @@ static GlassFunction *parse_function(Stream *stream) {
                 }
                 else {
                     parser_error(stream, "Invalid char %c encountered!", c);
-                    free_func_builder(builder);
-                    return NULL;
+                    return true;
                 }
                 break;
         }
@@ -302,46 +324,194 @@ static GlassFunction *parse_function(Stream *stream) {
             // that doesn't match with a loop beginning, so we can put this error
             // message here
             parser_error(stream, "Encountered a '\\' without a matching '/'.");
-            return NULL;
+            return true;
         }
 
         if (cmd.type == CMD_PUSH_NAME  || cmd.type == CMD_PUSH_STR || cmd.type == CMD_LOOP_BEGIN) {
             free_string(cmd.str);
         }
 
-        free_string(cmd.filename);
-
         skip_whitespace(stream);
         c = stream_get_char(stream);
     }
 
     if (c != ']') {
-        free_func_builder(builder);
-        return NULL;
+        parser_error(stream, "File ended before the function was closed.");
+        return true;
     }
 
-    GlassFunction *func = build_glass_function(builder);
-    if (func == NULL) {
-        // The only way the building can fail is if there's a unclosed loop
+    if (builder_in_loop(builder)) {
         parser_error(stream, "Loop not closed before function ended!");
+        return true;
     }
+
+    return false;
+}
+
+static bool parse_lazy_body(GlassFuncBuilder *builder, Stream *stream, SourcePos base, size_t offset) {
+    stream_seek(stream, offset);
+    return parse_function_body(stream, base, builder);
+}
+
+// Moves past the ']' ending a function body without parsing the commands in
+// it. Strings, comments and numbers are skipped over whole, since they can
+// contain ']'s of their own
+static bool skim_function_body(Stream *stream) {
+    size_t len;
+    const char *chars = stream_peek(stream, &len);
+    size_t i = 0;
+
+    while (i < len) {
+        i += scan_find_any(chars + i, len - i, "]\"'<");
+        if (i == len) {
+            break;
+        }
+
+        char c = chars[i++];
+        if (c == ']') {
+            stream_skip(stream, i);
+            return false;
+        }
+        else if (c == '"') {
+            // Escaped chars are skipped too, since they can be quotes
+            i += scan_find_either(chars + i, len - i, '"', '\\');
+            while (i + 1 < len && chars[i] == '\\') {
+                i += 2;
+                i += scan_find_either(chars + i, len - i, '"', '\\');
+            }
+            i++;
+        }
+        else {
+            i += scan_find_char(chars + i, len - i, c == '<' ? '>' : '\'');
+            i++;
+        }
+    }
+
+    stream_skip(stream, len);
+    parser_error(stream, "File ended before the function was closed.");
+    return true;
+}
+
+// Returns the index just past the first occurrence of c, or len if there's
+// none
+static size_t skip_past_char(const char *chars, size_t len, char c) {
+    size_t i = scan_find_char(chars, len, c);
+    return i < len ? i + 1 : len;
+}
+
+// Visits the names in a function body that's only been skimmed. Invalid
+// commands are skipped over rather than reported, since that happens once
+// the body gets parsed
+static void scan_lazy_body(Stream *stream, size_t offset, FuncNameVisitor visit, void *data) {
+    stream_seek(stream, offset);
+
+    size_t len;
+    const char *chars = stream_peek(stream, &len);
+    size_t i = skip_blank_chars(chars, len);
+
+    while (i < len && chars[i] != ']') {
+        char c = chars[i++];
+        size_t name_start = i - 1, name_len = 0;
+        bool is_loop = false;
+
+        if (c == '/') {
+            is_loop = true;
+            i += skip_blank_chars(chars + i, len - i);
+            if (i < len && isalpha(chars[i])) {
+                name_start = i++;
+                name_len = 1;
+            }
+            else if (i < len && chars[i] == '(') {
+                name_start = ++i;
+                name_len = scan_name_end(chars + i, len - i);
+                i += skip_past_char(chars + i, len - i, ')');
+            }
+        }
+        else if (c == '(') {
+            if (i < len && (isalpha(chars[i]) || chars[i] == '_')) {
+                name_start = i;
+                name_len = scan_name_end(chars + i, len - i);
+            }
+            i += skip_past_char(chars + i, len - i, ')');
+        }
+        else if (c == '"') {
+            // Escaped chars are skipped too, since they can be quotes
+            i += scan_find_either(chars + i, len - i, '"', '\\');
+            while (i + 1 < len && chars[i] == '\\') {
+                i += 2;
+                i += scan_find_either(chars + i, len - i, '"', '\\');
+            }
+            i += i < len;
+        }
+        else if (c == '<') {
+            i += skip_past_char(chars + i, len - i, '>');
+        }
+        else if (isalpha(c)) {
+            name_len = 1;
+        }
+
+        if (name_len > 0) {
+            String *name = string_from_buf(chars + name_start, name_len);
+            visit(name, is_loop, data);
+            free_string(name);
+        }
+        else {
+            visit(NULL, false, data);
+        }
+
+        i += skip_blank_chars(chars + i, len - i);
+    }
+}
+
+const LazyParser *GLASS_LAZY_PARSER = &(LazyParser) {
+    parse_lazy_body,
+    scan_lazy_body,
+};
+
+// Parses a function. If a lazy source is given, the body is only skimmed, and
+// gets parsed from the source once the function is first used
+static GlassFunction *parse_function(Stream *stream, SourcePos base, Arena *arena, LazySource *lazy) {
+    char c = stream_get_char(stream);
+    assert(c == '[');
+
+    SourcePos pos = last_char_pos(stream, base);
+
+    String *name = parse_name(stream);
+    if (name == NULL) {
+        return NULL;
+    }
+
+    GlassFuncBuilder *builder = new_func_builder(arena, name, pos);
+    free_string(name);
+
+    GlassFunction *func = NULL;
+
+    if (lazy != NULL) {
+        size_t offset = stream_get_offset(stream);
+        if (!skim_function_body(stream)) {
+            func = build_lazy_function(builder, lazy, offset);
+        }
+    }
+    else if (!parse_function_body(stream, base, builder)) {
+        func = build_glass_function(builder);
+    }
+
     free_func_builder(builder);
     return func;
 }
 
-static GlassClassBuilder *parse_class(Stream *stream) {
+static GlassClassBuilder *parse_class(Stream *stream, SourcePos base, Arena *arena, LazySource *lazy) {
     char c = stream_get_char(stream);
     assert(c == '{');
 
-    unsigned line = stream_get_line(stream);
-    unsigned col = stream_get_col(stream);
+    SourcePos pos = last_char_pos(stream, base);
 
     String *name = parse_name(stream);
     if (name == NULL) {
         return NULL;
     }
 
-    GlassClassBuilder *builder = new_class_builder(name, stream_get_name(stream), line, col);
+    GlassClassBuilder *builder = new_class_builder(arena, name, pos);
     free_string(name);
 
     skip_whitespace(stream);
@@ -349,13 +519,12 @@ static GlassClassBuilder *parse_class(Stream *stream) {
     while (!stream_ended(stream) && c != '}') {
         if (c == '[') {
             stream_unget(stream);
-            GlassFunction *func = parse_function(stream);
+            GlassFunction *func = parse_function(stream, base, arena, lazy);
             if (func == NULL) {
                 free_class_builder(builder);
                 return NULL;
             }
             builder_add_func(builder, func);
-            free_glass_func(func);
         }
         else if (c == '(') {
             stream_unget(stream);
@@ -385,17 +554,16 @@ static GlassClassBuilder *parse_class(Stream *stream) {
     return builder;
 }
 
-bool parse_classes(GlassProgramBuilder *builder, Stream *stream) {
+static bool parse_source(GlassProgramBuilder *builder, Stream *stream, SourcePos base, LazySource *lazy) {
     while (skip_whitespace(stream)) {
         char c = stream_get_char(stream);
         if (c == '{') {
             stream_unget(stream);
-            GlassClassBuilder *gclass = parse_class(stream);
+            GlassClassBuilder *gclass = parse_class(stream, base, builder_get_arena(builder), lazy);
             if (gclass == NULL) {
                 return true;
             }
             builder_add_class(builder, gclass);
-            free_class_builder(gclass);
         }
         else {
             parser_error(stream, "Unexpected char '%c' encountered when expecting '{'.", c);
@@ -406,41 +574,222 @@ bool parse_classes(GlassProgramBuilder *builder, Stream *stream) {
     return false;
 }
 
-Map *classes_from_files(List *filenames,
+bool parse_classes(GlassProgramBuilder *builder, Stream *stream) {
+    SourcePos base = register_source(stream);
+    if (base == NO_SOURCE_POS) {
+        parser_error(stream, "The program's source files are too large.");
+        return true;
+    }
+
+    return parse_source(builder, stream, base, NULL);
+}
+
+typedef struct ParseJob {
+    Stream *stream;
+
+    SourcePos base;
+
+    GlassProgramBuilder *builder;
+
+    // Set when function bodies are parsed lazily, in which case the builder
+    // owns the stream
+    LazySource *lazy;
+
+    char *errors;
+
+    size_t errors_len;
+
+    bool failed;
+} ParseJob;
+
+typedef struct ParseQueue {
+    ParseJob *jobs;
+
+    size_t num_jobs;
+
+    size_t next_job;
+
+    // Index of the first job that failed, or num_jobs if none have yet. Jobs
+    // after this one are skipped, since their errors would never be shown
+    size_t first_failed;
+
+    pthread_mutex_t lock;
+} ParseQueue;
+
+static void run_parse_job(ParseJob *job) {
+    error_out = open_memstream(&job->errors, &job->errors_len);
+
+    job->failed = parse_source(job->builder, job->stream, job->base, job->lazy);
+
+    if (error_out != NULL) {
+        fclose(error_out);
+        error_out = NULL;
+    }
+}
+
+static void *parse_worker(void *arg) {
+    ParseQueue *queue = arg;
+
+    while (true) {
+        pthread_mutex_lock(&queue->lock);
+        size_t idx = queue->next_job++;
+        bool skip = idx > queue->first_failed;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (idx >= queue->num_jobs) {
+            break;
+        }
+        else if (skip) {
+            continue;
+        }
+
+        ParseJob *job = &queue->jobs[idx];
+        run_parse_job(job);
+
+        if (job->failed) {
+            pthread_mutex_lock(&queue->lock);
+            if (idx < queue->first_failed) {
+                queue->first_failed = idx;
+            }
+            pthread_mutex_unlock(&queue->lock);
+        }
+    }
+
+    return NULL;
+}
+
+// Parses every job, using up to one thread per online processor
+static void run_parse_jobs(ParseJob *jobs, size_t num_jobs) {
+    ParseQueue queue = {
+        .jobs = jobs,
+        .num_jobs = num_jobs,
+        .next_job = 0,
+        .first_failed = num_jobs,
+    };
+
+    if (num_jobs <= 1) {
+        parse_worker(&queue);
+        return;
+    }
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = num_cpus > 1 ? (size_t) num_cpus : 1;
+    if (num_threads > num_jobs) {
+        num_threads = num_jobs;
+    }
+
+    pthread_mutex_init(&queue.lock, NULL);
+
+    // The calling thread works through the queue too, so it needs one less
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    size_t num_started = 0;
+    while (num_started < num_threads - 1) {
+        if (pthread_create(&threads[num_started], NULL, parse_worker, &queue) != 0) {
+            break;
+        }
+        num_started++;
+    }
+
+    parse_worker(&queue);
+
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&queue.lock);
+}
+
+GlassProgram *classes_from_files(List *filenames,
                         bool include_builtins,
-                        bool resolve_inheritance)
+                        bool resolve_inheritance,
+                        bool lazy_bodies)
 {
+    size_t num_files = list_len(filenames);
+    ParseJob *jobs = calloc(num_files + 1, sizeof(ParseJob));
+
+    // Sources are registered up front in file order, so that source positions
+    // don't depend on how the files get scheduled between threads
+    size_t num_opened = 0;
+    bool too_large = false;
+    while (num_opened < num_files) {
+        Stream *file_stream = stream_from_path(list_get(filenames, num_opened));
+        if (file_stream == NULL) {
+            break;
+        }
+
+        SourcePos base = register_source(file_stream);
+        if (base == NO_SOURCE_POS) {
+            free_stream(file_stream);
+            too_large = true;
+            break;
+        }
+
+        ParseJob *job = &jobs[num_opened];
+        job->stream = file_stream;
+        job->base = base;
+        job->builder = new_program_builder();
+        if (lazy_bodies) {
+            job->lazy = builder_add_lazy_source(job->builder, file_stream, job->base, GLASS_LAZY_PARSER);
+        }
+        num_opened++;
+    }
+
+    run_parse_jobs(jobs, num_opened);
+
     GlassProgramBuilder *builder = new_program_builder();
 
     if (include_builtins) {
         add_builtin_classes(builder);
     }
 
-    for (size_t i = 0; i < list_len(filenames); i++) {
-        String *filename = list_get_mutable(filenames, i);
-        FILE *fp = fopen(string_get_c_str(filename), "r");
+    // Stop at the first file that failed, like parsing the files one at a
+    // time would have
+    bool failed = false;
+    for (size_t i = 0; i < num_opened; i++) {
+        ParseJob *job = &jobs[i];
 
-        if (fp == NULL) {
-            fprintf(stderr, "Unable to open %s!\n", string_get_c_str(filename));
-            free_program_builder(builder);
-            return NULL;
-        }
+        if (!failed) {
+            if (job->errors != NULL) {
+                fwrite(job->errors, 1, job->errors_len, stderr);
+            }
 
-        Stream *file_stream = stream_from_file(fp);
-        stream_set_name(file_stream, filename);
-        fclose(fp);
+            if (job->failed) {
+                failed = true;
+            }
+            else {
+                builder_merge(builder, job->builder);
+            }
+        }
 
-        bool failed = parse_classes(builder, file_stream);
-        free_stream(file_stream);
+        free(job->errors);
+        free_program_builder(job->builder);
+        if (job->lazy == NULL) {
+            free_stream(job->stream);
+        }
+    }
 
-        if (failed) {
-            free_program_builder(builder);
-            return NULL;
+    if (!failed && num_opened < num_files) {
+        String *filename = list_get_mutable(filenames, num_opened);
+        if (too_large) {
+            fprintf(stderr, "Unable to load %s, the program's source files are too large!\n",
+                    string_get_c_str(filename));
+        }
+        else {
+            fprintf(stderr, "Unable to open %s!\n", string_get_c_str(filename));
         }
+        failed = true;
+    }
+
+    free(jobs);
+
+    if (failed) {
+        free_program_builder(builder);
+        return NULL;
     }
 
-    Map *classes = build_glass_program(builder, resolve_inheritance);
+    GlassProgram *program = build_glass_program(builder, resolve_inheritance);
     free_program_builder(builder);
 
-    return classes;
+    return program;
 }
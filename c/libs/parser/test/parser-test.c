@@ -1,14 +1,23 @@
 #include "glasstypes/glass-builders.h"
+#include "glasstypes/glass-cache.h"
 #include "glasstypes/glass-class.h"
 #include "glasstypes/glass-command.h"
 #include "glasstypes/glass-function.h"
+#include "glasstypes/glass-program.h"
+#include "glasstypes/glass-source.h"
+#include "glasstypes/glass-symbol.h"
 #include "parser/parser.h"
 #include "test/test.h"
+#include "utils/list.h"
 #include "utils/map.h"
 #include "utils/stream.h"
 #include "utils/string.h"
 
-Map *get_classes(const char *chars) {
+#include <stdio.h>
+
+#define NUM_TEST_FILES 3
+
+GlassProgram *get_program(const char *chars) {
     String *str = string_from_chars(chars);
     Stream *stream = stream_from_string(str);
     stream_set_name(stream, str);
@@ -22,58 +31,116 @@ Map *get_classes(const char *chars) {
         return NULL;
     }
 
-    Map *classes = build_glass_program(builder, true);
+    GlassProgram *program = build_glass_program(builder, true);
 
     free_program_builder(builder);
     free_stream(stream);
     free_string(str);
 
-    return classes;
+    return program;
+}
+
+GlassProgram *get_program_from_files(const char *contents[NUM_TEST_FILES], bool lazy_bodies) {
+    List *filenames = new_list(STRING_COPY_OPS);
+
+    for (size_t i = 0; i < NUM_TEST_FILES; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "parser-test-%zu.tmp", i);
+
+        FILE *fp = fopen(name, "w");
+        fputs(contents[i], fp);
+        fclose(fp);
+
+        String *filename = string_from_chars(name);
+        list_add(filenames, filename);
+        free_string(filename);
+    }
+
+    GlassProgram *program = classes_from_files(filenames, false, true, lazy_bodies);
+
+    for (size_t i = 0; i < list_len(filenames); i++) {
+        remove(string_get_c_str(list_get_mutable(filenames, i)));
+    }
+    free_list(filenames);
+
+    return program;
+}
+
+// Writes out each visited name, with a '/' before loop names and a '-' for
+// commands without one
+void describe_name(const String *name, bool is_loop, void *data) {
+    String *desc = data;
+
+    if (name == NULL) {
+        string_add_char(desc, '-');
+        return;
+    }
+
+    if (is_loop) {
+        string_add_char(desc, '/');
+    }
+    string_add_str(desc, name);
+}
+
+bool visits_names(const GlassFunction *func, const char *expected) {
+    String *desc = new_string();
+    String *expected_desc = string_from_chars(expected);
+    func_visit_names(func, describe_name, desc);
+    bool matches = strings_equal(desc, expected_desc);
+    free_string(desc);
+    free_string(expected_desc);
+    return matches;
 }
 
 int main() {
-    Map *classes = get_classes("");
-    if (ASSERT_NOT_NULL(classes)) {
+    const Map *classes;
+    GlassProgram *program = get_program("");
+    if (ASSERT_NOT_NULL(program)) {
+        classes = program_get_classes(program);
         ASSERT_EQUAL(map_size(classes), 0);
-        free_map(classes);
+        free_glass_program(program);
     }
 
     String *capital_m = string_from_chars("M");
     String *lower_m = string_from_chars("m");
     String *under_name = string_from_chars("_name");
 
-    classes = get_classes("{M[m]}");
-    if (ASSERT_NOT_NULL(classes)) {
+    program = get_program("{M[m]}");
+    if (ASSERT_NOT_NULL(program)) {
+        classes = program_get_classes(program);
         ASSERT_EQUAL(map_size(classes), 1);
         if (ASSERT_TRUE(map_has(classes, capital_m))) {
             const GlassClass *gclass = map_get(classes, capital_m);
             ASSERT_TRUE(class_has_func(gclass, lower_m));
         }
-        free_map(classes);
+        free_glass_program(program);
     }
 
-    classes = get_classes("{(M)[(m)]}");
-    if (ASSERT_NOT_NULL(classes)) {
+    program = get_program("{(M)[(m)]}");
+    if (ASSERT_NOT_NULL(program)) {
+        classes = program_get_classes(program);
         ASSERT_EQUAL(map_size(classes), 1);
         if (ASSERT_TRUE(map_has(classes, capital_m))) {
             const GlassClass *gclass = map_get(classes, capital_m);
             ASSERT_TRUE(class_has_func(gclass, lower_m));
         }
-        free_map(classes);
+        free_glass_program(program);
     }
 
-    classes = get_classes("  {    M    [   m   /  (_m)  \\  ]   }    ");
-    if (ASSERT_NOT_NULL(classes)) {
+    program = get_program("  {    M    [   m   /  (_m)  \\  ]   }    ");
+    if (ASSERT_NOT_NULL(program)) {
+        classes = program_get_classes(program);
         ASSERT_EQUAL(map_size(classes), 1);
         if (ASSERT_TRUE(map_has(classes, capital_m))) {
             const GlassClass *gclass = map_get(classes, capital_m);
             ASSERT_TRUE(class_has_func(gclass, lower_m));
         }
-        free_map(classes);
+        free_glass_program(program);
     }
 
-    classes = get_classes("{M[m.?!*^mM3(_name)(42)\"_name\"/(m)/M\\\\$<100>]}");
-    if (ASSERT_NOT_NULL(classes)) {
+    program = get_program("{M[m.?!*^mM3(_name)(42)\"_name\"/(m)/M\\\\$<100>]}");
+    if (ASSERT_NOT_NULL(program)) {
+        classes = program_get_classes(program);
         ASSERT_EQUAL(map_size(classes), 1);
         if (ASSERT_TRUE(map_has(classes, capital_m))) {
             const GlassClass *gclass = map_get(classes, capital_m);
@@ -88,6 +155,10 @@ int main() {
                 ASSERT_TRUE(strings_equal(func_get_command(func, 5)->str, lower_m));
                 ASSERT_EQUAL(func_get_command(func, 6)->type, CMD_PUSH_NAME);
                 ASSERT_TRUE(strings_equal(func_get_command(func, 6)->str, capital_m));
+                ASSERT_EQUAL(func_get_command(func, 5)->index, lookup_symbol(lower_m));
+                ASSERT_EQUAL(func_get_command(func, 6)->index, lookup_symbol(capital_m));
+                ASSERT_TRUE(lookup_symbol(lower_m) != lookup_symbol(capital_m));
+                ASSERT_TRUE(strings_equal(symbol_name(lookup_symbol(lower_m)), lower_m));
                 ASSERT_EQUAL(func_get_command(func, 7)->type, CMD_DUPLICATE);
                 ASSERT_EQUAL(func_get_command(func, 7)->index, 3);
                 ASSERT_EQUAL(func_get_command(func, 8)->type, CMD_PUSH_NAME);
@@ -113,39 +184,244 @@ int main() {
                 ASSERT_EQUAL(func_get_command(func, 16)->number, 100);
             }
         }
+        free_glass_program(program);
+    }
+
+    const char *positioned_source = "{M\n[m\n  .?]}";
+    program = get_program(positioned_source);
+    if (ASSERT_NOT_NULL(program)) {
+        classes = program_get_classes(program);
+        const GlassClass *gclass = map_get(classes, capital_m);
+        const GlassFunction *func = class_get_func(gclass, lower_m);
+        const String *filename;
+        unsigned line, col;
+
+        source_pos_lookup(func_get_pos(func), &filename, &line, &col);
+        ASSERT_EQUAL(line, 2);
+        ASSERT_EQUAL(col, 1);
+
+        source_pos_lookup(func_get_command(func, 1)->pos, &filename, &line, &col);
+        ASSERT_EQUAL(line, 3);
+        ASSERT_EQUAL(col, 4);
+        String *source_name = string_from_chars(positioned_source);
+        ASSERT_TRUE(strings_equal(filename, source_name));
+        free_string(source_name);
+        free_glass_program(program);
+    }
+
+    program = get_program("{M\n[m\n  .?]}{N M[n<2>\"s\"/(x)(x)\\]}");
+    if (ASSERT_NOT_NULL(program)) {
+        String *cache_path = string_from_chars("parser-test.glassc");
+        ASSERT_FALSE(write_program_cache(cache_path, program, 42));
+        free_glass_program(program);
+        free_sources();
+
+        ASSERT_NULL(read_program_cache(cache_path, 43, NULL));
+
+        program = read_program_cache(cache_path, 42, NULL);
+        if (ASSERT_NOT_NULL(program)) {
+            classes = program_get_classes(program);
+            String *capital_n = string_from_chars("N");
+            const GlassClass *gclass = map_get(classes, capital_n);
+            const GlassFunction *func = class_get_func(gclass, lower_m);
+            const String *filename;
+            unsigned line, col;
+
+            ASSERT_EQUAL(map_size(classes), 2);
+            if (ASSERT_NOT_NULL(func)) {
+                source_pos_lookup(func_get_command(func, 1)->pos, &filename, &line, &col);
+                ASSERT_EQUAL(line, 3);
+                ASSERT_EQUAL(col, 4);
+            }
+
+            String *lower_n = string_from_chars("n");
+            func = class_get_func(gclass, lower_n);
+            if (ASSERT_NOT_NULL(func) && ASSERT_EQUAL(func_len(func), 5)) {
+                ASSERT_EQUAL(func_get_command(func, 0)->number, 2);
+                ASSERT_EQUAL(string_len(func_get_command(func, 1)->str), 1);
+                ASSERT_EQUAL(func_get_command(func, 2)->index, 4);
+                ASSERT_EQUAL(func_get_command(func, 4)->index, 2);
+            }
+
+            free_string(lower_n);
+            free_string(capital_n);
+            free_glass_program(program);
+        }
+
+        remove(string_get_c_str(cache_path));
+        free_string(cache_path);
+    }
+
+    // Bodies that were never parsed are cached as where they are in the
+    // source, so they can only be read back lazily
+    free_sources();
+    FILE *fp = fopen("parser-test-lazy.tmp", "w");
+    fputs("{M[m\n  (_a)A!]}{A[a & ]}", fp);
+    fclose(fp);
+
+    List *lazy_files = new_list(STRING_COPY_OPS);
+    String *lazy_filename = string_from_chars("parser-test-lazy.tmp");
+    list_add(lazy_files, lazy_filename);
+
+    program = classes_from_files(lazy_files, false, true, true);
+    if (ASSERT_NOT_NULL(program)) {
+        String *cache_path = string_from_chars("parser-test.glassc");
+        ASSERT_FALSE(write_program_cache(cache_path, program, 42));
+        free_glass_program(program);
+        free_sources();
+
+        ASSERT_NULL(read_program_cache(cache_path, 42, NULL));
+        ASSERT_EQUAL(num_sources(), 0);
+
+        program = read_program_cache(cache_path, 42, GLASS_LAZY_PARSER);
+        if (ASSERT_NOT_NULL(program)) {
+            classes = program_get_classes(program);
+            String *capital_a = string_from_chars("A");
+            String *lower_a = string_from_chars("a");
+            const GlassClass *gclass = map_get(classes, capital_m);
+            const String *filename;
+            unsigned line, col;
+
+            ASSERT_TRUE(func_get_body_pos(class_find_func(gclass, lower_m)) != NO_SOURCE_POS);
+
+            const GlassFunction *func = class_get_func(gclass, lower_m);
+            if (ASSERT_NOT_NULL(func) && ASSERT_EQUAL(func_len(func), 3)) {
+                source_pos_lookup(func_get_command(func, 1)->pos, &filename, &line, &col);
+                ASSERT_EQUAL(line, 2);
+                ASSERT_EQUAL(col, 7);
+            }
+
+            ASSERT_NULL(class_get_func(map_get(classes, capital_a), lower_a));
+
+            free_string(capital_a);
+            free_string(lower_a);
+            free_glass_program(program);
+        }
+
+        remove(string_get_c_str(cache_path));
+        free_string(cache_path);
     }
 
+    free_sources();
+    remove(string_get_c_str(lazy_filename));
+    free_string(lazy_filename);
+    free_list(lazy_files);
+
     free_string(capital_m);
     free_string(lower_m);
     free_string(under_name);
 
+    const char *files[NUM_TEST_FILES] = {"{A[a]}", "{B A[b]}", "{(Cee)B}"};
+    program = get_program_from_files(files, false);
+    if (ASSERT_NOT_NULL(program)) {
+        classes = program_get_classes(program);
+        ASSERT_EQUAL(map_size(classes), 3);
+        free_glass_program(program);
+    }
+
+    files[1] = "{B A[b}";
+    ASSERT_NULL(get_program_from_files(files, false));
+
+    files[1] = "{A}";
+    ASSERT_NULL(get_program_from_files(files, false));
+
+    // Lazily parsed bodies only report errors once they're used, and skimming
+    // them has to look past the ']'s inside strings, comments and numbers
+    files[0] = "{A[a (b)\"]\\\"\"<]>'x]'.?]}";
+    files[1] = "{B[b & ]}";
+    files[2] = "{C[c / x(yy)(yy)(1)\\ ]}";
+    ASSERT_NULL(get_program_from_files(files, false));
+
+    program = get_program_from_files(files, true);
+    if (ASSERT_NOT_NULL(program)) {
+        classes = program_get_classes(program);
+        String *name_a = string_from_chars("A");
+        String *name_b = string_from_chars("B");
+        String *name_c = string_from_chars("C");
+        String *func_a = string_from_chars("a");
+        String *func_b = string_from_chars("b");
+        String *func_c = string_from_chars("c");
+
+        const GlassClass *class_a = map_get(classes, name_a);
+        const GlassClass *class_b = map_get(classes, name_b);
+        const GlassClass *class_c = map_get(classes, name_c);
+        if (ASSERT_NOT_NULL(class_a) && ASSERT_NOT_NULL(class_b) && ASSERT_NOT_NULL(class_c)) {
+            // Names can be found without parsing the bodies
+            ASSERT_TRUE(visits_names(class_find_func(class_a, func_a), "b----"));
+            ASSERT_TRUE(visits_names(class_find_func(class_c, func_c), "/xyyyy--"));
+            ASSERT_TRUE(func_get_body_pos(class_find_func(class_a, func_a)) != NO_SOURCE_POS);
+
+            const GlassFunction *func = class_get_func(class_a, func_a);
+            if (ASSERT_NOT_NULL(func) && ASSERT_EQUAL(func_len(func), 5)) {
+                ASSERT_EQUAL(func_get_command(func, 0)->type, CMD_PUSH_NAME);
+                ASSERT_EQUAL(string_len(func_get_command(func, 1)->str), 2);
+                ASSERT_EQUAL(func_get_command(func, 2)->type, CMD_PUSH_NUM);
+                ASSERT_EQUAL(func_get_command(func, 3)->type, CMD_GET_FUNC);
+                ASSERT_TRUE(visits_names(func, "b----"));
+                ASSERT_EQUAL(func_get_body_pos(func), NO_SOURCE_POS);
+            }
+
+            func = class_get_func(class_c, func_c);
+            if (ASSERT_NOT_NULL(func)) {
+                ASSERT_TRUE(visits_names(func, "/xyyyy--"));
+            }
+
+            ASSERT_TRUE(class_has_func(class_b, func_b));
+            ASSERT_NULL(class_get_func(class_b, func_b));
+            ASSERT_TRUE(visits_names(class_find_func(class_b, func_b), ""));
+        }
+
+        free_string(name_a);
+        free_string(name_b);
+        free_string(name_c);
+        free_string(func_a);
+        free_string(func_b);
+        free_string(func_c);
+        free_glass_program(program);
+    }
+
+    files[2] = "{C[c \"]}";
+    ASSERT_NULL(get_program_from_files(files, true));
+
     // Invalid Glass programs, should return NULL
-    ASSERT_NULL(get_classes("{"));
-    ASSERT_NULL(get_classes("{}"));
-    ASSERT_NULL(get_classes("{M"));
-    ASSERT_NULL(get_classes("{(Name)"));
-    ASSERT_NULL(get_classes("{(Name)[}"));
-    ASSERT_NULL(get_classes("{(Name)[n}"));
-    ASSERT_NULL(get_classes("{(Name)[(name)"));
-    ASSERT_NULL(get_classes("{(Name"));
-    ASSERT_NULL(get_classes("!$^*"));
-    ASSERT_NULL(get_classes("{M !}"));
-    ASSERT_NULL(get_classes("{M[m & ]}"));
-    ASSERT_NULL(get_classes("{M[m(a]}"));
-    ASSERT_NULL(get_classes("{M[m<2]}"));
-    ASSERT_NULL(get_classes("{M[m/]}"));
-    ASSERT_NULL(get_classes("{M[m/(_name]}"));
-    ASSERT_NULL(get_classes("{M[m/(_name)]}"));
-    ASSERT_NULL(get_classes("{M[m\\]}"));
-    ASSERT_NULL(get_classes("{M[m($)]}"));
-    ASSERT_NULL(get_classes("{M[m(n$)]}"));
-    ASSERT_NULL(get_classes("{M[m(0$)]}"));
-    ASSERT_NULL(get_classes("{M[m\"]}"));
-    ASSERT_NULL(get_classes("{M[m][m]}"));
-    ASSERT_NULL(get_classes("{M[m]}{M[m]}"));
-    ASSERT_NULL(get_classes("{MNN[m]}{N}"));
-    ASSERT_NULL(get_classes("{MZ[m]}"));
-    ASSERT_NULL(get_classes("{MN[m]}{NM}"));
+    ASSERT_NULL(get_program("{"));
+    ASSERT_NULL(get_program("{}"));
+    ASSERT_NULL(get_program("{M"));
+    ASSERT_NULL(get_program("{(Name)"));
+    ASSERT_NULL(get_program("{(Name)[}"));
+    ASSERT_NULL(get_program("{(Name)[n}"));
+    ASSERT_NULL(get_program("{(Name)[(name)"));
+    ASSERT_NULL(get_program("{(Name"));
+    ASSERT_NULL(get_program("!$^*"));
+    ASSERT_NULL(get_program("{M !}"));
+    ASSERT_NULL(get_program("{M[m & ]}"));
+    ASSERT_NULL(get_program("{M[m(a]}"));
+    ASSERT_NULL(get_program("{M[m<2]}"));
+    ASSERT_NULL(get_program("{M[m/]}"));
+    ASSERT_NULL(get_program("{M[m/(_name]}"));
+    ASSERT_NULL(get_program("{M[m/(_name)]}"));
+    ASSERT_NULL(get_program("{M[m\\]}"));
+    ASSERT_NULL(get_program("{M[m($)]}"));
+    ASSERT_NULL(get_program("{M[m(n$)]}"));
+    ASSERT_NULL(get_program("{M[m(0$)]}"));
+    ASSERT_NULL(get_program("{M[m\"]}"));
+    ASSERT_NULL(get_program("{M[m][m]}"));
+    ASSERT_NULL(get_program("{M[m]}{M[m]}"));
+    ASSERT_NULL(get_program("{MNN[m]}{N}"));
+    ASSERT_NULL(get_program("{MZ[m]}"));
+    ASSERT_NULL(get_program("{MN[m]}{NM}"));
+
+    // Sources that no longer fit in a SourcePos can't be registered
+    free_sources();
+    String *huge_name = string_from_chars("huge.glass");
+    size_t line_start = 0;
+    ASSERT_EQUAL(register_source_lines(huge_name, UINT32_MAX, &line_start, 1), NO_SOURCE_POS);
+    ASSERT_TRUE(register_source_lines(huge_name, UINT32_MAX - 3, &line_start, 1) != NO_SOURCE_POS);
+    ASSERT_NULL(get_program("{M[m]}"));
+    free_string(huge_name);
+    free_sources();
+
+    free_symbols();
 
     return test_status();
 }
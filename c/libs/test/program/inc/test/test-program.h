@@ -0,0 +1,13 @@
+#ifndef TEST_TEST_PROGRAM_H
+#define TEST_TEST_PROGRAM_H
+
+#include <stdbool.h>
+
+struct GlassProgram;
+
+// Parses a program from a string, using the string as its file name too, and
+// adds the builtin classes to it if include_builtins is set. Returns NULL if
+// the program is invalid
+struct GlassProgram *parse_test_program(const char *chars, bool include_builtins);
+
+#endif
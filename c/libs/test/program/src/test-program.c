@@ -0,0 +1,31 @@
+#include "test/test-program.h"
+#include "glasstypes/glass-builders.h"
+#include "glasstypes/glass-program.h"
+#include "parser/parser.h"
+#include "utils/stream.h"
+#include "utils/string.h"
+
+#include <stddef.h>
+
+GlassProgram *parse_test_program(const char *chars, bool include_builtins) {
+    String *str = string_from_chars(chars);
+    Stream *stream = stream_from_string(str);
+    stream_set_name(stream, str);
+
+    GlassProgramBuilder *builder = new_program_builder();
+    GlassProgram *program = NULL;
+
+    if (include_builtins) {
+        add_builtin_classes(builder);
+    }
+
+    if (!parse_classes(builder, stream)) {
+        program = build_glass_program(builder, true);
+    }
+
+    free_program_builder(builder);
+    free_stream(stream);
+    free_string(str);
+
+    return program;
+}
@@ -0,0 +1,28 @@
+#ifndef UTILS_ARENA_H
+#define UTILS_ARENA_H
+
+#include <stddef.h>
+
+// An arena hands out memory from large blocks, and frees all of it at once
+// when the arena itself is freed. Nothing allocated from an arena can be
+// freed on its own
+typedef struct Arena Arena;
+
+// Returns a pointer to a new, empty arena
+Arena *new_arena(void);
+
+// Frees the arena, along with everything allocated from it
+void free_arena(Arena *arena);
+
+// Returns size bytes of memory that live as long as the arena, aligned for
+// any type
+void *arena_alloc(Arena *arena, size_t size);
+
+// Returns a copy of some data allocated in the arena
+void *arena_copy(Arena *arena, const void *data, size_t size);
+
+// Moves everything allocated from src into dest, so it lives as long as dest
+// does. src is left empty, and can still be used or freed
+void arena_merge(Arena *dest, Arena *src);
+
+#endif
@@ -24,6 +24,10 @@ typedef struct CopyInterface {
         copy_ ## NAME, free,                                     \
     }                                                            \
 
+// For containers of pointers to data that's owned by something else. Adding a
+// pointer stores it as is, and nothing is freed along with the container
+COPY_OPS_DECL(BORROWED);
+
 COPY_OPS_DECL(INT);
 COPY_OPS_DECL(SIZE_T);
 COPY_OPS_DECL(VOID_PTR);
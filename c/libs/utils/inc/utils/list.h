@@ -23,6 +23,10 @@ void free_list(List *list);
 // Copies an element to the end of a list
 void list_add(List *list, const void *val);
 
+// Moves every element from the end of one list onto the end of another,
+// leaving the source list empty. Both lists must use the same copyinterface
+void list_move_all(List *dest, List *src);
+
 // Sorts the list, using the cmp function to compare elements
 void list_sort(List *list, int (*cmp)(const void *, const void *));
 
@@ -46,4 +50,8 @@ const void *list_get(const List *list, size_t index);
 // Returns a mutable element at a given index in the list
 void *list_get_mutable(List *list, size_t index);
 
+// Replaces the element at a given index with a copy of the given element,
+// freeing the old one
+void list_set(List *list, size_t index, const void *val);
+
 #endif
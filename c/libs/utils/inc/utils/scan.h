@@ -0,0 +1,28 @@
+#ifndef UTILS_SCAN_H
+#define UTILS_SCAN_H
+
+#include <stddef.h>
+
+// Byte scanning routines for the lexer. Each one looks at len chars and
+// returns the index of the first char that matches, or len if none do.
+// They use SSE2 or AVX2 when the compiler targets them, and a plain loop
+// otherwise.
+
+// Returns the index of the first occurrence of c
+size_t scan_find_char(const char *chars, size_t len, char c);
+
+// Returns the index of the first occurrence of either c1 or c2
+size_t scan_find_either(const char *chars, size_t len, char c1, char c2);
+
+// Returns the index of the first char that appears in set, which is a
+// NUL-terminated string of a few chars
+size_t scan_find_any(const char *chars, size_t len, const char *set);
+
+// Returns the index of the first char that isn't whitespace
+size_t scan_skip_space(const char *chars, size_t len);
+
+// Returns the index of the first char that can't be part of a name, meaning
+// anything other than a letter, digit or underscore
+size_t scan_name_end(const char *chars, size_t len);
+
+#endif
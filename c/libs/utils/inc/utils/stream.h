@@ -2,6 +2,7 @@
 #define UTILS_STREAM_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
 typedef struct Stream Stream;
@@ -11,6 +12,10 @@ Stream *stream_from_string(const struct String *str);
 
 Stream *stream_from_file(FILE *file);
 
+// Returns a stream named after the path with the file's contents, mapping the
+// file into memory where possible. Returns NULL if the file can't be read
+Stream *stream_from_path(const struct String *path);
+
 void free_stream(Stream *stream);
 
 void stream_set_name(Stream *stream, const struct String *name);
@@ -21,10 +26,30 @@ char stream_get_char(Stream *stream);
 
 const struct String *stream_get_name(const Stream *stream);
 
+// Returns the offset of the next char to be read
+size_t stream_get_offset(const Stream *stream);
+
+size_t stream_len(const Stream *stream);
+
+// The line and column of the last char read. These are computed from the
+// offset on demand, so they are meant for error reporting
 unsigned stream_get_line(const Stream *stream);
 
 unsigned stream_get_col(const Stream *stream);
 
+// Returns a newly-allocated array of the offsets each line starts at
+size_t *stream_line_starts(const Stream *stream, size_t *num_lines);
+
 void stream_unget(Stream *stream);
 
+// Returns a pointer to the chars that haven't been read yet, and sets len to
+// how many of them there are
+const char *stream_peek(const Stream *stream, size_t *len);
+
+// Moves past the next len chars, as if they had been read
+void stream_skip(Stream *stream, size_t len);
+
+// Moves to the given offset, so that the char there is the next one read
+void stream_seek(Stream *stream, size_t offset);
+
 #endif
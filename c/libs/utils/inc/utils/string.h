@@ -5,6 +5,7 @@
 #include <stddef.h>
 
 typedef struct String String;
+struct Arena;
 struct CopyInterface;
 struct HashInterface;
 
@@ -20,6 +21,14 @@ String *string_from_char(char c);
 // Returns a pointer to a newly-allocated string with the given content
 String *string_from_chars(const char *chars);
 
+// Returns a pointer to a newly-allocated string with the first len chars
+String *string_from_buf(const char *chars, size_t len);
+
+// Returns a copy of the string that's allocated in the arena. The copy is
+// null-terminated, lives as long as the arena, and must not be freed or
+// have anything added to it
+String *arena_copy_string(struct Arena *arena, const String *str);
+
 // Returns a copy of the given string
 String *copy_string(const String *str);
 
@@ -36,6 +45,9 @@ void string_add_char(String *str, char c);
 // Adds some characters to the end of the string
 void string_add_chars(String *str, const char *chars);
 
+// Adds len characters from a buffer to the end of the string
+void string_add_buf(String *str, const char *chars, size_t len);
+
 // Adds the content of the string to the end of another string
 void string_add_str(String *str1, const String *str2);
 
@@ -0,0 +1,106 @@
+#include "utils/arena.h"
+
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+
+    size_t used;
+
+    size_t size;
+
+    alignas(max_align_t) char data[];
+} ArenaBlock;
+
+struct Arena {
+    // The block currently being allocated from, which links to the rest
+    ArenaBlock *blocks;
+};
+
+static ArenaBlock *new_block(size_t size, ArenaBlock *next) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    block->next = next;
+    block->used = 0;
+    block->size = size;
+    return block;
+}
+
+Arena *new_arena(void) {
+    Arena *arena = malloc(sizeof(Arena));
+    arena->blocks = NULL;
+    return arena;
+}
+
+void free_arena(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    ArenaBlock *block = arena->blocks;
+
+    if (block == NULL || block->size - block->used < size) {
+        if (size > ARENA_BLOCK_SIZE / 4) {
+            // Give big allocations their own block, behind the current one, so
+            // the space left in the current block doesn't go to waste
+            ArenaBlock *big = new_block(size, block != NULL ? block->next : NULL);
+            if (block != NULL) {
+                block->next = big;
+            }
+            else {
+                arena->blocks = big;
+            }
+            big->used = size;
+            return big->data;
+        }
+
+        block = new_block(ARENA_BLOCK_SIZE, block);
+        arena->blocks = block;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void *arena_copy(Arena *arena, const void *data, size_t size) {
+    void *copy = arena_alloc(arena, size);
+    memcpy(copy, data, size);
+    return copy;
+}
+
+void arena_merge(Arena *dest, Arena *src) {
+    if (src->blocks == NULL) {
+        return;
+    }
+
+    // Put src's blocks after dest's current block, so dest keeps allocating
+    // from where it was
+    ArenaBlock *last = src->blocks;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+
+    if (dest->blocks != NULL) {
+        last->next = dest->blocks->next;
+        dest->blocks->next = src->blocks;
+    }
+    else {
+        dest->blocks = src->blocks;
+    }
+
+    src->blocks = NULL;
+}
@@ -2,6 +2,18 @@
 
 #include <stdlib.h>
 
+static void *borrow_val(const void *val) {
+    return (void *) val;
+}
+
+static void ignore_val(void *val) {
+    (void) val;
+}
+
+const CopyInterface *BORROWED_COPY_OPS = &(CopyInterface) {
+    borrow_val, ignore_val,
+};
+
 COPY_OPS_DEFINITION(int, INT);
 COPY_OPS_DEFINITION(size_t, SIZE_T);
 COPY_OPS_DEFINITION(void *, VOID_PTR);
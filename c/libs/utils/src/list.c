@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 struct List {
     CopyInterface copy_ops;
@@ -61,6 +62,13 @@ void list_add(List *list, const void *val) {
     list->len++;
 }
 
+void list_move_all(List *dest, List *src) {
+    list_reserve_space(dest, dest->len + src->len);
+    memcpy(dest->elements + dest->len, src->elements, sizeof(void *) * src->len);
+    dest->len += src->len;
+    src->len = 0;
+}
+
 static void list_sort_helper(List *list, int (*cmp)(const void *, const void *), int lo, int hi) {
     if (lo < hi) {
         void *pivot = list->elements[hi];
@@ -127,6 +135,14 @@ void *list_get_mutable(List *list, size_t index) {
     return list->elements[index];
 }
 
+void list_set(List *list, size_t index, const void *val) {
+    assert(index < list->len);
+
+    void *old_val = list->elements[index];
+    list->elements[index] = list->copy_ops.copy_val(val);
+    list->copy_ops.free_val(old_val);
+}
+
 // "Generic" versions of some functions that are used to satisfy interfaces
 
 static void *copy_list_generic(const void *list) {
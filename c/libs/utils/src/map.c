@@ -145,6 +145,9 @@ const void *map_get(const Map *map, const void *key) {
 
 void *map_get_mutable(Map *map, const void *key) {
     size_t slot = map_get_slot(map, key);
+    if (map->keys[slot] == NULL) {
+        return NULL;
+    }
     return map->vals[slot];
 }
 
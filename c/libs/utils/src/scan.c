@@ -0,0 +1,194 @@
+#include "utils/scan.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+#endif
+
+static inline bool is_space_char(char c) {
+    return c == ' ' || (unsigned char) (c - '\t') <= '\r' - '\t';
+}
+
+static inline bool is_name_char(char c) {
+    return (unsigned char) ((c | 0x20) - 'a') <= 'z' - 'a'
+        || (unsigned char) (c - '0') <= '9' - '0'
+        || c == '_';
+}
+
+#ifdef SCAN_WIDTH
+
+// The vector routines below all build a mask with a set bit for every
+// matching lane, so the first match is the lowest set bit
+
+#if SCAN_WIDTH == 32
+typedef __m256i Vec;
+#define vec_load(P)        _mm256_loadu_si256((const __m256i *) (P))
+#define vec_splat(C)       _mm256_set1_epi8(C)
+#define vec_eq(A, B)       _mm256_cmpeq_epi8(A, B)
+#define vec_or(A, B)       _mm256_or_si256(A, B)
+#define vec_sub(A, B)      _mm256_sub_epi8(A, B)
+#define vec_min(A, B)      _mm256_min_epu8(A, B)
+#define vec_mask(V)        ((uint32_t) _mm256_movemask_epi8(V))
+#else
+typedef __m128i Vec;
+#define vec_load(P)        _mm_loadu_si128((const __m128i *) (P))
+#define vec_splat(C)       _mm_set1_epi8(C)
+#define vec_eq(A, B)       _mm_cmpeq_epi8(A, B)
+#define vec_or(A, B)       _mm_or_si128(A, B)
+#define vec_sub(A, B)      _mm_sub_epi8(A, B)
+#define vec_min(A, B)      _mm_min_epu8(A, B)
+#define vec_mask(V)        ((uint32_t) _mm_movemask_epi8(V))
+#endif
+
+#define ALL_LANES ((uint32_t) (((uint64_t) 1 << SCAN_WIDTH) - 1))
+
+// Lanes where lo <= v <= hi, using an unsigned min to do the range check
+static inline Vec vec_in_range(Vec v, char lo, char hi) {
+    Vec offset = vec_sub(v, vec_splat(lo));
+    return vec_eq(vec_min(offset, vec_splat((char) (hi - lo))), offset);
+}
+
+static inline uint32_t space_mask(Vec v) {
+    return vec_mask(vec_or(vec_eq(v, vec_splat(' ')), vec_in_range(v, '\t', '\r')));
+}
+
+static inline uint32_t name_mask(Vec v) {
+    Vec lowered = vec_or(v, vec_splat(0x20));
+    Vec matches = vec_or(vec_in_range(lowered, 'a', 'z'), vec_in_range(v, '0', '9'));
+    return vec_mask(vec_or(matches, vec_eq(v, vec_splat('_'))));
+}
+
+#endif
+
+size_t scan_find_char(const char *chars, size_t len, char c) {
+    size_t i = 0;
+
+#ifdef SCAN_WIDTH
+    Vec target = vec_splat(c);
+
+    for (; i + SCAN_WIDTH <= len; i += SCAN_WIDTH) {
+        uint32_t mask = vec_mask(vec_eq(vec_load(chars + i), target));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (chars[i] == c) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+size_t scan_find_either(const char *chars, size_t len, char c1, char c2) {
+    size_t i = 0;
+
+#ifdef SCAN_WIDTH
+    Vec target1 = vec_splat(c1);
+    Vec target2 = vec_splat(c2);
+
+    for (; i + SCAN_WIDTH <= len; i += SCAN_WIDTH) {
+        Vec v = vec_load(chars + i);
+        uint32_t mask = vec_mask(vec_or(vec_eq(v, target1), vec_eq(v, target2)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (chars[i] == c1 || chars[i] == c2) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+size_t scan_find_any(const char *chars, size_t len, const char *set) {
+    size_t i = 0;
+
+#ifdef SCAN_WIDTH
+    for (; i + SCAN_WIDTH <= len; i += SCAN_WIDTH) {
+        Vec v = vec_load(chars + i);
+        Vec matches = vec_eq(v, vec_splat(set[0]));
+        for (const char *c = set + 1; *c != '\0'; c++) {
+            matches = vec_or(matches, vec_eq(v, vec_splat(*c)));
+        }
+
+        uint32_t mask = vec_mask(matches);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (chars[i] != '\0' && strchr(set, chars[i]) != NULL) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+size_t scan_skip_space(const char *chars, size_t len) {
+    size_t i = 0;
+
+    // Most gaps between tokens are a char or two, so check those before
+    // paying for a vector load
+    while (i < len && i < 2) {
+        if (!is_space_char(chars[i])) {
+            return i;
+        }
+        i++;
+    }
+
+#ifdef SCAN_WIDTH
+    for (; i + SCAN_WIDTH <= len; i += SCAN_WIDTH) {
+        uint32_t mask = ~space_mask(vec_load(chars + i)) & ALL_LANES;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (!is_space_char(chars[i])) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+size_t scan_name_end(const char *chars, size_t len) {
+    size_t i = 0;
+
+#ifdef SCAN_WIDTH
+    for (; i + SCAN_WIDTH <= len; i += SCAN_WIDTH) {
+        uint32_t mask = ~name_mask(vec_load(chars + i)) & ALL_LANES;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (!is_name_char(chars[i])) {
+            return i;
+        }
+    }
+
+    return len;
+}
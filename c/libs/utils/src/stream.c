@@ -1,9 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "utils/stream.h"
 #include "utils/string.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 struct Stream {
     String *name;
@@ -14,34 +21,110 @@ struct Stream {
 
     size_t len;
 
-    unsigned line;
-
-    unsigned col;
+    // Whether chars is a read-only file mapping rather than a malloc'd buffer
+    bool mapped;
 };
 
-Stream *stream_from_string(const String *str) {
+#define STREAM_READ_CHUNK 65536
+
+static Stream *new_stream(char *chars, size_t len, bool mapped) {
     Stream *stream = malloc(sizeof(Stream));
-    stream->chars = malloc(sizeof(char) * string_len(str));
+    stream->chars = chars;
     stream->cur_index = 0;
-    stream->len = string_len(str);
-    stream->line = 1;
-    stream->col = 0;
+    stream->len = len;
+    stream->mapped = mapped;
     stream->name = NULL;
-    memcpy(stream->chars, string_data(str), stream->len);
     return stream;
 }
 
+Stream *stream_from_string(const String *str) {
+    char *chars = malloc(sizeof(char) * string_len(str));
+    memcpy(chars, string_data(str), string_len(str));
+    return new_stream(chars, string_len(str), false);
+}
+
 Stream *stream_from_file(FILE *file) {
-    String *str = new_string();
+    size_t len = 0;
+    size_t alloc = STREAM_READ_CHUNK;
+    char *chars = malloc(sizeof(char) * alloc);
+
+    size_t read_len;
+    while ((read_len = fread(chars + len, sizeof(char), alloc - len, file)) > 0) {
+        len += read_len;
+        if (len == alloc) {
+            alloc *= 2;
+            chars = realloc(chars, sizeof(char) * alloc);
+        }
+    }
+
+    return new_stream(chars, len, false);
+}
+
+// Reads everything from a file descriptor that can't be mapped, such as a
+// pipe, using as few read calls as possible
+static Stream *stream_from_fd(int fd, size_t size_hint) {
+    size_t len = 0;
+    size_t alloc = size_hint > 0 ? size_hint + 1 : STREAM_READ_CHUNK;
+    char *chars = malloc(sizeof(char) * alloc);
+
+    for (;;) {
+        ssize_t read_len = read(fd, chars + len, alloc - len);
+        if (read_len < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (read_len < 0) {
+            free(chars);
+            return NULL;
+        }
+        else if (read_len == 0) {
+            break;
+        }
+
+        len += read_len;
+        if (len == alloc) {
+            alloc *= 2;
+            chars = realloc(chars, sizeof(char) * alloc);
+        }
+    }
+
+    return new_stream(chars, len, false);
+}
 
-    int c;
+Stream *stream_from_path(const String *path) {
+    String *path_copy = copy_string(path);
+    int fd = open(string_get_c_str(path_copy), O_RDONLY);
+    free_string(path_copy);
+
+    if (fd < 0) {
+        return NULL;
+    }
 
-    while ((c = fgetc(file)) != EOF) {
-        string_add_char(str, c);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    Stream *stream = NULL;
+
+    if (S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            stream = new_stream(mapping, info.st_size, true);
+        }
+    }
+
+    if (stream == NULL) {
+        size_t size_hint = S_ISREG(info.st_mode) ? (size_t) info.st_size : 0;
+        stream = stream_from_fd(fd, size_hint);
+    }
+
+    close(fd);
+
+    if (stream != NULL) {
+        stream_set_name(stream, path);
     }
 
-    Stream *stream = stream_from_string(str);
-    free_string(str);
     return stream;
 }
 
@@ -49,7 +132,12 @@ void free_stream(Stream *stream) {
     if (stream->name != NULL) {
         free_string(stream->name);
     }
-    free(stream->chars);
+    if (stream->mapped) {
+        munmap(stream->chars, stream->len);
+    }
+    else {
+        free(stream->chars);
+    }
     free(stream);
 }
 
@@ -69,13 +157,6 @@ char stream_get_char(Stream *stream) {
         return 0;
     }
     else {
-        if (stream->cur_index > 0 && stream->chars[stream->cur_index - 1] == '\n') {
-            stream->line++;
-            stream->col = 1;
-        }
-        else {
-            stream->col++;
-        }
         return stream->chars[stream->cur_index++];
     }
 }
@@ -84,17 +165,89 @@ const String *stream_get_name(const Stream *stream) {
     return stream->name;
 }
 
+size_t stream_get_offset(const Stream *stream) {
+    return stream->cur_index;
+}
+
+size_t stream_len(const Stream *stream) {
+    return stream->len;
+}
+
+// Counts the newlines that come before the given offset
+static size_t count_newlines(const Stream *stream, size_t offset) {
+    size_t count = 0;
+    const char *cur = stream->chars;
+    const char *end = stream->chars + offset;
+
+    while (cur < end && (cur = memchr(cur, '\n', end - cur)) != NULL) {
+        count++;
+        cur++;
+    }
+
+    return count;
+}
+
 unsigned stream_get_line(const Stream *stream) {
-    return stream->line;
+    if (stream->cur_index == 0) {
+        return 1;
+    }
+    return count_newlines(stream, stream->cur_index - 1) + 1;
 }
 
 unsigned stream_get_col(const Stream *stream) {
-    return stream->col;
+    if (stream->cur_index == 0) {
+        return 0;
+    }
+
+    size_t index = stream->cur_index - 1;
+    size_t line_start = index;
+
+    while (line_start > 0 && stream->chars[line_start - 1] != '\n') {
+        line_start--;
+    }
+
+    return index - line_start + 1;
+}
+
+size_t *stream_line_starts(const Stream *stream, size_t *num_lines) {
+    size_t alloc = 64;
+    size_t *line_starts = malloc(sizeof(size_t) * alloc);
+    line_starts[0] = 0;
+    *num_lines = 1;
+
+    const char *cur = stream->chars;
+    const char *end = stream->chars + stream->len;
+
+    while (cur < end && (cur = memchr(cur, '\n', end - cur)) != NULL) {
+        cur++;
+        if (*num_lines == alloc) {
+            alloc *= 2;
+            line_starts = realloc(line_starts, sizeof(size_t) * alloc);
+        }
+        line_starts[(*num_lines)++] = cur - stream->chars;
+    }
+
+    return line_starts;
 }
 
 void stream_unget(Stream *stream) {
     if (stream->cur_index > 0) {
         stream->cur_index--;
-        stream->col--;
-    } 
+    }
+}
+
+const char *stream_peek(const Stream *stream, size_t *len) {
+    *len = stream->len - stream->cur_index;
+    return stream->chars + stream->cur_index;
+}
+
+void stream_skip(Stream *stream, size_t len) {
+    stream->cur_index += len;
+    if (stream->cur_index > stream->len) {
+        stream->cur_index = stream->len;
+    }
+}
+
+void stream_seek(Stream *stream, size_t offset) {
+    stream->cur_index = offset < stream->len ? offset : stream->len;
 }
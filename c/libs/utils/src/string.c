@@ -1,4 +1,5 @@
 #include "utils/string.h"
+#include "utils/arena.h"
 #include "utils/copy-interface.h"
 #include "utils/hash-interface.h"
 
@@ -33,8 +34,12 @@ String *string_from_char(char c) {
 }
 
 String *string_from_chars(const char *chars) {
+    return string_from_buf(chars, strlen(chars));
+}
+
+String *string_from_buf(const char *chars, size_t len) {
     String *str = malloc(sizeof(String));
-    str->len = strlen(chars);
+    str->len = len;
     str->alloc = STR_INIT_ALLOC;
     while (str->len > str->alloc) {
         str->alloc *= 2;
@@ -44,6 +49,16 @@ String *string_from_chars(const char *chars) {
     return str;
 }
 
+String *arena_copy_string(Arena *arena, const String *str) {
+    String *copy = arena_alloc(arena, sizeof(String));
+    copy->buf = arena_alloc(arena, str->len + 1);
+    copy->len = str->len;
+    copy->alloc = str->len + 1;
+    memcpy(copy->buf, str->buf, str->len);
+    copy->buf[str->len] = '\0';
+    return copy;
+}
+
 String *copy_string(const String *str) {
     String *copy = malloc(sizeof(String));
     copy->buf = malloc(sizeof(char) * str->alloc);
@@ -90,10 +105,13 @@ void string_add_char(String *str, char c) {
 }
 
 void string_add_chars(String *str, const char *chars) {
-    size_t chars_len = strlen(chars);
-    string_reserve_space(str, str->len + chars_len);
-    memcpy(str->buf + str->len, chars, chars_len);
-    str->len += chars_len;
+    string_add_buf(str, chars, strlen(chars));
+}
+
+void string_add_buf(String *str, const char *chars, size_t len) {
+    string_reserve_space(str, str->len + len);
+    memcpy(str->buf + str->len, chars, len);
+    str->len += len;
 }
 
 void string_add_str(String *str1, const String *str2) {
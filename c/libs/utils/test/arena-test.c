@@ -0,0 +1,47 @@
+#include "test/test.h"
+#include "utils/arena.h"
+#include "utils/string.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define NUM_ALLOCS 10000
+
+int main() {
+    Arena *arena = new_arena();
+
+    // Allocations should be aligned for any type, and not overlap
+    char *prev = NULL;
+    for (size_t i = 1; i < NUM_ALLOCS; i++) {
+        char *ptr = arena_alloc(arena, i % 100 + 1);
+        ASSERT_EQUAL((uintptr_t) ptr % sizeof(double), 0);
+        memset(ptr, 'x', i % 100 + 1);
+        if (prev != NULL) {
+            ASSERT_EQUAL(*prev, 'x');
+        }
+        prev = ptr;
+    }
+
+    // A big allocation gets its own block
+    char *big = arena_alloc(arena, 1024 * 1024);
+    memset(big, 'y', 1024 * 1024);
+
+    String *str = string_from_chars("Hello");
+    String *copy = arena_copy_string(arena, str);
+    free_string(str);
+
+    ASSERT_EQUAL(string_len(copy), 5);
+    ASSERT_EQUAL(strcmp(string_get_c_str(copy), "Hello"), 0);
+
+    Arena *other = new_arena();
+    int *num = arena_copy(other, &(int) {42}, sizeof(int));
+    arena_merge(arena, other);
+    free_arena(other);
+
+    ASSERT_EQUAL(*num, 42);
+    ASSERT_EQUAL(*big, 'y');
+
+    free_arena(arena);
+
+    return test_status();
+}
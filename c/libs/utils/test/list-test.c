@@ -57,6 +57,18 @@ int main() {
     ASSERT_EQUAL(list_len(list), 5);
     ASSERT_TRUE(strings_equal(str, cmp));
 
+    list_move_all(list, sorted);
+
+    ASSERT_EQUAL(list_len(list), 11);
+    ASSERT_TRUE(list_empty(sorted));
+    ASSERT_TRUE(strings_equal(list_get(list, 4), list_get(list, 5)));
+
+    list_set(list, 4, cmp);
+
+    ASSERT_EQUAL(list_len(list), 11);
+    ASSERT_TRUE(strings_equal(list_get(list, 4), cmp));
+    ASSERT_FALSE(strings_equal(list_get(list, 5), cmp));
+
     free_string(str);
     free_string(cmp);
     free_list(sorted);
@@ -42,6 +42,8 @@ int main() {
 
     int two = 2;
     ASSERT_FALSE(map_has(map, &two));
+    ASSERT_NULL(map_get(map, &two));
+    ASSERT_NULL(map_get_mutable(map, &two));
 
     for (size_t i = 1; i <= 100; i++) {
         int key = i;
@@ -63,5 +65,8 @@ int main() {
         ASSERT_EQUAL(* (int *) map_get(copy, &i), i * 2);
     }
 
+    free_map(copy);
+    free_map(map);
+
     return test_status();
 }
@@ -0,0 +1,54 @@
+#include "test/test.h"
+#include "utils/scan.h"
+
+#include <string.h>
+
+#define LONG_LEN 100
+
+int main() {
+    ASSERT_EQUAL(scan_find_char("", 0, 'a'), 0);
+    ASSERT_EQUAL(scan_find_char("abc", 3, 'c'), 2);
+    ASSERT_EQUAL(scan_find_char("abc", 3, 'd'), 3);
+    ASSERT_EQUAL(scan_find_char("abc", 2, 'c'), 2);
+
+    ASSERT_EQUAL(scan_find_either("ab\\c\"", 5, '"', '\\'), 2);
+    ASSERT_EQUAL(scan_find_either("abc", 3, '"', '\\'), 3);
+
+    ASSERT_EQUAL(scan_find_any("ab'c]", 5, "]\"'<"), 2);
+    ASSERT_EQUAL(scan_find_any("abc", 3, "]\"'<"), 3);
+    ASSERT_EQUAL(scan_find_any("a\0b", 3, "b"), 2);
+
+    ASSERT_EQUAL(scan_skip_space(" \t\r\n\v\fx", 7), 6);
+    ASSERT_EQUAL(scan_skip_space("x ", 2), 0);
+    ASSERT_EQUAL(scan_skip_space("   ", 3), 3);
+
+    ASSERT_EQUAL(scan_name_end("aZ_09)", 6), 5);
+    ASSERT_EQUAL(scan_name_end("az@", 3), 2);
+    ASSERT_EQUAL(scan_name_end("az[", 3), 2);
+    ASSERT_EQUAL(scan_name_end("\xe1", 1), 0);
+
+    // Check every position in a buffer long enough to go through the
+    // vectorized paths, along with the scalar tail
+    char buf[LONG_LEN];
+    for (size_t i = 0; i < LONG_LEN; i++) {
+        memset(buf, ' ', LONG_LEN);
+        buf[i] = '"';
+        ASSERT_EQUAL(scan_find_char(buf, LONG_LEN, '"'), i);
+        ASSERT_EQUAL(scan_find_either(buf, LONG_LEN, '\\', '"'), i);
+        ASSERT_EQUAL(scan_find_any(buf, LONG_LEN, "]'\"<"), i);
+        ASSERT_EQUAL(scan_skip_space(buf, LONG_LEN), i);
+
+        memset(buf, 'q', LONG_LEN);
+        buf[i] = ')';
+        ASSERT_EQUAL(scan_name_end(buf, LONG_LEN), i);
+    }
+
+    memset(buf, '\n', LONG_LEN);
+    ASSERT_EQUAL(scan_skip_space(buf, LONG_LEN), LONG_LEN);
+    ASSERT_EQUAL(scan_find_char(buf, LONG_LEN, '"'), LONG_LEN);
+
+    memset(buf, '_', LONG_LEN);
+    ASSERT_EQUAL(scan_name_end(buf, LONG_LEN), LONG_LEN);
+
+    return test_status();
+}
@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "test/test.h"
+#include "utils/stream.h"
+#include "utils/string.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_FILENAME "stream-test.tmp"
+#define TEST_FIFO_NAME "stream-test.fifo"
+
+static void write_test_file(const char *contents) {
+    FILE *fp = fopen(TEST_FILENAME, "w");
+    fputs(contents, fp);
+    fclose(fp);
+}
+
+int main() {
+    String *str = string_from_chars("ab\nc");
+    Stream *stream = stream_from_string(str);
+
+    ASSERT_FALSE(stream_ended(stream));
+    ASSERT_EQUAL(stream_get_char(stream), 'a');
+    ASSERT_EQUAL(stream_get_line(stream), 1);
+    ASSERT_EQUAL(stream_get_col(stream), 1);
+    ASSERT_EQUAL(stream_get_char(stream), 'b');
+    ASSERT_EQUAL(stream_get_char(stream), '\n');
+    ASSERT_EQUAL(stream_get_char(stream), 'c');
+    ASSERT_EQUAL(stream_get_line(stream), 2);
+    ASSERT_EQUAL(stream_get_col(stream), 1);
+    ASSERT_TRUE(stream_ended(stream));
+
+    stream_unget(stream);
+    ASSERT_FALSE(stream_ended(stream));
+    ASSERT_EQUAL(stream_get_char(stream), 'c');
+
+    stream_seek(stream, 1);
+    ASSERT_EQUAL(stream_get_offset(stream), 1);
+    ASSERT_EQUAL(stream_get_char(stream), 'b');
+    stream_seek(stream, 10);
+    ASSERT_TRUE(stream_ended(stream));
+
+    free_stream(stream);
+    free_string(str);
+
+    String *path = string_from_chars(TEST_FILENAME);
+
+    write_test_file("{M[m]}\n");
+    stream = stream_from_path(path);
+    if (ASSERT_NOT_NULL(stream)) {
+        ASSERT_TRUE(strings_equal(stream_get_name(stream), path));
+        ASSERT_EQUAL(stream_get_char(stream), '{');
+        ASSERT_EQUAL(stream_get_char(stream), 'M');
+        ASSERT_EQUAL(stream_get_char(stream), '[');
+        ASSERT_EQUAL(stream_get_char(stream), 'm');
+        ASSERT_EQUAL(stream_get_char(stream), ']');
+        ASSERT_EQUAL(stream_get_char(stream), '}');
+        ASSERT_EQUAL(stream_get_char(stream), '\n');
+        ASSERT_TRUE(stream_ended(stream));
+        free_stream(stream);
+    }
+
+    write_test_file("");
+    stream = stream_from_path(path);
+    if (ASSERT_NOT_NULL(stream)) {
+        ASSERT_TRUE(stream_ended(stream));
+        free_stream(stream);
+    }
+
+    remove(TEST_FILENAME);
+
+    ASSERT_NULL(stream_from_path(path));
+
+    free_string(path);
+
+    // FIFOs can't be mapped, so they're read in chunks instead
+    path = string_from_chars(TEST_FIFO_NAME);
+    remove(TEST_FIFO_NAME);
+
+    if (ASSERT_FALSE(mkfifo(TEST_FIFO_NAME, 0600))) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            FILE *fp = fopen(TEST_FIFO_NAME, "w");
+            for (int i = 0; i < 20000; i++) {
+                fputs("{M[m]}\n", fp);
+            }
+            fclose(fp);
+            _exit(0);
+        }
+
+        stream = stream_from_path(path);
+        waitpid(pid, NULL, 0);
+
+        if (ASSERT_NOT_NULL(stream)) {
+            size_t len = 0;
+            size_t mismatches = 0;
+            while (!stream_ended(stream)) {
+                mismatches += stream_get_char(stream) != "{M[m]}\n"[len % 7];
+                len++;
+            }
+            ASSERT_EQUAL(len, 140000);
+            ASSERT_EQUAL(mismatches, 0);
+            free_stream(stream);
+        }
+
+        remove(TEST_FIFO_NAME);
+    }
+
+    free_string(path);
+
+    return test_status();
+}